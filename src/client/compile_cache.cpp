@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2016-2017, Egor Pugin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "compile_cache.h"
+
+#include <hash.h>
+
+#include <boost/algorithm/string.hpp>
+#include <primitives/command.h>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string_view>
+
+#define OBJECT_EXTENSION ".o"
+#define STDERR_EXTENSION ".stderr"
+
+namespace
+{
+
+struct CompileCommand
+{
+    Strings args;
+    Strings key_args; // args that are not consumed by the preprocessor
+    path output;
+    path source;
+    bool compile = false;
+    bool cacheable = true;
+    bool deps = false; // -MD, -MMD
+    bool depfile = false; // -MF
+    bool deps_target = false; // -MT, -MQ
+    bool debug_info = false; // -g*, except -g0
+};
+
+const std::set<String> source_extensions = {
+    ".c", ".cc", ".cpp", ".cxx", ".c++", ".C", ".m", ".mm", ".s", ".S", ".sx",
+};
+
+// options with values in the next argument
+const std::set<String> options_with_value = {
+    "-o", "-x", "-MF", "-MT", "-MQ",
+    "-I", "-D", "-U", "-include", "-imacros", "-isystem", "-iquote", "-idirafter",
+    "-iprefix", "-iwithprefix", "-iwithprefixbefore", "-isysroot",
+    "-arch", "-target", "-Xclang", "-Xpreprocessor", "-Xassembler",
+};
+
+// these options are fully applied by the preprocessor
+bool is_preprocessor_option(const String &a)
+{
+    for (auto &o : { "-I", "-D", "-U", "-include", "-imacros", "-isystem", "-iquote",
+        "-idirafter", "-iprefix", "-iwithprefix", "-isysroot", "-MF", "-MT", "-MQ", "-MD", "-MMD" })
+    {
+        if (a.find(o) == 0)
+            return true;
+    }
+    return false;
+}
+
+// side outputs cannot be restored from the cache
+bool has_side_outputs(const String &a)
+{
+    for (auto &o : { "-save-temps", "--coverage", "-ftest-coverage", "-fprofile-", "-gsplit-dwarf", "-fdump-", "-MJ" })
+    {
+        if (a.find(o) == 0)
+            return true;
+    }
+    return false;
+}
+
+CompileCommand parse(const Strings &args)
+{
+    CompileCommand c;
+    c.args = args;
+
+    int n_sources = 0;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        auto &a = args[i];
+        String value;
+        bool separate_value = options_with_value.find(a) != options_with_value.end();
+        if (separate_value)
+        {
+            if (i + 1 == args.size())
+            {
+                c.cacheable = false;
+                break;
+            }
+            value = args[++i];
+        }
+
+        if (a.find("-g") == 0 && a != "-g0")
+            c.debug_info = true;
+
+        if (a == "-c")
+            c.compile = true;
+        else if (a == "-o")
+            c.output = value;
+        else if (a.find("-o") == 0 && !separate_value)
+            c.output = a.substr(2);
+        else if (a == "-MD" || a == "-MMD")
+            c.deps = true;
+        else if (a.find("-MF") == 0)
+            c.depfile = true;
+        else if (a.find("-MT") == 0 || a.find("-MQ") == 0)
+            c.deps_target = true;
+        else if (a == "-E" || a == "-S" || a == "-M" || a == "-MM" || a == "-" || has_side_outputs(a))
+            c.cacheable = false;
+        else if (a[0] != '-' && !separate_value)
+        {
+            if (source_extensions.find(path(a).extension().string()) == source_extensions.end())
+                c.cacheable = false;
+            c.source = a;
+            n_sources++;
+            continue;
+        }
+
+        if (is_preprocessor_option(a) || a == "-o" || (a.find("-o") == 0 && !separate_value))
+            continue;
+        c.key_args.push_back(a);
+        if (separate_value)
+            c.key_args.push_back(value);
+    }
+
+    if (!c.compile || c.output.empty() || n_sources != 1)
+        c.cacheable = false;
+    return c;
+}
+
+String compiler_identity(path compiler)
+{
+    // bare names are found on PATH, so the identity changes with the compiler
+    if (!compiler.has_parent_path())
+    {
+        auto r = primitives::resolve_executable(compiler);
+        if (!r.empty())
+            compiler = r;
+    }
+    String s = compiler.string();
+    std::error_code ec;
+    auto size = fs::file_size(compiler, ec);
+    if (!ec)
+        s += " " + std::to_string(size);
+    auto t = fs::last_write_time(compiler, ec);
+    if (!ec)
+        s += " " + std::to_string(t.time_since_epoch().count());
+    return s;
+}
+
+// line markers (# 1 "/path/to/file.h") have absolute paths of the source
+// and all headers, so paths under base dirs are made relative to them
+String relative_line_markers(const String &text, const Files &base_dirs)
+{
+    // longest first, base dirs may be nested
+    // all of them get one name, their order differs between machines
+    Strings bases;
+    for (auto &b : base_dirs)
+    {
+        auto s = normalize_path(b);
+        if (s.empty())
+            continue;
+        if (s.back() != '/')
+            s += '/';
+        bases.push_back(s);
+    }
+    std::sort(bases.begin(), bases.end(), [](const auto &a, const auto &b) { return a.size() > b.size(); });
+
+    String out;
+    out.reserve(text.size());
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        auto end = text.find('\n', pos);
+        end = end == text.npos ? text.size() : end + 1;
+        std::string_view line(text.data() + pos, end - pos);
+        pos = end;
+
+        // '# 12 "file"' or '#line 12 "file"'
+        bool marker =
+            (line.size() > 2 && line[0] == '#' && line[1] == ' ' && isdigit((unsigned char)line[2])) ||
+            line.compare(0, 6, "#line ") == 0;
+        size_t b, e;
+        if (!marker || (b = line.find('"')) == line.npos || (e = line.rfind('"')) == b)
+        {
+            out.append(line.data(), line.size());
+            continue;
+        }
+
+        // windows paths are escaped
+        auto p = boost::replace_all_copy(String(line.substr(b + 1, e - b - 1)), "\\\\", "/");
+        for (auto &base : bases)
+        {
+            if (p.compare(0, base.size(), base) == 0)
+            {
+                p = "<base>/" + p.substr(base.size());
+                break;
+            }
+        }
+        out.append(line.data(), b + 1);
+        out += p;
+        out.append(line.data() + e, line.size() - e);
+    }
+    return out;
+}
+
+int run(primitives::Command &c, String *err = nullptr)
+{
+    std::error_code ec;
+    c.execute(ec);
+    std::cout << c.out.text;
+    std::cerr << c.err.text;
+    if (ec && !c.exit_code)
+    {
+        std::cerr << "cppan: cannot run " << c.print() << ": " << ec.message() << "\n";
+        return 1;
+    }
+    if (err)
+        *err = c.err.text;
+    return c.exit_code ? c.exit_code.value() : 1;
+}
+
+int run_compiler(const Strings &args)
+{
+    primitives::Command c;
+    c.program = args[0];
+    c.args.assign(args.begin() + 1, args.end());
+    return run(c);
+}
+
+}
+
+int compile_with_cache(const path &cache_dir, const Files &base_dirs, const Strings &args)
+{
+    if (args.empty())
+    {
+        std::cerr << "usage: cppan internal-compile cache_dir [base_dirs... --] compiler args...\n";
+        return 1;
+    }
+
+    auto cmd = parse(args);
+    if (!cmd.cacheable)
+        return run_compiler(args);
+
+    // preprocess with the same args, dependency file is written here too
+    primitives::Command pp;
+    pp.program = args[0];
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        auto &a = args[i];
+        if (a == "-c")
+            continue;
+        if (a == "-o")
+        {
+            i++;
+            continue;
+        }
+        if (a.find("-o") == 0)
+            continue;
+        pp.args.push_back(a);
+    }
+    pp.args.push_back("-E");
+    // without -o compiler takes default names from the output
+    if (cmd.deps && !cmd.depfile)
+    {
+        pp.args.push_back("-MF");
+        pp.args.push_back(path(cmd.output).replace_extension(".d").string());
+    }
+    if (cmd.deps && !cmd.deps_target)
+    {
+        pp.args.push_back("-MT");
+        pp.args.push_back(cmd.output.string());
+    }
+    std::error_code ec;
+    pp.execute(ec);
+    if (ec || !pp.exit_code || pp.exit_code.value())
+        return run_compiler(args);
+
+    // debug info has absolute paths of sources and of the working dir,
+    // such objects are shared only within the same tree
+    String location;
+    if (cmd.debug_info)
+    {
+        location = normalize_path(fs::current_path());
+        for (auto &b : base_dirs)
+            location += "\n" + normalize_path(b);
+    }
+
+    auto key = sha256(compiler_identity(args[0]) + "\n" +
+        boost::join(cmd.key_args, " ") + "\n" +
+        location + "\n" +
+        relative_line_markers(pp.out.text, base_dirs));
+    auto dir = cache_dir / key.substr(0, 2);
+    auto object = dir / (key + OBJECT_EXTENSION);
+    auto stderr_file = dir / (key + STDERR_EXTENSION);
+
+    // hit
+    if (fs::exists(object))
+    {
+        fs::copy_file(object, cmd.output, fs::copy_options::overwrite_existing, ec);
+        if (!ec)
+        {
+            if (fs::exists(stderr_file))
+                std::cerr << read_file(stderr_file);
+            return 0;
+        }
+    }
+
+    // miss
+    primitives::Command c;
+    c.program = args[0];
+    c.args.assign(args.begin() + 1, args.end());
+    String err;
+    auto r = run(c, &err);
+    if (r)
+        return r;
+
+    // store, other processes may write the same object at the same time
+    auto tmp = path(object).replace_extension("." + std::to_string(std::random_device()()));
+    fs::create_directories(dir, ec);
+    fs::copy_file(cmd.output, tmp, fs::copy_options::overwrite_existing, ec);
+    if (!ec)
+    {
+        if (!err.empty())
+            write_file(stderr_file, err);
+        fs::rename(tmp, object, ec);
+    }
+    if (ec)
+        fs::remove(tmp, ec);
+    return 0;
+}
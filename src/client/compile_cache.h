@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2016-2017, Egor Pugin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cppan_string.h>
+#include <filesystem.h>
+
+// Compiler launcher with content addressed object cache.
+//
+// Objects are stored by hash of the preprocessed source, compiler identity
+// and flags that are not consumed by the preprocessor,
+// so the same translation unit built in another config or storage dir is a hit.
+// Only gcc compatible single source compilations (-c -o) are cached,
+// everything else is passed to the compiler as is.
+//
+// base_dirs: paths under them are hashed relative to them (storage and source dirs)
+// args: compiler and its arguments
+int compile_with_cache(const path &cache_dir, const Files &base_dirs, const Strings &args);
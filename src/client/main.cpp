@@ -15,22 +15,27 @@
  */
 
 #include "build.h"
+#include "compile_cache.h"
 #include "fix_imports.h"
 #include "options.h"
 #include "autotools.h"
+#include "watch.h"
 
 #include <access_table.h>
 #include <api.h>
 #include <config.h>
+#include <counters.h>
 #include <database.h>
 #include <exceptions.h>
 #include <filesystem.h>
 #include <hash.h>
 #include <http.h>
+#include <jobserver.h>
 #include <printers/cmake.h>
 #include <program.h>
 #include <resolver.h>
 #include <settings.h>
+#include <trace.h>
 #include <verifier.h>
 
 #include <boost/algorithm/string.hpp>
@@ -58,6 +63,7 @@ void check_spec_file();
 void default_run();
 void init(const Strings &args, const String &log_level);
 void load_current_config();
+void print_checks_report();
 void self_upgrade();
 void self_upgrade_copy(const path &dst);
 optional<int> internal(const Strings &args);
@@ -70,14 +76,38 @@ try
     for (auto i = 0; i < argc; i++)
         args.push_back(argv[i]);
 
+    // compiler launcher is started for every source file,
+    // it does not need any init and its args are compiler's ones
+    // internal-compile cache_dir base_dirs... -- compiler args...
+    if (args.size() > 2 && args[1] == "internal-compile")
+    {
+        auto sep = std::find(args.begin() + 3, args.end(), "--");
+        if (sep == args.end())
+            return compile_with_cache(args[2], {}, Strings(args.begin() + 3, args.end()));
+        return compile_with_cache(args[2], Files(args.begin() + 3, sep), Strings(sep + 1, args.end()));
+    }
+
     String log_level = "info";
 
     // set correct working directory to look for config file
     std::unique_ptr<ScopedCurrentPath> cp;
 
+    path trace_file;
+    bool print_stats = false;
+    int jobs = 0;
+
+    // options of this process that a resident watcher would not see
+    bool local_options = false;
+
     // do manual checks of critical arguments
     {
         Strings args_copy = args;
+        // indices of args and args_copy differ after the first erase
+        auto erase_arg = [&args, &args_copy](size_t i, int n)
+        {
+            auto j = std::find(args_copy.begin(), args_copy.end(), args[i]);
+            args_copy.erase(j, j + n);
+        };
         for (size_t i = 1; i < args.size(); i++)
         {
             // working dir
@@ -87,37 +117,101 @@ try
                     cp = std::make_unique<ScopedCurrentPath>(args[i + 1], CurrentPathScope::All);
                 else
                     throw std::runtime_error("Missing necessary argument for "s + args[i] + " option");
-                args_copy.erase(args_copy.begin() + i, args_copy.begin() + i + 2);
+                erase_arg(i, 2);
             }
 
             // verbosity
             if (args[i] == "-v"s || args[i] == "--verbose"s)
             {
                 log_level = "debug";
-                args_copy.erase(args_copy.begin() + i, args_copy.begin() + i + 1);
+                local_options = true;
+                erase_arg(i, 1);
             }
             if (args[i] == "--trace"s)
             {
                 log_level = "trace";
-                args_copy.erase(args_copy.begin() + i, args_copy.begin() + i + 1);
+                local_options = true;
+                erase_arg(i, 1);
             }
 
             // additional build args
             if (args[i] == "--"s)
             {
+                // options before it may be already removed from args_copy
+                auto j = std::find(args_copy.begin(), args_copy.end(), args[i]);
                 auto &s = Settings::get_user_settings();
-                s.additional_build_args.assign(args_copy.begin() + i + 1, args_copy.end());
-                args_copy.erase(args_copy.begin() + i, args_copy.end());
+                s.additional_build_args.assign(j + 1, args_copy.end());
+                args_copy.erase(j, args_copy.end());
+                local_options = true;
+                // the rest belongs to the build tool
+                break;
             }
 
             if (args[i] == "--self-upgrade")
             {
                 Settings::get_user_settings().disable_update_checks = true;
             }
+
+            if (args[i] == "--stats")
+            {
+                print_stats = true;
+                local_options = true;
+                erase_arg(i, 1);
+            }
+
+            // must be known before any phase starts
+            if (args[i].find("--trace-file") == 0)
+            {
+                auto n = 1;
+                if (args[i].find("--trace-file=") == 0)
+                    trace_file = args[i].substr(args[i].find('=') + 1);
+                else if (i + 1 < args.size())
+                    trace_file = args[i + n++];
+                else
+                    throw std::runtime_error("Missing necessary argument for "s + args[i] + " option");
+                local_options = true;
+                erase_arg(i, n);
+            }
+
+            // jobserver is passed to children before they are started
+            if (args[i] == "-j"s || args[i].find("--jobs") == 0)
+            {
+                auto n = 1;
+                String v;
+                if (args[i].find("--jobs=") == 0)
+                    v = args[i].substr(args[i].find('=') + 1);
+                else if (i + 1 < args.size())
+                    v = args[i + n++];
+                else
+                    throw std::runtime_error("Missing necessary argument for "s + args[i] + " option");
+                size_t end = 0;
+                try
+                {
+                    jobs = std::stoi(v, &end);
+                }
+                catch (std::exception &)
+                {
+                }
+                if (v.empty() || end != v.size())
+                    throw std::runtime_error("Bad number of jobs for "s + args[i] + " option: " + v);
+                local_options = true;
+                erase_arg(i, n);
+            }
         }
         args = args_copy;
     }
 
+    trace_init(trace_file, args.size() > 1 ? "cppan " + args[1] : "cppan");
+    counters_init(print_stats);
+    jobserver_init(jobs);
+
+    // resident cppan is running for this dir, let it do the work
+    if (args.size() == 1 && !local_options)
+    {
+        if (auto r = watch_request(current_thread_path()))
+            return r.value();
+    }
+
     // main cppan client init routine
     init(args, log_level);
 
@@ -304,6 +398,11 @@ try
         c.clear_vars_cache();
         return 0;
     }
+    if (options["checks-report"].as<bool>())
+    {
+        print_checks_report();
+        return 0;
+    }
     if (options().count(CLEAN_PACKAGES))
     {
         auto fs = CleanTarget::getStrings();
@@ -466,6 +565,9 @@ try
         return 0;
     }
 
+    if (options["watch"].as<bool>())
+        return watch(current_thread_path());
+
     default_run();
 
     return 0;
@@ -486,6 +588,8 @@ catch (...)
 int main(int argc, char *argv[])
 {
     auto r = main1(argc, argv);
+    trace_save();
+    counters_print();
     return r;
 }
 
@@ -548,7 +652,10 @@ void init(const Strings &args, const String &log_level)
     if (!init)
         us.disable_update_checks = true;
 
-    load_current_config();
+    {
+        TRACE_SCOPE("settings load");
+        load_current_config();
+    }
     getServiceDatabase(init);
 }
 
@@ -571,6 +678,27 @@ void load_current_config()
     httpSettings.proxy = Settings::get_local_settings().proxy;
 }
 
+void print_checks_report()
+{
+    auto r = getServiceDatabase().getChecksReport(20);
+    auto sec = [](int ms)
+    {
+        return std::to_string(ms / 1000) + "." + std::to_string(ms % 1000 / 100) + " s";
+    };
+
+    std::cout << "Slowest checks (average over configs):\n";
+    for (auto &i : r.slowest)
+        std::cout << "    " << i.name << ": " << sec(i.time) << " (" << i.n << " configs)\n";
+
+    std::cout << "\nCheck time per package:\n";
+    for (auto &i : r.packages)
+        std::cout << "    " << i.name << ": " << sec(i.time) << " (" << i.n << " checks)\n";
+
+    std::cout << "\nChecks with the same value in all configs:\n";
+    for (auto &i : r.constant)
+        std::cout << "    " << i.name << " = " << i.value << " (" << i.n << " configs)\n";
+}
+
 void self_upgrade()
 {
 #ifdef _WIN32
@@ -681,7 +809,7 @@ optional<int> internal(const Strings &args)
         if (args.size() < 7)
         {
             std::cout << "invalid number of arguments: " << args.size() << "\n";
-            std::cout << "usage: cppan internal-parallel-vars-check cmake_binary vars_dir vars_file checks_file generator system_version toolset toolchain\n";
+            std::cout << "usage: cppan internal-parallel-vars-check cmake_binary vars_dir vars_file checks_file generator system_version toolset toolchain [c_compiler cxx_compiler c_flags cxx_flags]\n";
             return 1;
         }
 
@@ -697,6 +825,10 @@ optional<int> internal(const Strings &args)
         ASSIGN_ARG(system_version);
         ASSIGN_ARG(toolset);
         ASSIGN_ARG(toolchain);
+        ASSIGN_ARG(c_compiler);
+        ASSIGN_ARG(cxx_compiler);
+        ASSIGN_ARG(c_flags);
+        ASSIGN_ARG(cxx_flags);
 #undef ASSIGN_ARG
 
         CMakePrinter c;
@@ -727,7 +859,12 @@ optional<int> internal(const Strings &args)
             c.working_directory = wd;
             c.program = prog;
             c.args.push_back(arg);
-            e.push([c]() mutable { c.execute(); });
+            counter_add(Counter::ProcessesSpawned);
+            e.push([c]() mutable
+            {
+                JobToken t;
+                c.execute();
+            });
         }
         e.wait();
 
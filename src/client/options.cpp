@@ -47,11 +47,17 @@ ProgramOptions::ProgramOptions()
 
         ("settings", po::value<std::string>()->default_value(""), "file to take settings from")
 
+        ("watch", po::bool_switch(), "stay resident, regenerate on file changes and run-cppan requests")
+
         ("verbose,v", po::bool_switch(), "verbose output")
         ("trace", po::bool_switch(), "trace output")
+        ("trace-file", po::value<String>(), "write timings of main phases to file in chrome trace-event format")
+        ("jobs,j", po::value<int>(), "max number of jobs (processes) of the whole build, shared with children via make jobserver")
+        ("stats", po::bool_switch(), "print counters of sql statements, file operations, downloads etc. on exit")
 
         ("clear-cache", po::bool_switch(), "clear CMakeCache.txt files")
         ("clear-vars-cache", po::bool_switch(), "clear checked symbols, types, includes etc.")
+        ("checks-report", po::bool_switch(), "print slowest checks, check time per package and checks with the same value in all configs")
         (CLEAN_PACKAGES, po::value<Strings>()->multitoken(), "completely clean package files for matched regex")
         (CLEAN_CONFIGS, po::value<Strings>()->multitoken(), "clean config dirs and files")
 
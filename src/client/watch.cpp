@@ -0,0 +1,408 @@
+/*
+ * Copyright (C) 2016-2017, Egor Pugin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "watch.h"
+
+#include <access_table.h>
+#include <package_store.h>
+#include <printers/printer.h>
+#include <settings.h>
+
+#include <primitives/date_time.h>
+#include <primitives/templates.h>
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include <primitives/log.h>
+//DECLARE_STATIC_LOGGER(logger, "watch");
+
+#define WATCH_SOCKET_FILENAME "watch.sock"
+
+// from main.cpp
+void default_run();
+void load_current_config();
+
+// wait for more events before regenerating
+static const auto debounce_time = std::chrono::milliseconds(200);
+
+static path get_socket_filename(const path &dir)
+{
+    return dir / Settings::get_local_settings().cppan_dir / WATCH_SOCKET_FILENAME;
+}
+
+static bool skip_directory(const path &p)
+{
+    auto &s = Settings::get_local_settings();
+    auto fn = p.filename().string();
+    // hidden dirs contain our own generated files (.cppan)
+    if (fn.empty() || fn[0] == '.')
+        return true;
+    if (fn.find(CPPAN_LOCAL_BUILD_PREFIX) == 0)
+        return true;
+    return p.filename() == s.build_dir.filename() || p.filename() == s.output_dir.filename();
+}
+
+struct Watcher
+{
+    path root;
+    bool dirty = false;
+    bool config_changed = false;
+    std::chrono::steady_clock::time_point last_event;
+
+#ifdef __linux__
+    int inotify_fd = -1;
+    std::unordered_map<int, path> watches;
+    Files watched_dirs;
+#else
+    // configs and sources of the last run and their dirs,
+    // dir stamps change when files are added or removed
+    std::unordered_map<path, fs::file_time_type> stamps;
+#endif
+
+#ifndef _WIN32
+    int socket_fd = -1;
+#endif
+
+    Watcher(const path &root)
+        : root(root)
+    {
+#ifdef __linux__
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd == -1)
+            throw std::runtime_error("Cannot init inotify, errno = " + std::to_string(errno));
+#endif
+        add_tree(root);
+        open_socket();
+    }
+
+    ~Watcher()
+    {
+#ifdef __linux__
+        if (inotify_fd != -1)
+            close(inotify_fd);
+#endif
+#ifndef _WIN32
+        if (socket_fd != -1)
+        {
+            close(socket_fd);
+            error_code ec;
+            fs::remove(get_socket_filename(root), ec);
+        }
+#endif
+    }
+
+    void add_tree(const path &dir)
+    {
+#ifdef __linux__
+        add_dir(dir);
+        error_code ec;
+        for (auto i = fs::recursive_directory_iterator(dir, ec); i != fs::recursive_directory_iterator(); i.increment(ec))
+        {
+            if (ec)
+                break;
+            if (!fs::is_directory(i->path()))
+                continue;
+            if (skip_directory(i->path()))
+            {
+                i.disable_recursion_pending();
+                continue;
+            }
+            add_dir(i->path());
+        }
+#endif
+    }
+
+    void track_files()
+    {
+#ifndef __linux__
+        Files files;
+        files.insert(root / CPPAN_FILENAME);
+        for (auto &d : rd.get_local_package_dirs())
+            files.insert(d / CPPAN_FILENAME);
+        for (auto &[pkg, pc] : rd)
+        {
+            if (!pc.config || !(pkg == Package() || pkg.ppath.is_loc() || pkg.flags[pfLocalProject]))
+                continue;
+            for (auto &[n, p] : pc.config->getProjects())
+                files.insert(p.files.begin(), p.files.end());
+        }
+        Files dirs{ root };
+        for (auto &f : files)
+            dirs.insert(f.parent_path());
+        files.insert(dirs.begin(), dirs.end());
+
+        stamps.clear();
+        error_code ec;
+        for (auto &f : files)
+            stamps[f] = fs::last_write_time(f, ec);
+#endif
+    }
+
+    void add_dir(const path &dir)
+    {
+#ifdef __linux__
+        if (watched_dirs.find(dir) != watched_dirs.end())
+            return;
+        auto wd = inotify_add_watch(inotify_fd, dir.string().c_str(),
+            IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+        if (wd == -1)
+        {
+            LOG_WARN(logger, "Cannot watch directory: " + dir.string());
+            return;
+        }
+        watches[wd] = dir;
+        watched_dirs.insert(dir);
+#endif
+    }
+
+    void open_socket()
+    {
+#ifndef _WIN32
+        auto fn = get_socket_filename(root);
+        sockaddr_un addr = { 0 };
+        if (fn.string().size() >= sizeof(addr.sun_path))
+        {
+            LOG_WARN(logger, "Socket path is too long, regeneration requests will not be served: " + fn.string());
+            return;
+        }
+        fs::create_directories(fn.parent_path());
+        error_code ec;
+        fs::remove(fn, ec);
+
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, fn.string().c_str());
+
+        socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (socket_fd == -1)
+            throw std::runtime_error("Cannot create socket, errno = " + std::to_string(errno));
+        if (bind(socket_fd, (sockaddr *)&addr, sizeof(addr)) == -1 || listen(socket_fd, 8) == -1)
+            throw std::runtime_error("Cannot listen on " + fn.string() + ", errno = " + std::to_string(errno));
+#endif
+    }
+
+    void on_change(const path &p)
+    {
+        if (p.filename() == CPPAN_FILENAME)
+            config_changed = true;
+        dirty = true;
+        last_event = std::chrono::steady_clock::now();
+    }
+
+    void read_events()
+    {
+#ifdef __linux__
+        alignas(inotify_event) char buf[16 * 1024];
+        ssize_t len;
+        while ((len = read(inotify_fd, buf, sizeof(buf))) > 0)
+        {
+            for (auto ptr = buf; ptr < buf + len; ptr += sizeof(inotify_event) + ((inotify_event *)ptr)->len)
+            {
+                auto e = (inotify_event *)ptr;
+                auto i = watches.find(e->wd);
+                if (i == watches.end() || e->len == 0)
+                    continue;
+                auto p = i->second / e->name;
+                if (e->mask & IN_ISDIR)
+                {
+                    if (skip_directory(p))
+                        continue;
+                    if (e->mask & (IN_CREATE | IN_MOVED_TO))
+                        add_tree(p);
+                }
+                on_change(p);
+            }
+        }
+#else
+        // no native notifications here yet, poll timestamps of tracked files
+        error_code ec;
+        for (auto &[f, t] : stamps)
+        {
+            auto t2 = fs::last_write_time(f, ec);
+            if (t2 == t)
+                continue;
+            t = t2;
+            on_change(f);
+        }
+#endif
+    }
+
+    void regenerate(AccessTable &access_table)
+    {
+        LOG_INFO(logger, "Regenerating " + root.string());
+
+        auto t = get_time<std::chrono::milliseconds>([this]
+        {
+            // remote packages are kept loaded, local ones are refound
+            rd.clear_local_packages();
+            if (config_changed)
+                load_current_config();
+            default_run();
+        });
+
+        dirty = false;
+        config_changed = false;
+
+        // local deps may live outside of the root
+        for (auto &d : rd.get_local_package_dirs())
+            add_tree(d);
+        track_files();
+
+        access_table.flush();
+
+        LOG_INFO(logger, "Done in " + std::to_string(t) + " ms");
+    }
+
+    int safe_regenerate(AccessTable &access_table)
+    {
+        try
+        {
+            regenerate(access_table);
+            return 0;
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR(logger, e.what());
+        }
+        // keep watching at least configs
+        track_files();
+        dirty = false;
+        config_changed = false;
+        return 1;
+    }
+
+    void serve_request(AccessTable &access_table)
+    {
+#ifndef _WIN32
+        auto fd = accept(socket_fd, nullptr, nullptr);
+        if (fd == -1)
+            return;
+        SCOPE_EXIT
+        {
+            close(fd);
+        };
+
+        // request is run-cppan re-run, usually because of changed cppan.yml
+        char c;
+        while (read(fd, &c, 1) == 1 && c != '\n')
+            ;
+        config_changed = true;
+        auto r = std::to_string(safe_regenerate(access_table)) + "\n";
+        write(fd, r.c_str(), r.size());
+#endif
+    }
+
+    int run()
+    {
+        // keep stamps loaded during the whole session
+        AccessTable access_table;
+
+        safe_regenerate(access_table);
+
+        LOG_INFO(logger, "Watching " + root.string() + " for changes. Press Ctrl+C to exit.");
+        while (1)
+        {
+            auto timeout = std::chrono::milliseconds(dirty ? debounce_time.count() : 1000);
+#ifndef _WIN32
+            std::vector<pollfd> fds;
+#ifdef __linux__
+            fds.push_back({ inotify_fd, POLLIN, 0 });
+#endif
+            if (socket_fd != -1)
+                fds.push_back({ socket_fd, POLLIN, 0 });
+            poll(fds.data(), fds.size(), (int)timeout.count());
+
+            for (auto &f : fds)
+            {
+                if (!(f.revents & POLLIN))
+                    continue;
+                if (f.fd == socket_fd)
+                    serve_request(access_table);
+                else
+                    read_events();
+            }
+#else
+            std::this_thread::sleep_for(timeout);
+#endif
+#ifndef __linux__
+            read_events();
+#endif
+            if (dirty && std::chrono::steady_clock::now() - last_event >= debounce_time)
+                safe_regenerate(access_table);
+        }
+        return 0;
+    }
+};
+
+int watch(const path &dir)
+{
+    Watcher w(fs::canonical(fs::absolute(dir)));
+    return w.run();
+}
+
+optional<int> watch_request(const path &dir)
+{
+#ifdef _WIN32
+    return {};
+#else
+    auto fn = get_socket_filename(dir);
+    sockaddr_un addr = { 0 };
+    if (fn.string().size() >= sizeof(addr.sun_path))
+        return {};
+    error_code ec;
+    if (!fs::exists(fn, ec))
+        return {};
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, fn.string().c_str());
+
+    auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return {};
+    SCOPE_EXIT
+    {
+        close(fd);
+    };
+
+    // stale socket - watcher is dead, do normal run
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) == -1)
+        return {};
+
+    String req = "regenerate\n";
+    if (write(fd, req.c_str(), req.size()) != (ssize_t)req.size())
+        return {};
+
+    String r;
+    char c;
+    while (read(fd, &c, 1) == 1 && c != '\n')
+        r += c;
+    if (r.empty())
+        return {};
+    return std::stoi(r);
+#endif
+}
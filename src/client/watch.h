@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2016-2017, Egor Pugin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cppan_string.h>
+#include <filesystem.h>
+
+#include <primitives/stdcompat/optional.h>
+
+// stay resident in dir, keep package store, configs, stamps and databases loaded
+// and regenerate on file changes or on requests from run-cppan target
+int watch(const path &dir);
+
+// ask running watcher of dir to regenerate
+// returns nothing if there is no watcher
+optional<int> watch_request(const path &dir);
@@ -16,40 +16,306 @@
 
 #include "access_table.h"
 
+#include "counters.h"
 #include "cppan_string.h"
 #include "database.h"
 #include "directories.h"
+#include "hash.h"
 #include "lock.h"
 #include "stamp.h"
 
-#include <unordered_map>
+#include <primitives/executor.h>
+#include <primitives/stdcompat/optional.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+
+#include <primitives/log.h>
+//DECLARE_STATIC_LOGGER(logger, "access_table");
+
+// files are written in batches on a separate thread
+#define WRITE_BATCH_SIZE 64
 
 struct AccessData
 {
-    Stamps stamps;
+    struct Stamp : FileStamp
+    {
+        // queued for writing, time is not known yet
+        bool pending = false;
+    };
+
+    // keys are normalized paths, so every directory is a contiguous range
+    std::map<String, Stamp> stamps;
+    std::set<String> dirty;
+    // dirs read from db, their subdirs are read too
+    std::set<String> loaded_dirs;
+    // dirs removed since last flush, deleted from db on flush
+    Files removed_dirs;
+    bool all_loaded = false;
     bool do_not_update = false;
-    int refs = 0;
+    std::atomic_int refs{ 0 };
+
+    // guards all containers above and below,
+    // tables are used from download threads and from the writer thread
+    std::mutex m;
+    std::unique_ptr<Executor> writer;
+    std::vector<std::pair<path, String>> batch;
+    std::vector<Future<void>> writes;
+    // errors of background writes, reported by flush()
+    Strings errors;
 
     void load()
     {
-        if (refs++ > 0)
-            return;
-
-        stamps = getServiceDatabase().getFileStamps();
+        // stamps are read lazily by directories
+        refs++;
     }
 
+    // called from destructor, must not throw
     void save()
     {
         if (--refs > 0)
             return;
 
-        getServiceDatabase().setFileStamps(stamps);
+        try
+        {
+            flush();
+        }
+        catch (std::exception &e)
+        {
+            LOG_WARN(logger, e.what());
+        }
+    }
+
+    void flush()
+    {
+        wait_writes();
+        save_stamps();
+
+        std::unique_lock<std::mutex> lk(m);
+        if (errors.empty())
+            return;
+        auto e = std::move(errors);
+        errors.clear();
+        String s = "Cannot write " + std::to_string(e.size()) + " file(s):";
+        for (auto &err : e)
+            s += "\n" + err;
+        throw std::runtime_error(s);
+    }
+
+    void save_stamps()
+    {
+        std::unique_lock<std::mutex> lk(m);
+        if (dirty.empty() && removed_dirs.empty())
+            return;
+
+        Stamps st;
+        for (auto &d : dirty)
+            st[d] = stamps[d];
+        getServiceDatabase().updateFileStamps(st, removed_dirs);
+        dirty.clear();
+        removed_dirs.clear();
     }
 
     void clear()
     {
+        wait_writes();
+
+        std::unique_lock<std::mutex> lk(m);
         stamps.clear();
+        dirty.clear();
+        loaded_dirs.clear();
+        removed_dirs.clear();
         getServiceDatabase().clearFileStamps();
+        // nothing left in db
+        all_loaded = true;
+    }
+
+    // under lock
+    bool is_loaded(path dir) const
+    {
+        if (all_loaded)
+            return true;
+        for (; !dir.empty() && dir != dir.parent_path(); dir = dir.parent_path())
+        {
+            if (loaded_dirs.find(normalize_path(dir)) != loaded_dirs.end())
+                return true;
+        }
+        return false;
+    }
+
+    // under lock
+    void load_dir(const path &dir)
+    {
+        if (is_loaded(dir))
+            return;
+
+        for (auto &s : getServiceDatabase().getFileStamps(dir))
+        {
+            // not flushed removals are still in db
+            bool removed = false;
+            for (auto &r : removed_dirs)
+                removed |= is_under_root(s.first, r);
+            if (removed)
+                continue;
+            Stamp st;
+            (FileStamp &)st = s.second;
+            stamps.emplace(normalize_path(s.first), st);
+        }
+        loaded_dirs.insert(normalize_path(dir));
+    }
+
+    // copy, writer thread may update the stamp
+    optional<Stamp> get(const path &p)
+    {
+        std::unique_lock<std::mutex> lk(m);
+        load_dir(p.parent_path());
+        auto i = stamps.find(normalize_path(p));
+        if (i == stamps.end())
+            return {};
+        return i->second;
+    }
+
+    // file already has these contents, not written by us or stamps were cleared
+    void set_contents(const path &p, const String &hash)
+    {
+        counter_add(Counter::FilesStat);
+        auto t = fs::last_write_time(p);
+
+        std::unique_lock<std::mutex> lk(m);
+        auto k = normalize_path(p);
+        auto &s = stamps[k];
+        s.hash = hash;
+        s.time = t;
+        s.pending = false;
+        dirty.insert(k);
+    }
+
+    bool is_outdated(const path &p)
+    {
+        auto s = get(p);
+        if (!s)
+            return true;
+        if (s->pending)
+            return false;
+        counter_add(Counter::FilesStat);
+        return fs::last_write_time(p) != s->time;
+    }
+
+    // true if p was written by us with the same contents and was not touched since
+    bool has_contents(const path &p, const String &hash)
+    {
+        auto s = get(p);
+        if (!s || s->hash != hash)
+            return false;
+        if (s->pending)
+            return true;
+        counter_add(Counter::FilesStat);
+        error_code ec;
+        return fs::last_write_time(p, ec) == s->time && !ec;
+    }
+
+    void write(const path &p, const String &contents, const String &hash)
+    {
+        std::unique_lock<std::mutex> lk(m);
+        auto &s = stamps[normalize_path(p)];
+        s.hash = hash;
+        s.pending = true;
+
+        batch.emplace_back(p, contents);
+        if (batch.size() >= WRITE_BATCH_SIZE)
+            push_batch();
+    }
+
+    // under lock, does not wait
+    void push_batch()
+    {
+        if (batch.empty())
+            return;
+        if (!writer)
+            writer = std::make_unique<Executor>(1);
+
+        writes.push_back(writer->push([this, b = std::move(batch)]
+        {
+            // errors are kept for flush(), the rest of the batch is still written
+            for (auto &f : b)
+            {
+                fs::file_time_type t;
+                String error;
+                try
+                {
+                    write_file(f.first, f.second);
+                    counter_add(Counter::FilesWritten);
+                    counter_add(Counter::FilesStat);
+                    t = fs::last_write_time(f.first);
+                }
+                catch (std::exception &e)
+                {
+                    error = f.first.string() + ": " + e.what();
+                }
+
+                std::unique_lock<std::mutex> lk(m);
+                auto k = normalize_path(f.first);
+                auto i = stamps.find(k);
+                if (!error.empty())
+                {
+                    errors.push_back(error);
+                    // file is not written, so it is outdated
+                    if (i != stamps.end())
+                        stamps.erase(i);
+                    dirty.erase(k);
+                    continue;
+                }
+                // removed while in queue
+                if (i == stamps.end())
+                    continue;
+                i->second.time = t;
+                i->second.pending = false;
+                dirty.insert(k);
+            }
+        }));
+        batch.clear();
+    }
+
+    // must not be called under lock, writer thread takes it
+    void wait_writes()
+    {
+        std::vector<Future<void>> w;
+        {
+            std::unique_lock<std::mutex> lk(m);
+            push_batch();
+            w = std::move(writes);
+            writes.clear();
+            // writes already taken by other threads are waited by them,
+            // writer has one thread, so this empty job finishes after them too
+            if (writer)
+                w.push_back(writer->push([] {}));
+        }
+        for (auto &f : w)
+            f.wait();
+        for (auto &f : w)
+            f.get();
+    }
+
+    void remove(const path &p)
+    {
+        // let queued files reach the disk first
+        wait_writes();
+
+        std::unique_lock<std::mutex> lk(m);
+        auto k = normalize_path(p);
+
+        auto erase_range = [&k](auto &c)
+        {
+            c.erase(k);
+            c.erase(c.lower_bound(k + "/"), c.lower_bound(k + "0"));
+        };
+        erase_range(stamps);
+        erase_range(dirty);
+
+        removed_dirs.insert(p);
+        loaded_dirs.insert(k);
     }
 };
 
@@ -67,13 +333,14 @@ AccessTable::~AccessTable()
 
 bool AccessTable::must_update_contents(const path &p) const
 {
+    counter_add(Counter::FilesStat);
     if (!fs::exists(p))
         return true;
     if (data.do_not_update)
         return false;
     if (!is_under_root(p, directories.storage_dir_etc))
         return true;
-    return fs::last_write_time(p) != data.stamps[p];
+    return data.is_outdated(p);
 }
 
 bool AccessTable::updates_disabled() const
@@ -83,15 +350,40 @@ bool AccessTable::updates_disabled() const
 
 void AccessTable::update_contents(const path &p, const String &s) const
 {
-    write_file_if_different(p, s);
-    data.stamps[p] = fs::last_write_time(p);
+    write_if_different(p, s);
+}
+
+void AccessTable::write_if_different(const path &p, const String &s) const
+{
+    // compare with stored hash, do not read the file back
+    auto h = sha256(s);
+    if (data.has_contents(p, h))
+        return;
+
+    // no stamp on the first run or after clear(),
+    // compare contents once, so unchanged files keep their time
+    if (!data.get(p))
+    {
+        counter_add(Counter::FilesStat);
+        error_code ec;
+        if (fs::file_size(p, ec) == s.size() && !ec)
+        {
+            counter_add(Counter::FilesRead);
+            if (read_file(p, true) == s)
+            {
+                data.set_contents(p, h);
+                return;
+            }
+        }
+    }
+    data.write(p, s, h);
 }
 
 void AccessTable::write_if_older(const path &p, const String &s) const
 {
     if (!is_under_root(p, directories.storage_dir_etc))
     {
-        write_file_if_different(p, s);
+        write_if_different(p, s);
         return;
     }
     if (must_update_contents(p))
@@ -103,16 +395,14 @@ void AccessTable::clear() const
     data.clear();
 }
 
+void AccessTable::flush() const
+{
+    data.flush();
+}
+
 void AccessTable::remove(const path &p) const
 {
-    std::set<path> rm;
-    for (auto &s : data.stamps)
-    {
-        if (is_under_root(s.first, p))
-            rm.insert(s.first);
-    }
-    for (auto &s : rm)
-        data.stamps.erase(s);
+    data.remove(p);
 }
 
 void AccessTable::do_not_update_files(bool v)
@@ -29,7 +29,9 @@ public:
     bool must_update_contents(const path &p) const;
     void update_contents(const path &p, const String &s) const;
     void write_if_older(const path &p, const String &s) const;
+    void write_if_different(const path &p, const String &s) const;
     void clear() const;
+    void flush() const;
     void remove(const path &p) const;
 
     static void do_not_update_files(bool v);
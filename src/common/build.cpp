@@ -25,6 +25,7 @@
 #include <program.h>
 #include <resolver.h>
 #include <settings.h>
+#include <trace.h>
 
 #include <primitives/templates.h>
 
@@ -39,6 +40,8 @@ int build_packages(const Config &c, const String &name);
 
 String test_run()
 {
+    TRACE_SCOPE("test_run");
+
     // do a test build to extract config string
     auto src_dir = temp_directory_path() / "temp" / unique_path();
     auto bin_dir = src_dir / "build";
@@ -16,12 +16,15 @@
 
 #include "checks.h"
 #include "checks_detail.h"
+#include "counters.h"
 
 #include "hash.h"
 #include "printers/printer.h"
 
 #include <boost/algorithm/string.hpp>
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <memory>
 
@@ -463,7 +466,24 @@ void Checks::load(const yaml &root)
 #include <float.h>
 int main() {return 0;}
 )")->default_ = true;
+
+        // headers of decls are their dependencies too
+        std::set<String> vars;
+        for (auto &c : checks)
+            vars.insert(c->getVariable());
+        for (auto &c : ChecksSet(checks))
+        {
+            if (c->getInformation().type != Check::Decl)
+                continue;
+            for (auto &h : c->parameters.headers)
+            {
+                if (vars.insert(Check::make_include_var(h)).second)
+                    addCheck<CheckInclude>(h)->default_ = true;
+            }
+        }
     }
+
+    normalize();
 }
 
 void Checks::save(yaml &root) const
@@ -507,10 +527,106 @@ bool Checks::empty() const
 
 Checks &Checks::operator+=(const Checks &rhs)
 {
-    checks.insert(rhs.checks.begin(), rhs.checks.end());
+    // cmake evaluates only the first check of a variable anyway
+    if (n_indexed != checks.size())
+    {
+        vars.clear();
+        for (auto &c : checks)
+            vars.emplace(c->getInformation().type, c->getVariable());
+    }
+    for (auto &c : rhs.checks)
+    {
+        if (vars.emplace(c->getInformation().type, c->getVariable()).second)
+            checks.insert(c);
+    }
+    n_indexed = checks.size();
     return *this;
 }
 
+void Checks::invalidate_index()
+{
+    vars.clear();
+    n_indexed = 0;
+}
+
+void Checks::normalize()
+{
+    ChecksSet checks_old;
+    checks_old.swap(checks);
+
+    // user checks go first, so they are not replaced by default ones
+    vars.clear();
+    for (auto d : { false, true })
+    {
+        for (auto &c : checks_old)
+        {
+            if (c->default_ != d)
+                continue;
+            c->parameters.normalize();
+            if (vars.emplace(c->getInformation().type, c->getVariable()).second)
+                checks.insert(c);
+        }
+    }
+    n_indexed = checks.size();
+}
+
+CheckAliases Checks::remove_aliases()
+{
+    invalidate_index();
+    CheckAliases aliases;
+    std::map<std::tuple<int, String, bool, bool, CheckParameters>, CheckPtr> canonical;
+    for (auto &c : ChecksSet(checks))
+    {
+        // only these checks have user defined variables,
+        // custom ones set their variables themselves
+        bool invert = false;
+        switch (c->getInformation().type)
+        {
+        case Check::Include:
+            break;
+        case Check::CSourceCompiles:
+        case Check::CSourceRuns:
+        case Check::CXXSourceCompiles:
+        case Check::CXXSourceRuns:
+            invert = ((CheckSource *)c.get())->invert;
+            break;
+        default:
+            continue;
+        }
+
+        auto k = std::make_tuple(c->getInformation().type, c->getData(), c->get_cpp(), invert, c->parameters);
+        auto i = canonical.emplace(k, c);
+        if (i.second)
+            continue;
+        aliases.emplace_back(c, i.first->second);
+        checks.erase(c);
+    }
+    return aliases;
+}
+
+void Checks::add_aliases(const CheckAliases &aliases)
+{
+    invalidate_index();
+    for (auto &[a, c] : aliases)
+    {
+        if (!c->isEvaluated())
+            continue;
+        a->setValue(c->getValue());
+        a->time = 0;
+        checks.insert(a);
+    }
+}
+
+void add_alias_values(const CheckAliases &aliases, CheckValues &values)
+{
+    for (auto &[a, c] : aliases)
+    {
+        auto i = values.find(c->getVariable());
+        if (i != values.end())
+            values[a->getVariable()] = i->second;
+    }
+}
+
 String Checks::save() const
 {
     yaml root;
@@ -518,6 +634,227 @@ String Checks::save() const
     return dump_yaml_config(root);
 }
 
+// binary checks file
+// all integers are in native byte order, the file is not meant to be moved
+#define CHECKS_BINARY_MAGIC "CPPANCHK"
+#define CHECKS_BINARY_VERSION 1
+
+enum CheckBinaryFlags
+{
+    cbfCpp          = (1 << 0),
+    cbfDefault      = (1 << 1),
+    cbfInvert       = (1 << 2),
+    cbfAllIncludes  = (1 << 3),
+};
+
+class ChecksWriter
+{
+public:
+    void write(uint32_t v)
+    {
+        buf.append((const char *)&v, sizeof(v));
+    }
+
+    void write(const String &s)
+    {
+        write((uint32_t)s.size());
+        buf += s;
+    }
+
+    template <class T>
+    void write_list(const T &v)
+    {
+        write((uint32_t)v.size());
+        for (auto &s : v)
+            write(s);
+    }
+
+    String buf;
+};
+
+class ChecksReader
+{
+public:
+    // buf must outlive the reader, reading starts at offset
+    ChecksReader(const String &buf, size_t offset, const path &fn)
+        : buf(buf), fn(fn), pos(offset)
+    {
+    }
+
+    uint32_t read_int()
+    {
+        uint32_t v;
+        check(sizeof(v));
+        memcpy(&v, buf.data() + pos, sizeof(v));
+        pos += sizeof(v);
+        return v;
+    }
+
+    String read_string()
+    {
+        auto n = read_int();
+        check(n);
+        auto p = pos;
+        pos += n;
+        return buf.substr(p, n);
+    }
+
+    template <class T>
+    T read_list()
+    {
+        T v;
+        auto n = read_int();
+        for (uint32_t i = 0; i < n; i++)
+            v.insert(v.end(), read_string());
+        return v;
+    }
+
+private:
+    const String &buf;
+    const path &fn;
+    size_t pos;
+
+    void check(size_t n) const
+    {
+        if (pos + n > buf.size())
+            throw std::runtime_error("Checks file is corrupted: " + fn.string());
+    }
+};
+
+String Checks::save_binary() const
+{
+    ChecksWriter w;
+    w.buf = CHECKS_BINARY_MAGIC;
+    w.write(CHECKS_BINARY_VERSION);
+    w.write((uint32_t)checks.size());
+    for (auto &c : checks)
+    {
+        auto t = c->getInformation().type;
+        String extra;
+        uint32_t flags = 0;
+        if (c->cpp)
+            flags |= cbfCpp;
+        if (c->default_)
+            flags |= cbfDefault;
+        if (c->parameters.all_includes)
+            flags |= cbfAllIncludes;
+        switch (t)
+        {
+        case Check::StructMember:
+            extra = ((CheckStructMember *)c.get())->struct_;
+            break;
+        case Check::LibraryFunction:
+            extra = ((CheckLibraryFunction *)c.get())->library;
+            break;
+        case Check::CSourceCompiles:
+        case Check::CSourceRuns:
+        case Check::CXXSourceCompiles:
+        case Check::CXXSourceRuns:
+        case Check::Custom:
+            if (((CheckSource *)c.get())->invert)
+                flags |= cbfInvert;
+            break;
+        }
+
+        w.write((uint32_t)t);
+        w.write(flags);
+        w.write(c->variable);
+        w.write(c->data);
+        w.write(extra);
+        w.write_list(c->parameters.headers);
+        w.write_list(c->parameters.definitions);
+        w.write_list(c->parameters.include_directories);
+        w.write_list(c->parameters.libraries);
+        w.write_list(c->parameters.flags);
+    }
+    return w.buf;
+}
+
+void Checks::load_binary(const path &fn)
+{
+    const auto buf = read_file(fn);
+    const String magic = CHECKS_BINARY_MAGIC;
+    if (buf.compare(0, magic.size(), magic) != 0)
+        throw std::runtime_error("Not a checks file: " + fn.string());
+
+    ChecksReader r(buf, magic.size(), fn);
+    if (r.read_int() != CHECKS_BINARY_VERSION)
+        throw std::runtime_error("Checks file has unknown version: " + fn.string());
+
+    auto n = r.read_int();
+    for (uint32_t i = 0; i < n; i++)
+    {
+        auto t = (int)r.read_int();
+        auto flags = r.read_int();
+        auto var = r.read_string();
+        auto data = r.read_string();
+        auto extra = r.read_string();
+
+        // variables are set below as they may be user-provided
+        CheckPtr c;
+        switch (t)
+        {
+        case Check::Function:
+            c = std::make_shared<CheckFunction>(data);
+            break;
+        case Check::Include:
+            c = std::make_shared<CheckInclude>(data, var);
+            break;
+        case Check::Type:
+            c = std::make_shared<CheckType>(data);
+            break;
+        case Check::Alignment:
+            c = std::make_shared<CheckAlignment>(data);
+            break;
+        case Check::Library:
+            c = std::make_shared<CheckLibrary>(data);
+            break;
+        case Check::LibraryFunction:
+            c = std::make_shared<CheckLibraryFunction>(data, extra);
+            break;
+        case Check::Symbol:
+            c = std::make_shared<CheckSymbol>(data);
+            break;
+        case Check::StructMember:
+            c = std::make_shared<CheckStructMember>(data, extra);
+            break;
+        case Check::Decl:
+            c = std::make_shared<CheckDecl>(data);
+            break;
+        case Check::CSourceCompiles:
+            c = std::make_shared<CheckCSourceCompiles>(var, data);
+            break;
+        case Check::CSourceRuns:
+            c = std::make_shared<CheckCSourceRuns>(var, data);
+            break;
+        case Check::CXXSourceCompiles:
+            c = std::make_shared<CheckCXXSourceCompiles>(var, data);
+            break;
+        case Check::CXXSourceRuns:
+            c = std::make_shared<CheckCXXSourceRuns>(var, data);
+            break;
+        case Check::Custom:
+            c = std::make_shared<CheckCustom>(var, data);
+            break;
+        default:
+            throw std::runtime_error("Checks file has unknown check type " + std::to_string(t) + ": " + fn.string());
+        }
+
+        c->variable = var;
+        c->cpp = !!(flags & cbfCpp);
+        c->default_ = !!(flags & cbfDefault);
+        if (flags & cbfInvert)
+            ((CheckSource *)c.get())->invert = true;
+        c->parameters.all_includes = !!(flags & cbfAllIncludes);
+        c->parameters.headers = r.read_list<Strings>();
+        c->parameters.definitions = r.read_list<StringSet>();
+        c->parameters.include_directories = r.read_list<StringSet>();
+        c->parameters.libraries = r.read_list<StringSet>();
+        c->parameters.flags = r.read_list<StringSet>();
+        checks.insert(c);
+    }
+}
+
 void invert(CMakeContext &ctx, const CheckPtr &c)
 {
     ctx.addLine();
@@ -652,8 +989,29 @@ void Checks::write_checks(CMakeContext &ctx, const StringSet &prefixes) const
     }
 }
 
-void Checks::write_parallel_checks_for_workers(CMakeContext &ctx) const
+void Checks::write_parallel_checks_for_workers(CMakeContext &ctx, const String &results_file, const CheckValues &values) const
 {
+    ctx.addLine("set(CPPAN_CHECK_RESULTS)");
+    ctx.addLine();
+
+    // values of dependencies checked earlier
+    std::set<String> deps;
+    for (auto &c : checks)
+    {
+        if (c->getInformation().type != Check::Decl)
+            continue;
+        for (auto &d : ((const CheckDecl *)c.get())->getDependencies())
+            deps.insert(d);
+    }
+    for (auto &d : deps)
+    {
+        auto i = values.find(d);
+        if (i != values.end())
+            ctx.addLine("set(" + d + " " + std::to_string(i->second) + ")");
+    }
+    if (!deps.empty())
+        ctx.addLine();
+
     for (auto &c : checks)
     {
         auto &i = c->getInformation();
@@ -681,8 +1039,7 @@ void Checks::write_parallel_checks_for_workers(CMakeContext &ctx) const
             ctx.addLine(i.function + "(" + p->library + " \"" + c->getData() + "\" \"\" " + c->getVariable() + ")");
         }
             break;
-        case Check::Decl:
-            continue; // do not participate in parallel
+        case Check::Decl: // dependencies are set above
         case Check::Function:
         case Check::Symbol:
         case Check::StructMember:
@@ -730,34 +1087,47 @@ void Checks::write_parallel_checks_for_workers(CMakeContext &ctx) const
                 for (auto &i : f->parameters.headers)
                 {
                     auto iv = Check::make_include_var(i);
-                    ctx.addLine("file(WRITE " + iv + " \"1\")");
+                    ctx.addLine("string(APPEND CPPAN_CHECK_RESULTS \"" + iv + " 1\\n\")");
                 }
             }
         }
 
         ctx.decreaseIndent();
         ctx.addLine("endif()");
-        ctx.addLine("file(WRITE " + c->getFileName() + " \"${" + c->getVariable() + "}\")");
+        ctx.addLine("string(APPEND CPPAN_CHECK_RESULTS \"" + c->getFileName() + " ${" + c->getVariable() + "}\\n\")");
         ctx.addLine();
     }
+
+    // one file for all checks
+    ctx.addLine("file(WRITE " + results_file + " \"${CPPAN_CHECK_RESULTS}\")");
 }
 
-void Checks::read_parallel_checks_for_workers(const path &dir)
+void Checks::read_parallel_checks_for_workers(const path &results_file)
 {
+    counter_add(Counter::FilesStat);
+    if (!fs::exists(results_file))
+        return;
+    counter_add(Counter::FilesRead);
+
+    // file name -> value, later lines win
+    std::map<String, String> results;
+    for (auto &l : read_lines(results_file))
+    {
+        auto p = l.find(' ');
+        if (p != l.npos)
+            results[l.substr(0, p)] = boost::trim_copy(l.substr(p + 1));
+    }
+
     for (auto &c : checks)
     {
-        auto fn = dir / c->getFileName();
-        if (!fs::exists(fn))
-            continue;
-        auto s = read_file(fn);
-        boost::trim(s);
-        if (s.empty())
+        auto i = results.find(c->getFileName());
+        if (i == results.end() || i->second.empty())
         {
             // if s empty, we do not read var
             // it will be checked in normal mode
             continue;
         }
-        c->setValue(std::stoi(s));
+        c->setValue(std::stoi(i->second));
     }
 }
 
@@ -843,6 +1213,7 @@ void Checks::write_definitions(CMakeContext &ctx, const Package &d, const String
 
 void Checks::remove_known_vars(const std::set<String> &known_vars)
 {
+    invalidate_index();
     auto checks_old = checks;
     for (auto &c : checks_old)
     {
@@ -851,25 +1222,73 @@ void Checks::remove_known_vars(const std::set<String> &known_vars)
     }
 }
 
-std::vector<Checks> Checks::scatter(int N) const
+Checks Checks::remove_known_results(const CheckResults &results)
 {
-    std::vector<Checks> workers(N);
-    int i = 0;
+    invalidate_index();
+    Checks known;
     for (auto &c : checks)
     {
-        auto &inf = c->getInformation();
-        auto t = inf.type;
+        auto i = results.find(c->getHash());
+        if (i == results.end())
+            continue;
+        c->setValue(i->second);
+        known.checks.insert(c);
+    }
+    for (auto &c : known.checks)
+        checks.erase(c);
+    return known;
+}
 
-        switch (t)
-        {
-        case Check::Decl: // do not participate in parallel
-            break;
-        default:
-            workers[i++ % N].checks.insert(c);
-            break;
-        }
+CheckResults Checks::get_results() const
+{
+    CheckResults results;
+    for (auto &c : checks)
+    {
+        // custom checks are arbitrary cmake code, do not share them
+        if (!c->isEvaluated() || c->getInformation().type == Check::Custom)
+            continue;
+        results[c->getHash()] = c->getValue();
     }
-    return workers;
+    return results;
+}
+
+std::vector<CheckPtr> Checks::order_by_time(const CheckTimes &times) const
+{
+    std::vector<std::pair<int, CheckPtr>> v;
+    for (auto &c : checks)
+    {
+        auto i = times.find(c->getHash());
+        v.emplace_back(i == times.end() ? c->getDefaultTime() : i->second, c);
+    }
+    std::stable_sort(v.begin(), v.end(), [](const auto &a, const auto &b)
+    {
+        return a.first > b.first;
+    });
+
+    std::vector<CheckPtr> r;
+    r.reserve(v.size());
+    for (auto &p : v)
+        r.push_back(p.second);
+    return r;
+}
+
+ChecksQueue::ChecksQueue(const Checks &checks, const CheckTimes &times, int n_workers)
+    : checks(checks.order_by_time(times)), n_workers(std::max(n_workers, 1))
+{
+}
+
+Checks ChecksQueue::pop()
+{
+    std::unique_lock<std::mutex> lk(m);
+    Checks w;
+    auto left = checks.size() - next;
+    if (left == 0)
+        return w;
+    // each cmake run has its startup cost, so batches are not too small
+    auto n = std::max<size_t>(left / (2 * n_workers), std::min<size_t>(left, 4));
+    for (auto e = next + n; next < e; next++)
+        w.checks.insert(checks[next]);
+    return w;
 }
 
 void Checks::print_values() const
@@ -880,8 +1299,8 @@ void Checks::print_values() const
         auto &i = c->getInformation();
         auto t = i.type;
 
-        // skip decls
-        if (t == Check::Decl)
+        // decls are printed only when they were evaluated in parallel
+        if (t == Check::Decl && !c->isEvaluated())
             continue;
 
         // if we have duplicate values, choose the ok one
@@ -910,7 +1329,11 @@ void Checks::print_values(CMakeContext &ctx) const
 
         switch (t)
         {
-        case Check::Decl: // do not participate in parallel
+        case Check::Decl:
+            // otherwise left for sequential mode
+            if (!c->isEvaluated())
+                break;
+            checks_to_print[c->getVariable()] = c;
             break;
         case Check::Type:
         {
@@ -984,6 +1407,30 @@ String Check::getFileName() const
     return getVariable() + "_" + parameters.getHash();
 }
 
+int Check::getDefaultTime() const
+{
+    switch (information.type)
+    {
+    case CSourceRuns:
+    case CXXSourceRuns:
+    case Custom:
+        return 1500;
+    case Library:
+    case LibraryFunction:
+    case Type:
+    case Alignment:
+        return 700;
+    default:
+        return 300;
+    }
+}
+
+String Check::getHash() const
+{
+    return sha256(std::to_string(information.type) + ";" + variable + ";" + data + ";" +
+        std::to_string(cpp) + ";" + parameters.getHash());
+}
+
 String CheckParameters::getHash() const
 {
     String h;
@@ -1083,6 +1530,29 @@ void CheckParameters::save(yaml &n) const
     ADD_SET(flags);
 }
 
+String ParallelCheckOptions::getFingerprint() const
+{
+    if (c_compiler.empty() && cxx_compiler.empty())
+        return String();
+
+    String h;
+    auto add_compiler = [&h](const path &p)
+    {
+        h += normalize_path(p) + ";";
+        // compiler upgrades go in place
+        error_code ec;
+        auto t = fs::last_write_time(p, ec);
+        if (!ec)
+            h += std::to_string(t.time_since_epoch().count());
+        h += ";";
+    };
+    add_compiler(c_compiler);
+    add_compiler(cxx_compiler);
+    h += c_flags + ";" + cxx_flags + ";";
+    h += generator + ";" + system_version + ";" + toolset + ";" + toolchain;
+    return sha256(h);
+}
+
 bool CheckParameters::empty() const
 {
     return
@@ -1095,6 +1565,37 @@ bool CheckParameters::empty() const
         ;
 }
 
+void CheckParameters::normalize()
+{
+    auto trim_set = [](StringSet &v)
+    {
+        StringSet r;
+        for (auto &s : v)
+        {
+            auto t = boost::trim_copy(s);
+            if (!t.empty())
+                r.insert(t);
+        }
+        v.swap(r);
+    };
+
+    // order of headers matters, so they are not sorted
+    Strings hs;
+    StringSet seen;
+    for (auto &h : headers)
+    {
+        auto t = boost::trim_copy(h);
+        if (!t.empty() && seen.insert(t).second)
+            hs.push_back(t);
+    }
+    headers.swap(hs);
+
+    trim_set(definitions);
+    trim_set(include_directories);
+    trim_set(libraries);
+    trim_set(flags);
+}
+
 bool CheckParameters::operator<(const CheckParameters &p) const
 {
     return
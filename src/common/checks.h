@@ -21,6 +21,8 @@
 #include "filesystem.h"
 #include "yaml.h"
 
+#include <mutex>
+
 class CMakeContext;
 struct Package;
 
@@ -45,6 +47,9 @@ struct CheckParameters
     bool empty() const;
     String getHash() const;
     bool operator<(const CheckParameters &p) const;
+
+    // trims values and removes duplicate headers
+    void normalize();
 };
 
 class Check
@@ -100,7 +105,14 @@ public:
     virtual void writeCheck(CMakeContext &/*ctx*/) const {}
     virtual void save(yaml &/*root*/) const {}
 
-    void setValue(const Value &v) { value = v; }
+    void setValue(const Value &v) { value = v; evaluated = true; }
+    bool isEvaluated() const { return evaluated; }
+
+    // identifies check in the check results store
+    virtual String getHash() const;
+
+    // expected time of cmake evaluation when there is no recorded one, ms
+    int getDefaultTime() const;
 
     bool get_cpp() const { return cpp; }
     virtual void set_cpp(bool) {}
@@ -140,6 +152,9 @@ protected:
 
     bool cpp = false;
 
+    // value is set by a worker, not default one
+    bool evaluated = false;
+
 public:
     // default check won't be printed
     bool default_ = false;
@@ -147,6 +162,9 @@ public:
     // parameters
     CheckParameters parameters;
 
+    // time spent on evaluation, ms
+    int time = 0;
+
 public:
     static String make_include_var(const String &i);
     static String make_type_var(const String &t, const String &prefix = "HAVE_");
@@ -155,6 +173,7 @@ public:
 private:
     template <class T>
     friend struct CheckPtrLess;
+    friend struct Checks;
 };
 
 using CheckPtr = std::shared_ptr<Check>;
@@ -174,6 +193,22 @@ struct CheckPtrLess
 
 using ChecksSet = std::set<CheckPtr, CheckPtrLess<CheckPtr>>;
 
+// Check::getHash() -> value
+using CheckResults = std::map<String, Check::Value>;
+
+// Check::getHash() -> time, ms
+using CheckTimes = std::map<String, int>;
+
+// Check::getVariable() -> value
+using CheckValues = std::map<String, Check::Value>;
+
+// alias -> check that is evaluated instead
+using CheckAliases = std::vector<std::pair<CheckPtr, CheckPtr>>;
+
+// copies known values of checks to their aliases,
+// decls may depend on alias variables
+void add_alias_values(const CheckAliases &aliases, CheckValues &values);
+
 struct Checks
 {
     ChecksSet checks;
@@ -186,21 +221,69 @@ struct Checks
     void save(yaml &root) const;
     String save() const;
 
+    // compact form for passing checks to the parallel checker
+    void load_binary(const path &fn);
+    String save_binary() const;
+
     void write_checks(CMakeContext &ctx, const StringSet &prefixes = StringSet()) const;
     void write_definitions(CMakeContext &ctx, const Package &d, const StringSet &prefixes = StringSet()) const;
 
-    void write_parallel_checks_for_workers(CMakeContext &ctx) const;
-    void read_parallel_checks_for_workers(const path &dir);
+    // workers write values of all checks to one results file
+    void write_parallel_checks_for_workers(CMakeContext &ctx, const String &results_file, const CheckValues &values = CheckValues()) const;
+    void read_parallel_checks_for_workers(const path &results_file);
+
+    // normalizes parameters and keeps one check per variable
+    // call before checks are shared with other sets
+    void normalize();
+
+    // checks that differ only in variable name are evaluated once
+    CheckAliases remove_aliases();
+    // sets values of evaluated checks to their aliases and adds them back
+    void add_aliases(const CheckAliases &aliases);
 
     void remove_known_vars(const std::set<String> &known_vars);
-    std::vector<Checks> scatter(int N) const;
+    // sets values of known checks and moves them to the result
+    Checks remove_known_results(const CheckResults &results);
+    CheckResults get_results() const;
+
+    // longest first
+    std::vector<CheckPtr> order_by_time(const CheckTimes &times) const;
     void print_values() const;
     void print_values(CMakeContext &ctx) const;
 
+    // checks of variables that are already present are skipped
     Checks &operator+=(const Checks &rhs);
 
     template <class T, class ... Args>
     T *addCheck(Args && ... args);
+
+private:
+    // (type, variable) of checks, so operator+= does not rescan the whole set;
+    // rebuilt when the number of checks differs from n_indexed
+    std::set<std::pair<int, String>> vars;
+    size_t n_indexed = 0;
+
+    void invalidate_index();
+};
+
+// Shared queue of parallel checks.
+// Checks go longest first, workers take them in decreasing batches
+// (guided scheduling), so long checks do not end up in the same worker
+// and there are no stragglers at the end.
+class ChecksQueue
+{
+public:
+    ChecksQueue(const Checks &checks, const CheckTimes &times, int n_workers);
+
+    // returns empty checks when the queue is drained
+    Checks pop();
+    size_t size() const { return checks.size(); }
+
+private:
+    std::mutex m;
+    std::vector<CheckPtr> checks;
+    size_t next = 0;
+    int n_workers;
 };
 
 Check::Information getCheckInformation(int type);
@@ -215,4 +298,12 @@ struct ParallelCheckOptions
     String system_version;
     String toolset;
     String toolchain;
+    path c_compiler;
+    path cxx_compiler;
+    String c_flags;
+    String cxx_flags;
+
+    // identity of the toolchain checks are evaluated with
+    // empty when compilers are unknown
+    String getFingerprint() const;
 };
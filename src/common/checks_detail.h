@@ -15,6 +15,7 @@
  */
 
 #include "checks.h"
+#include "hash.h"
 
 #include "printers/printer.h"
 
@@ -185,6 +186,11 @@ public:
         root[information.cppan_key].push_back(n);
     }
 
+    String getHash() const override
+    {
+        return sha256(Check::getHash() + struct_);
+    }
+
     String printStatus() const override
     {
         if (getValue())
@@ -259,6 +265,11 @@ public:
         root[information.cppan_key].push_back(v);
     }
 
+    String getHash() const override
+    {
+        return sha256(Check::getHash() + library);
+    }
+
     String library;
 };
 
@@ -323,9 +334,11 @@ public:
         root[information.cppan_key].push_back(n);
     }
 
-    void writeCheck(CMakeContext &ctx) const override
+    // variables of headers included by the probe,
+    // they must be checked before this check
+    Strings getDependencies() const
     {
-        static const Strings headers = {
+        Strings deps = {
             "HAVE_SYS_TYPES_H",
             "HAVE_SYS_STAT_H",
             "STDC_HEADERS",
@@ -337,29 +350,24 @@ public:
             "HAVE_STDINT_H",
             "HAVE_UNISTD_H",
         };
+        for (auto &h : parameters.headers)
+            deps.push_back(make_include_var(h));
+        return deps;
+    }
 
-        auto print_header_def = [&ctx](const auto &h)
-        {
-            ctx.addLine("if (" + h + ")");
-            ctx.addLine("set(CMAKE_REQUIRED_DEFINITIONS ${CMAKE_REQUIRED_DEFINITIONS} -D" + h + "=${" + h + "})");
-            ctx.addLine("endif()");
-        };
-
-        ctx.addLine("set(CMAKE_REQUIRED_DEFINITIONS)");
-        for (auto &h : headers)
-            print_header_def(h);
+    // probe prologue, dependencies are passed as definitions
+    String getIncludes() const
+    {
         String more_headers;
         for (auto &h : parameters.headers)
         {
             auto iv = make_include_var(h);
-            print_header_def(iv);
             more_headers += "#ifdef " + iv + "\n";
             more_headers += "# include <" + h + ">\n";
             more_headers += "#endif\n";
         }
 
-        ctx.addLine(information.function + "(\"" +
-            R"(
+        return R"(
 
 #include <stdio.h>
 #ifdef HAVE_SYS_TYPES_H
@@ -395,9 +403,25 @@ public:
 # include <unistd.h>
 #endif
 
-)" +
-more_headers +
-R"(
+)" + more_headers;
+    }
+
+    void writeCheck(CMakeContext &ctx) const override
+    {
+        auto print_header_def = [&ctx](const auto &h)
+        {
+            ctx.addLine("if (" + h + ")");
+            ctx.addLine("set(CMAKE_REQUIRED_DEFINITIONS ${CMAKE_REQUIRED_DEFINITIONS} -D" + h + "=${" + h + "})");
+            ctx.addLine("endif()");
+        };
+
+        ctx.addLine("set(CMAKE_REQUIRED_DEFINITIONS)");
+        for (auto &h : getDependencies())
+            print_header_def(h);
+
+        ctx.addLine(information.function + "(\"" +
+            getIncludes() +
+            R"(
 
 int main()
 {
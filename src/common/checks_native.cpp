@@ -0,0 +1,617 @@
+/*
+ * Copyright (C) 2016-2017, Egor Pugin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "checks_native.h"
+
+#include "checks_detail.h"
+#include "counters.h"
+#include "jobserver.h"
+#include "trace.h"
+
+#include <boost/algorithm/string.hpp>
+
+#include <primitives/command.h>
+#include <primitives/date_time.h>
+#include <primitives/executor.h>
+
+#include <algorithm>
+
+#include <primitives/log.h>
+//DECLARE_STATIC_LOGGER(logger, "checks.native");
+
+#ifdef _WIN32
+#define EXECUTABLE_EXTENSION ".exe"
+#else
+#define EXECUTABLE_EXTENSION ""
+#endif
+
+// same trick as in cmake's CheckTypeSize.c:
+// values are embedded into object file as strings, so nothing is run
+// and it works when crosscompiling
+static String make_info_value(const String &name, const String &value)
+{
+    const String prefix = "INFO:" + name + "[";
+    String s = "static char info_" + name + "[] = { ";
+    for (auto c : prefix)
+        s += "'" + String(1, c) + "', ";
+    for (auto d : { "10000", "1000", "100", "10" })
+        s += "(char)('0' + (((" + value + ") / " + d + ") % 10)), ";
+    s += "(char)('0' + ((" + value + ") % 10)), ']', '\\0' };\n";
+    return s;
+}
+
+static String make_info_main(size_t n)
+{
+    String s = "\nint main(int argc, char *argv[])\n{\n    int require = 0;\n";
+    for (size_t i = 0; i < n; i++)
+        s += "    require += info_v" + std::to_string(i) + "[argc];\n";
+    s += "    (void)argv;\n    return require;\n}\n";
+    return s;
+}
+
+static bool get_info_value(const String &object, size_t i, Check::Value &v)
+{
+    const String prefix = "INFO:v" + std::to_string(i) + "[";
+    auto p = object.find(prefix);
+    if (p == object.npos)
+        return false;
+    p += prefix.size();
+    auto e = object.find(']', p);
+    if (e == object.npos)
+        return false;
+    v = std::stoi(object.substr(p, e - p));
+    return true;
+}
+
+static const String type_headers = R"(
+#ifdef __has_include
+# if __has_include(<sys/types.h>)
+#  include <sys/types.h>
+# endif
+# if __has_include(<stdint.h>)
+#  include <stdint.h>
+# endif
+#endif
+#include <stddef.h>
+)";
+
+// includes more than this are bisected anyway
+static const size_t max_batch_size = 64;
+
+// compiler that cannot be started is not a failed check,
+// such results must not be stored, so it is an error
+static bool run_compiler(primitives::Command &cmd)
+{
+    std::error_code ec;
+    counter_add(Counter::ProcessesSpawned);
+    cmd.execute(ec);
+    if (ec && !cmd.exit_code)
+        throw std::runtime_error("Cannot run " + cmd.print() + ": " + ec.message());
+    return cmd.exit_code && cmd.exit_code.value() == 0;
+}
+
+static Strings split_flags(const String &s)
+{
+    Strings flags;
+    boost::split(flags, s, boost::is_any_of(" "));
+    flags.erase(std::remove(flags.begin(), flags.end(), ""), flags.end());
+    return flags;
+}
+
+static bool is_gcc_compatible(const path &p)
+{
+    if (p.empty())
+        return false;
+    // msvc and its clang frontend have other command line
+    auto s = boost::to_lower_copy(p.filename().stem().string());
+    return s != "cl" && s != "clang-cl";
+}
+
+static Strings get_headers(const Check &c)
+{
+    Strings headers;
+    boost::split(headers, c.getData(), boost::is_any_of(";"));
+    headers.erase(std::remove(headers.begin(), headers.end(), ""), headers.end());
+    return headers;
+}
+
+static String make_includes(const Strings &headers)
+{
+    String s;
+    for (auto &h : headers)
+        s += "#include <" + h + ">\n";
+    return s;
+}
+
+static bool is_source_check(const Check &c)
+{
+    switch (c.getInformation().type)
+    {
+    case Check::CSourceCompiles:
+    case Check::CSourceRuns:
+    case Check::CXXSourceCompiles:
+    case Check::CXXSourceRuns:
+        return true;
+    default:
+        return false;
+    }
+}
+
+NativeChecker::NativeChecker(const ParallelCheckOptions &o)
+    : dir(o.dir / "native"), crosscompilation(!o.toolchain.empty())
+{
+    if (is_gcc_compatible(o.c_compiler))
+    {
+        cc.program = o.c_compiler;
+        cc.flags = split_flags(o.c_flags);
+    }
+    if (is_gcc_compatible(o.cxx_compiler))
+    {
+        cxx.program = o.cxx_compiler;
+        cxx.flags = split_flags(o.cxx_flags);
+    }
+}
+
+bool NativeChecker::supported() const
+{
+    return !cc.empty() || !cxx.empty();
+}
+
+const NativeChecker::Compiler &NativeChecker::get_compiler(bool cpp) const
+{
+    return cpp ? cxx : cc;
+}
+
+bool NativeChecker::is_cpp(const Check &c) const
+{
+    switch (c.getInformation().type)
+    {
+    case Check::CXXSourceCompiles:
+    case Check::CXXSourceRuns:
+        return true;
+    default:
+        return c.get_cpp();
+    }
+}
+
+bool NativeChecker::can_check(const Check &c) const
+{
+    if (get_compiler(is_cpp(c)).empty())
+        return false;
+
+    switch (c.getInformation().type)
+    {
+    case Check::Function:
+    case Check::Include:
+    case Check::Type:
+    case Check::Alignment:
+    case Check::LibraryFunction:
+    case Check::Symbol:
+    case Check::StructMember:
+    case Check::CSourceCompiles:
+    case Check::CXXSourceCompiles:
+    case Check::Decl:
+        return true;
+    case Check::CSourceRuns:
+    case Check::CXXSourceRuns:
+        // leave try_run() emulation to cmake
+        return !crosscompilation;
+    default:
+        // Library: find_library() search paths are cmake's
+        // Custom: cmake code
+        return false;
+    }
+}
+
+NativeChecker::Mode NativeChecker::get_mode(const Check &c) const
+{
+    switch (c.getInformation().type)
+    {
+    case Check::Function:
+    case Check::LibraryFunction:
+    case Check::Symbol:
+    case Check::Decl:
+    case Check::CSourceCompiles:
+    case Check::CXXSourceCompiles:
+        return Mode::Link;
+    case Check::CSourceRuns:
+    case Check::CXXSourceRuns:
+        return Mode::Run;
+    default:
+        return Mode::Compile;
+    }
+}
+
+Checks NativeChecker::check(Checks &checks, int N, const CheckTimes &times, const CheckValues &values) const
+{
+    TRACE_SCOPE("native checks");
+
+    Checks native;
+    for (auto &c : checks.checks)
+    {
+        if (can_check(*c))
+            native.checks.insert(c);
+    }
+    if (native.checks.empty())
+        return native;
+    for (auto &c : native.checks)
+        checks.checks.erase(c);
+
+    // checks of the same type, language and parameters go into one probe
+    using Key = std::tuple<int, bool, CheckParameters, String>;
+    std::map<Key, Batch> groups;
+    std::vector<Batch> batches;
+    for (auto &c : native.order_by_time(times))
+    {
+        if (is_source_check(*c))
+        {
+            batches.push_back({ c.get() });
+            continue;
+        }
+        String library;
+        if (c->getInformation().type == Check::LibraryFunction)
+            library = ((const CheckLibraryFunction &)*c).library;
+        groups[Key{ c->getInformation().type, is_cpp(*c), c->parameters, library }].push_back(c.get());
+    }
+
+    // keep all processes busy: split groups by number of processes
+    const size_t n_procs = std::max(N, 1);
+    for (auto &g : groups)
+    {
+        auto &cs = g.second;
+        auto size = std::min(max_batch_size, (cs.size() + n_procs - 1) / n_procs);
+        for (size_t i = 0; i < cs.size(); i += size)
+            batches.emplace_back(cs.begin() + i, cs.begin() + std::min(cs.size(), i + size));
+    }
+
+    Executor e(n_procs);
+    std::vector<Future<void>> fs;
+    int i = 0;
+    for (auto &b : batches)
+    {
+        fs.push_back(e.push([this, &b, &values, d = dir / std::to_string(i++)]
+        {
+            fs::create_directories(d);
+            auto t = get_time<std::chrono::milliseconds>([this, &b, &values, &d]
+            {
+                try
+                {
+                    check(b, d, values);
+                }
+                catch (std::exception &e)
+                {
+                    // not evaluated checks are returned below
+                    LOG_WARN(logger, "-- Native check failed: " << e.what());
+                }
+            });
+            for (auto &c : b)
+                c->time = std::max<int>(int(t / b.size()), 1);
+        }));
+    }
+    for (auto &f : fs)
+        f.wait();
+    for (auto &f : fs)
+        f.get();
+
+    error_code ec;
+    fs::remove_all(dir, ec);
+
+    // checks of failed batches go back to cmake
+    for (auto &c : ChecksSet(native.checks))
+    {
+        if (c->isEvaluated())
+            continue;
+        native.checks.erase(c);
+        checks.checks.insert(c);
+    }
+
+    return native;
+}
+
+void NativeChecker::check(Batch b, const path &dir, const CheckValues &values) const
+{
+    if (b.empty())
+        return;
+
+    auto &c = *b[0];
+    const auto t = c.getInformation().type;
+
+    if (is_source_check(c))
+    {
+        auto ok = build(c, c.getData(), get_mode(c), dir);
+        // same as invert() for cmake
+        if (((const CheckSource &)c).invert)
+            ok = !ok;
+        c.setValue(ok ? 1 : 0);
+        return;
+    }
+
+    if (t == Check::Include)
+    {
+        // one preprocessor run drops missing headers
+        if (b.size() > 1)
+            filter_includes(b, dir);
+
+        check_includes(b, dir, values);
+        return;
+    }
+
+    String object;
+    if (build(c, make_source(b, values), get_mode(c), dir, &object))
+    {
+        for (size_t i = 0; i < b.size(); i++)
+        {
+            if (t == Check::Type || t == Check::Alignment)
+            {
+                Check::Value v = 0;
+                get_info_value(object, i, v);
+                b[i]->setValue(v);
+            }
+            else
+                b[i]->setValue(1);
+        }
+        return;
+    }
+
+    if (b.size() == 1)
+    {
+        c.setValue(0);
+        return;
+    }
+
+    // bisect failed batch
+    auto m = b.begin() + b.size() / 2;
+    check(Batch(b.begin(), m), dir, values);
+    check(Batch(m, b.end()), dir, values);
+}
+
+void NativeChecker::check_includes(Batch b, const path &dir, const CheckValues &values) const
+{
+    if (b.empty())
+        return;
+
+    // a header may compile only after another one from the batch,
+    // so each check gets its own TU like in check_include_files(),
+    // but all of them are compiled by one driver call
+    Strings srcs;
+    for (auto &c : b)
+        srcs.push_back(make_source({ c }, values));
+    if (syntax_check(*b[0], srcs, dir))
+    {
+        for (auto &c : b)
+            c->setValue(1);
+        return;
+    }
+
+    if (b.size() == 1)
+    {
+        b[0]->setValue(0);
+        return;
+    }
+
+    // bisect failed batch
+    auto m = b.begin() + b.size() / 2;
+    check_includes(Batch(b.begin(), m), dir, values);
+    check_includes(Batch(m, b.end()), dir, values);
+}
+
+void NativeChecker::filter_includes(Batch &b, const path &dir) const
+{
+    String src;
+    for (size_t i = 0; i < b.size(); i++)
+    {
+        String e;
+        for (auto &h : get_headers(*b[i]))
+            e += (e.empty() ? "" : " && ") + String("__has_include(<" + h + ">)");
+        if (e.empty())
+            e = "1";
+        auto v = "CPPAN_HAS_" + std::to_string(i);
+        src += "#if defined(__has_include)\n";
+        src += "# if " + e + "\n";
+        src += "#  define " + v + " 1\n";
+        src += "# else\n";
+        src += "#  define " + v + " 0\n";
+        src += "# endif\n";
+        src += "#else\n";
+        src += "# define " + v + " 1\n";
+        src += "#endif\n";
+        src += make_info_value("v" + std::to_string(i), v);
+    }
+    src += make_info_main(b.size());
+
+    String object;
+    if (!build(*b[0], src, Mode::Compile, dir, &object))
+        return;
+
+    Batch found;
+    for (size_t i = 0; i < b.size(); i++)
+    {
+        Check::Value v = 1;
+        get_info_value(object, i, v);
+        if (v)
+            found.push_back(b[i]);
+        else
+            b[i]->setValue(0);
+    }
+    b = found;
+}
+
+String NativeChecker::make_source(const Batch &b, const CheckValues &values) const
+{
+    const auto &first = *b[0];
+    const auto includes = make_includes(first.parameters.headers);
+
+    String s;
+    switch (first.getInformation().type)
+    {
+    case Check::Include:
+        for (auto &c : b)
+            s += make_includes(get_headers(*c));
+        s += "\nint main() { return 0; }\n";
+        break;
+    case Check::Function:
+    case Check::LibraryFunction:
+        s += "#ifdef __cplusplus\nextern \"C\" {\n#endif\n";
+        for (auto &c : b)
+            s += "char " + c->getData() + "(void);\n";
+        s += "#ifdef __cplusplus\n}\n#endif\n";
+        s += "\nint main()\n{\n";
+        for (auto &c : b)
+            s += "    " + c->getData() + "();\n";
+        s += "    return 0;\n}\n";
+        break;
+    case Check::Symbol:
+        s += includes;
+        s += "\nint main(int argc, char *argv[])\n{\n    int r = 0;\n    (void)argv;\n";
+        for (auto &c : b)
+        {
+            s += "#ifndef " + c->getData() + "\n";
+            s += "    r += ((int *)(&" + c->getData() + "))[argc];\n";
+            s += "#endif\n";
+        }
+        s += "    (void)argc;\n    return r;\n}\n";
+        break;
+    case Check::StructMember:
+        s += includes;
+        s += "\nint main()\n{\n";
+        for (auto &c : b)
+            s += "    (void)sizeof(((" + ((const CheckStructMember &)*c).struct_ + " *)0)->" + c->getData() + ");\n";
+        s += "    return 0;\n}\n";
+        break;
+    case Check::Type:
+        s += type_headers + includes;
+        for (size_t i = 0; i < b.size(); i++)
+            s += make_info_value("v" + std::to_string(i), "sizeof(" + b[i]->getData() + ")");
+        s += make_info_main(b.size());
+        break;
+    case Check::Alignment:
+        s += type_headers + includes;
+        for (size_t i = 0; i < b.size(); i++)
+        {
+            auto st = "cppan_alignment_probe" + std::to_string(i);
+            s += "struct " + st + " { char a; " + b[i]->getData() + " b; };\n";
+            s += make_info_value("v" + std::to_string(i), "offsetof(struct " + st + ", b)");
+        }
+        s += make_info_main(b.size());
+        break;
+    case Check::Decl:
+    {
+        auto &d = (const CheckDecl &)first;
+        for (auto &v : d.getDependencies())
+        {
+            auto i = values.find(v);
+            if (i != values.end() && i->second)
+                s += "#define " + v + " " + std::to_string(i->second) + "\n";
+        }
+        s += d.getIncludes();
+        s += "\nint main()\n{\n";
+        for (auto &c : b)
+            s += "    (void)" + c->getData() + ";\n";
+        s += "    return 0;\n}\n";
+        break;
+    }
+    }
+    return s;
+}
+
+primitives::Command NativeChecker::make_command(const Check &c, const path &dir) const
+{
+    const auto &compiler = get_compiler(is_cpp(c));
+    const auto &p = c.parameters;
+
+    primitives::Command cmd;
+    cmd.program = compiler.program;
+    cmd.working_directory = dir;
+    for (auto &f : compiler.flags)
+        cmd.args.push_back(f);
+    for (auto &f : p.flags)
+        cmd.args.push_back(f);
+    for (auto &d : p.definitions)
+        cmd.args.push_back(d);
+    for (auto &i : p.include_directories)
+        cmd.args.push_back("-I" + i);
+    return cmd;
+}
+
+bool NativeChecker::syntax_check(const Check &c, const Strings &srcs, const path &dir) const
+{
+    auto cmd = make_command(c, dir);
+    cmd.args.push_back("-fsyntax-only");
+    for (size_t i = 0; i < srcs.size(); i++)
+    {
+        auto fn = dir / ("probe" + std::to_string(i) + (is_cpp(c) ? ".cpp" : ".c"));
+        counter_add(Counter::FilesWritten);
+        write_file(fn, srcs[i]);
+        cmd.args.push_back(fn.string());
+    }
+
+    JobToken t;
+    return run_compiler(cmd);
+}
+
+bool NativeChecker::build(const Check &c, const String &src, Mode mode, const path &dir, String *object) const
+{
+    const auto cpp = is_cpp(c);
+    const auto &p = c.parameters;
+
+    auto fn = dir / (cpp ? "probe.cpp" : "probe.c");
+    counter_add(Counter::FilesWritten);
+    write_file(fn, src);
+
+    auto out = dir / (mode == Mode::Compile ? "probe.o" : "probe" EXECUTABLE_EXTENSION);
+
+    auto cmd = make_command(c, dir);
+    if (mode == Mode::Compile)
+        cmd.args.push_back("-c");
+    cmd.args.push_back(fn.string());
+    cmd.args.push_back("-o");
+    cmd.args.push_back(out.string());
+    if (mode != Mode::Compile)
+    {
+        for (auto &l : p.libraries)
+        {
+            // full paths and linker flags go as is
+            if (l.find_first_of("/\\") != l.npos || l[0] == '-')
+                cmd.args.push_back(l);
+            else
+                cmd.args.push_back("-l" + l);
+        }
+        if (c.getInformation().type == Check::LibraryFunction)
+            cmd.args.push_back("-l" + ((const CheckLibraryFunction &)c).library);
+    }
+
+    // compiler and probe run are one job
+    JobToken t;
+    if (!run_compiler(cmd))
+        return false;
+
+    if (object)
+    {
+        counter_add(Counter::FilesRead);
+        *object = read_file(out);
+    }
+
+    if (mode != Mode::Run)
+        return true;
+
+    primitives::Command run;
+    run.program = out;
+    run.working_directory = dir;
+    std::error_code ec;
+    counter_add(Counter::ProcessesSpawned);
+    run.execute(ec);
+    return !ec && run.exit_code && run.exit_code.value() == 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2016-2017, Egor Pugin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "checks.h"
+
+#include <primitives/command.h>
+
+// Evaluates checks by running the compiler on probe sources directly
+// instead of configuring a cmake project for them.
+// Similar checks are probed in one translation unit.
+// Only gcc compatible compiler drivers are supported.
+// Checks that cannot be done here (libraries, custom)
+// are left to cmake workers.
+class NativeChecker
+{
+public:
+    NativeChecker(const ParallelCheckOptions &options);
+
+    bool supported() const;
+    bool can_check(const Check &c) const;
+
+    // evaluates supported checks using N processes, longest first,
+    // and moves them from checks to the result
+    // values are results of dependencies (for decls)
+    Checks check(Checks &checks, int N, const CheckTimes &times = CheckTimes(), const CheckValues &values = CheckValues()) const;
+
+private:
+    struct Compiler
+    {
+        path program;
+        Strings flags;
+
+        bool empty() const { return program.empty(); }
+    };
+
+    enum class Mode
+    {
+        Compile,
+        Link,
+        Run,
+    };
+
+    // checks of the same type, language and parameters
+    using Batch = std::vector<Check *>;
+
+    Compiler cc;
+    Compiler cxx;
+    path dir;
+    bool crosscompilation;
+
+    const Compiler &get_compiler(bool cpp) const;
+    bool is_cpp(const Check &c) const;
+    Mode get_mode(const Check &c) const;
+
+    // whole batch is probed at once and bisected on failure
+    void check(Batch b, const path &dir, const CheckValues &values) const;
+    // every include is its own TU, all of them go to one compiler call
+    void check_includes(Batch b, const path &dir, const CheckValues &values) const;
+    void filter_includes(Batch &b, const path &dir) const;
+    String make_source(const Batch &b, const CheckValues &values) const;
+    primitives::Command make_command(const Check &c, const path &dir) const;
+    bool syntax_check(const Check &c, const Strings &srcs, const path &dir) const;
+    bool build(const Check &c, const String &src, Mode mode, const path &dir, String *object = nullptr) const;
+};
@@ -287,6 +287,7 @@ void Config::clear_vars_cache() const
             continue;
         remove_file(f);
     }
+    getServiceDatabase().clearCheckResults();
 }
 
 Project &Config::getProject1(const ProjectPath &ppath)
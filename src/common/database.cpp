@@ -25,6 +25,7 @@
 #include "settings.h"
 #include "sqlite_database.h"
 #include "stamp.h"
+#include "trace.h"
 #include "printers/cmake.h"
 
 #include <primitives/command.h>
@@ -72,6 +73,9 @@ std::vector<StartupAction> startup_actions{
     { 11, StartupAction::ServiceDbClearConfigHashes },
     { 12, StartupAction::ClearStorageDirExp | StartupAction::ClearStorageDirObj },
     { 13, StartupAction::ClearStorageDirExp },
+    { 14, StartupAction::CheckSchema },
+    { 15, StartupAction::CheckSchema | StartupAction::ClearSourceGroups },
+    { 16, StartupAction::CheckSchema }, // CheckTimes are keyed by toolchain, CheckPackages
 };
 
 const TableDescriptors &get_service_tables()
@@ -102,6 +106,7 @@ const TableDescriptors &get_service_tables()
             CREATE TABLE "FileStamps" (
                 "file" TEXT NOT NULL,
                 "stamp" INTEGER NOT NULL,
+                "hash" TEXT NOT NULL,
                 PRIMARY KEY ("file")
             );
         )" },
@@ -155,20 +160,9 @@ const TableDescriptors &get_service_tables()
         { "SourceGroups",
         R"(
             CREATE TABLE "SourceGroups" (
-                "id" INTEGER NOT NULL,
-                "package_id" INTEGER NOT NULL,
-                "path" TEXT NOT NULL,
-                PRIMARY KEY ("id"),
-                FOREIGN KEY ("package_id") REFERENCES "InstalledPackages" ("id") ON DELETE CASCADE
-            );
-        )" },
-
-        { "SourceGroupFiles",
-        R"(
-            CREATE TABLE "SourceGroupFiles" (
-                "source_group_id" INTEGER NOT NULL,
-                "path" TEXT NOT NULL,
-                FOREIGN KEY ("source_group_id") REFERENCES "SourceGroups" ("id") ON DELETE CASCADE
+                "package" TEXT NOT NULL,        -- package hash
+                "groups" BLOB NOT NULL,         -- directory tree of package files
+                PRIMARY KEY ("package")
             );
         )" },
 
@@ -189,6 +183,37 @@ const TableDescriptors &get_service_tables()
                 PRIMARY KEY ("tbl")
             );
         )"},
+
+        { "CheckResults",
+        R"(
+            CREATE TABLE "CheckResults" (
+                "toolchain" TEXT NOT NULL,      -- toolchain fingerprint
+                "check" TEXT NOT NULL,          -- check hash
+                "value" INTEGER NOT NULL,
+                PRIMARY KEY ("toolchain", "check")
+            );
+        )" },
+
+        { "CheckTimes",
+        R"(
+            CREATE TABLE "CheckTimes" (
+                "toolchain" TEXT NOT NULL,      -- toolchain fingerprint, empty when unknown
+                "check" TEXT NOT NULL,          -- check hash
+                "variable" TEXT NOT NULL,
+                "time" INTEGER NOT NULL,        -- ms
+                "value" INTEGER NOT NULL,
+                PRIMARY KEY ("toolchain", "check")
+            );
+        )" },
+
+        { "CheckPackages",
+        R"(
+            CREATE TABLE "CheckPackages" (
+                "check" TEXT NOT NULL,          -- check hash
+                "package" TEXT NOT NULL,        -- project path of the package declaring the check
+                PRIMARY KEY ("check", "package")
+            );
+        )" },
     };
     return service_tables;
 }
@@ -356,6 +381,8 @@ ServiceDatabase::ServiceDatabase()
 
 void ServiceDatabase::init()
 {
+    TRACE_SCOPE("ServiceDatabase::init");
+
     RUN_ONCE
     {
         createTables();
@@ -606,36 +633,174 @@ void ServiceDatabase::setTableHash(const String &table, const String &hash) cons
     db->execute("replace into TableHashes values ('" + table + "', '" + hash + "')");
 }
 
-Stamps ServiceDatabase::getFileStamps() const
+Stamps ServiceDatabase::getFileStamps(const path &dir) const
 {
+    // all files under dir form a contiguous range of keys ('0' follows '/')
+    auto d = normalize_path(dir);
     Stamps st;
-    db->execute("select * from FileStamps",
+    db->execute("select * from FileStamps where file >= '" + d + "/' and file < '" + d + "0'",
         [&st](SQLITE_CALLBACK_ARGS)
     {
-        st[cols[0]] = fs::file_time_type(fs::file_time_type::duration(std::stoll(cols[1])));
+        auto &s = st[cols[0]];
+        s.time = fs::file_time_type(fs::file_time_type::duration(std::stoll(cols[1])));
+        s.hash = cols[2];
         return 0;
     });
     return st;
 }
 
-void ServiceDatabase::setFileStamps(const Stamps &stamps) const
+void ServiceDatabase::updateFileStamps(const Stamps &stamps, const Files &removed_dirs) const
 {
-    if (stamps.empty())
-    {
-        clearFileStamps();
+    if (stamps.empty() && removed_dirs.empty())
         return;
+
+    db->execute("BEGIN;");
+
+    // removals go first, stamps written after them are newer
+    for (auto &r : removed_dirs)
+    {
+        auto d = normalize_path(r);
+        db->execute("delete from FileStamps where file = '" + d + "' or (file >= '" + d + "/' and file < '" + d + "0')");
     }
-    String q = "replace into FileStamps values ";
-    for (auto &s : stamps)
-        q += "('" + normalize_path(s.first) + "', '" + std::to_string(s.second.time_since_epoch().count()) + "'),";
+
+    if (!stamps.empty())
+    {
+        String q = "replace into FileStamps values ";
+        for (auto &s : stamps)
+            q += "('" + normalize_path(s.first) + "', '" + std::to_string(s.second.time.time_since_epoch().count()) + "', '" + s.second.hash + "'),";
+        q.resize(q.size() - 1);
+        q += ";";
+        db->execute(q);
+    }
+
+    db->execute("COMMIT;");
+}
+
+void ServiceDatabase::clearFileStamps() const
+{
+    db->execute("delete from FileStamps");
+}
+
+CheckResults ServiceDatabase::getCheckResults(const String &toolchain) const
+{
+    CheckResults results;
+    db->execute("select \"check\", value from CheckResults where toolchain = '" + toolchain + "'",
+        [&results](SQLITE_CALLBACK_ARGS)
+    {
+        results[cols[0]] = std::stoi(cols[1]);
+        return 0;
+    });
+    return results;
+}
+
+void ServiceDatabase::addCheckResults(const String &toolchain, const CheckResults &results) const
+{
+    if (results.empty())
+        return;
+
+    String q = "replace into CheckResults values ";
+    for (auto &r : results)
+        q += "('" + toolchain + "', '" + r.first + "', '" + std::to_string(r.second) + "'),";
     q.resize(q.size() - 1);
     q += ";";
     db->execute(q);
 }
 
-void ServiceDatabase::clearFileStamps() const
+void ServiceDatabase::clearCheckResults() const
 {
-    db->execute("delete from FileStamps");
+    db->execute("delete from CheckResults");
+}
+
+CheckTimes ServiceDatabase::getCheckTimes(const String &toolchain) const
+{
+    // times of other toolchains are better than nothing
+    CheckTimes times, other;
+    db->execute("select toolchain, \"check\", time from CheckTimes",
+        [&toolchain, &times, &other](SQLITE_CALLBACK_ARGS)
+    {
+        auto &t = cols[0] == toolchain ? times : other;
+        t[cols[1]] = std::max(t[cols[1]], std::stoi(cols[2]));
+        return 0;
+    });
+    times.insert(other.begin(), other.end());
+    return times;
+}
+
+void ServiceDatabase::addCheckTimes(const String &toolchain, const Checks &checks) const
+{
+    String q;
+    for (auto &c : checks.checks)
+    {
+        if (!c->isEvaluated() || c->time <= 0)
+            continue;
+        q += "('" + toolchain + "', '" + c->getHash() + "', '" + c->getVariable() + "', '" +
+            std::to_string(c->time) + "', '" + std::to_string(c->getValue()) + "'),";
+    }
+    if (q.empty())
+        return;
+    q.resize(q.size() - 1);
+    db->execute("replace into CheckTimes values " + q + ";");
+}
+
+void ServiceDatabase::addCheckPackages(const CheckPackages &packages) const
+{
+    if (packages.empty())
+        return;
+
+    // packages may drop their checks
+    String d = "delete from CheckPackages where package in (";
+    String q;
+    for (auto &p : packages)
+    {
+        d += "'" + p.first + "',";
+        for (auto &c : p.second)
+            q += "('" + c + "', '" + p.first + "'),";
+    }
+    d.resize(d.size() - 1);
+    d += ");";
+
+    db->execute("BEGIN;");
+    db->execute(d);
+    if (!q.empty())
+    {
+        q.resize(q.size() - 1);
+        db->execute("insert into CheckPackages values " + q + ";");
+    }
+    db->execute("COMMIT;");
+}
+
+ChecksReport ServiceDatabase::getChecksReport(int limit) const
+{
+    ChecksReport r;
+    auto add = [](auto &v)
+    {
+        return [&v](SQLITE_CALLBACK_ARGS)
+        {
+            ChecksReport::Item i;
+            i.name = cols[0];
+            i.n = std::stoi(cols[1]);
+            i.time = std::stoi(cols[2]);
+            if (ncols > 3)
+                i.value = std::stoi(cols[3]);
+            v.push_back(i);
+            return 0;
+        };
+    };
+
+    // average over toolchains
+    static const String check_times =
+        "select \"check\", variable, count(*) as n, cast(avg(time) as integer) as time "
+        "from CheckTimes group by \"check\"";
+
+    db->execute("select variable, n, time from (" + check_times + ") "
+        "order by time desc limit " + std::to_string(limit), add(r.slowest));
+    db->execute("select p.package, count(*), sum(t.time) from CheckPackages p "
+        "join (" + check_times + ") t on p.\"check\" = t.\"check\" "
+        "group by p.package order by 3 desc", add(r.packages));
+    db->execute("select variable, count(*), cast(avg(time) as integer), min(value) from CheckTimes "
+        "where toolchain <> '' group by \"check\" "
+        "having count(*) > 1 and min(value) = max(value) order by variable", add(r.constant));
+    return r;
 }
 
 bool ServiceDatabase::isActionPerformed(const StartupAction &action) const
@@ -750,71 +915,54 @@ bool ServiceDatabase::hasPackageDependenciesHash(const Package &p, const String
     return has;
 }
 
+// groups are stored in one row:
+// "dir/\n" line starts a group, next lines are its file names
 void ServiceDatabase::setSourceGroups(const Package &p, const SourceGroups &sgs) const
 {
-    auto id = getInstalledPackageId(p);
-    if (id == 0)
-        return;
-    removeSourceGroups(id);
+    String blob;
     for (auto &sg : sgs)
     {
-        db->execute("insert into SourceGroups (package_id, path) values ('" + std::to_string(id) + "', '" + sg.first + "');");
-        if (!sg.second.empty())
-        {
-            auto sg_id = db->getLastRowId();
-            String q = "insert into SourceGroupFiles values ";
-            for (auto &f : sg.second)
-                q += "('" + std::to_string(sg_id) + "', '" + f + "'),";
-            q.resize(q.size() - 1);
-            q += ";";
-            db->execute(q);
-        }
+        blob += sg.first + "/\n";
+        for (auto &f : sg.second)
+            blob += f + "\n";
     }
+    boost::replace_all(blob, "'", "''");
+    db->execute("replace into SourceGroups values ('" + p.getHash() + "', '" + blob + "')");
 }
 
-SourceGroups ServiceDatabase::getSourceGroups(const Package &p) const
+optional<SourceGroups> ServiceDatabase::getSourceGroups(const Package &p) const
 {
-    SourceGroups sgs;
-    auto id = getInstalledPackageId(p);
-    if (id == 0)
-        return sgs;
-    std::map<int, String> ids;
-    db->execute("select id, path from SourceGroups where package_id = '" + std::to_string(id) + "';",
-        [&ids](SQLITE_CALLBACK_ARGS)
+    optional<SourceGroups> sgs;
+    db->execute("select groups from SourceGroups where package = '" + p.getHash() + "'",
+        [&sgs](SQLITE_CALLBACK_ARGS)
     {
-        ids[std::stoi(cols[0])] = cols[1];
+        sgs = SourceGroups();
+        String v = cols[0];
+        std::set<String> *sg = nullptr;
+        size_t b = 0, e;
+        while ((e = v.find('\n', b)) != v.npos)
+        {
+            if (e != b && v[e - 1] == '/')
+                sg = &sgs.value()[v.substr(b, e - 1 - b)];
+            else if (sg && e != b)
+                sg->insert(v.substr(b, e - b));
+            b = e + 1;
+        }
         return 0;
     });
-    for (auto &i : ids)
-    {
-        auto &sg = sgs[i.second];
-        db->execute("select path from SourceGroupFiles where source_group_id = '" + std::to_string(i.first) + "';",
-            [&sg](SQLITE_CALLBACK_ARGS)
-        {
-            sg.insert(cols[0]);
-            return 0;
-        });
-    }
     return sgs;
 }
 
 void ServiceDatabase::removeSourceGroups(const Package &p) const
 {
-    auto id = getInstalledPackageId(p);
-    if (id == 0)
-        return;
-    removeSourceGroups(id);
-}
-
-void ServiceDatabase::removeSourceGroups(int id) const
-{
-    db->execute("delete from SourceGroups where package_id = '" + std::to_string(id) + "';");
+    db->execute("delete from SourceGroups where package = '" + p.getHash() + "'");
 }
 
 void ServiceDatabase::clearSourceGroups() const
 {
-    db->execute("delete from SourceGroupFiles;");
     db->execute("delete from SourceGroups;");
+    // per file rows of older versions
+    db->execute("drop table if exists SourceGroupFiles;");
 }
 
 void ServiceDatabase::addInstalledPackage(const Package &p) const
@@ -822,11 +970,13 @@ void ServiceDatabase::addInstalledPackage(const Package &p) const
     auto h = p.getFilesystemHash();
     if (getInstalledPackageHash(p) == h)
         return;
+    removeSourceGroups(p);
     db->execute("replace into InstalledPackages (package, version, hash) values ('" + p.ppath.toString() + "', '" + p.version.toString() + "', '" + p.getFilesystemHash() + "')");
 }
 
 void ServiceDatabase::removeInstalledPackage(const Package &p) const
 {
+    removeSourceGroups(p);
     db->execute("delete from InstalledPackages where package = '" + p.ppath.toString() + "' and version = '" + p.version.toString() + "'");
 }
 
@@ -892,6 +1042,8 @@ PackagesDatabase::PackagesDatabase()
 
 void PackagesDatabase::init()
 {
+    TRACE_SCOPE("packages db refresh");
+
     if (created)
     {
         LOG_INFO(logger, "Packages database was not found");
@@ -16,11 +16,13 @@
 
 #pragma once
 
+#include "checks.h"
 #include "cppan_string.h"
 #include "dependency.h"
 #include "filesystem.h"
 
 #include <primitives/date_time.h>
+#include <primitives/stdcompat/optional.h>
 
 #include <chrono>
 #include <memory>
@@ -59,6 +61,25 @@ struct StartupAction
     int action;
 };
 
+// package -> hashes of its checks
+using CheckPackages = std::map<String, StringSet>;
+
+struct ChecksReport
+{
+    struct Item
+    {
+        String name; // check variable or package
+        int n = 0; // configs or checks
+        int time = 0; // ms
+        Check::Value value = 0;
+    };
+
+    std::vector<Item> slowest;
+    std::vector<Item> packages;
+    // same value in all configs
+    std::vector<Item> constant;
+};
+
 class Database
 {
 public:
@@ -115,15 +136,24 @@ public:
     PackagesSet getInstalledPackages() const;
 
     void setSourceGroups(const Package &p, const SourceGroups &sg) const;
-    SourceGroups getSourceGroups(const Package &p) const;
+    // empty when package is not cached
+    optional<SourceGroups> getSourceGroups(const Package &p) const;
     void removeSourceGroups(const Package &p) const;
-    void removeSourceGroups(int id) const;
     void clearSourceGroups() const;
 
-    Stamps getFileStamps() const;
-    void setFileStamps(const Stamps &stamps) const;
+    Stamps getFileStamps(const path &dir) const;
+    void updateFileStamps(const Stamps &stamps, const Files &removed_dirs) const;
     void clearFileStamps() const;
 
+    CheckResults getCheckResults(const String &toolchain) const;
+    void addCheckResults(const String &toolchain, const CheckResults &results) const;
+    void clearCheckResults() const;
+
+    CheckTimes getCheckTimes(const String &toolchain) const;
+    void addCheckTimes(const String &toolchain, const Checks &checks) const;
+    void addCheckPackages(const CheckPackages &packages) const;
+    ChecksReport getChecksReport(int limit) const;
+
 private:
     void createTables() const;
     void checkStamp() const;
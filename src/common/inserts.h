@@ -23,6 +23,7 @@ DECLARE_TEXT_VAR(version_rc_in);
 DECLARE_TEXT_VAR(branch_rc_in);
 DECLARE_TEXT_VAR(cmake_functions);
 DECLARE_TEXT_VAR(cmake_build_file);
+DECLARE_TEXT_VAR(cmake_aggregate_file);
 DECLARE_TEXT_VAR(cmake_generate_file);
 DECLARE_TEXT_VAR(cmake_export_import_file);
 DECLARE_TEXT_VAR(cmake_header);
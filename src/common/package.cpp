@@ -19,6 +19,7 @@
 #include "config.h"
 #include "database.h"
 #include "directories.h"
+#include "counters.h"
 #include "hash.h"
 #include "lock.h"
 
@@ -63,11 +64,69 @@ String Package::getStampHash() const
     return hash;
 }
 
-String Package::getHash() const
+namespace
+{
+
+// names depend only on ppath and version, but packages are copied
+// and recreated many times, so compute them once per package
+struct PackageNames
+{
+    String target_name;
+    String target_name_hash;
+    String variable_name;
+    String variable_no_version_name;
+    String hash;
+};
+
+const PackageNames &get_names(const Package &p)
 {
+    static std::shared_mutex m;
+    static std::unordered_map<Package, PackageNames> names;
+
+    {
+        std::shared_lock<std::shared_mutex> lk(m);
+        auto i = names.find(p);
+        if (i != names.end())
+            return i->second;
+    }
+
     static const auto delim = "/";
+
+    PackageNames n;
+    auto v = p.version.toAnyVersion();
+
+    n.target_name = p.ppath.toString() + (v == "*" ? "" : ("-" + v));
+
+    // for local projects we use simplified variable name without
+    // the second dir hash argument
+    auto vname = p.ppath.toString();
+    if (p.ppath.is_loc())
+        vname = p.ppath[PathElementType::Namespace] / p.ppath[PathElementType::Tail];
+
+    n.variable_name = vname + (v == "*" ? "" : ("_" + v));
+    std::replace(n.variable_name.begin(), n.variable_name.end(), '.', '_');
+
+    n.variable_no_version_name = vname;
+    std::replace(n.variable_no_version_name.begin(), n.variable_no_version_name.end(), '.', '_');
+
+    n.hash = sha256(p.ppath.toString() + delim + p.version.toString());
+    n.target_name_hash = shorten_hash(n.hash);
+
+    // key holds only the fields used by hash and compare
+    Package k;
+    k.ppath = p.ppath;
+    k.version = p.version;
+
+    std::unique_lock<std::shared_mutex> lk(m);
+    return names.emplace(std::move(k), std::move(n)).first->second;
+}
+
+}
+
+String Package::getHash() const
+{
     if (hash.empty())
-        return sha256(ppath.toString() + delim + version.toString());
+        return get_names(*this).hash;
     return hash;
 }
 
@@ -93,33 +152,18 @@ path Package::getHashPath() const
 
 void Package::createNames()
 {
-    auto v = version.toAnyVersion();
-
-    target_name = ppath.toString() + (v == "*" ? "" : ("-" + v));
-
-    // for local projects we use simplified variable name without
-    // the second dir hash argument
-    auto vname = ppath.toString();
-    if (ppath.is_loc())
-        vname = ppath[PathElementType::Namespace] / ppath[PathElementType::Tail];
-
-    variable_name = vname + (v == "*" ? "" : ("_" + v));
-    std::replace(variable_name.begin(), variable_name.end(), '.', '_');
-
-    variable_no_version_name = vname;
-    std::replace(variable_no_version_name.begin(), variable_no_version_name.end(), '.', '_');
-
-    target_name_hash = getHashShort();
-    hash = getHash();
+    auto &n = get_names(*this);
+    target_name = n.target_name;
+    variable_name = n.variable_name;
+    variable_no_version_name = n.variable_no_version_name;
+    target_name_hash = n.target_name_hash;
+    hash = n.hash;
 }
 
 String Package::getTargetName() const
 {
     if (target_name.empty())
-    {
-        auto v = version.toAnyVersion();
-        return ppath.toString() + (v == "*" ? "" : ("-" + v));
-    }
+        return get_names(*this).target_name;
     return target_name;
 }
 
@@ -167,6 +211,7 @@ void cleanPackages(const String &s, int flags)
         flags = CleanTarget::All;
 
     std::regex r(s);
+    counter_add(Counter::RegexCompiled);
     PackagesSet pkgs;
 
     // find direct packages
@@ -18,6 +18,7 @@
 
 #include "access_table.h"
 #include "config.h"
+#include "counters.h"
 #include "database.h"
 #include "directories.h"
 #include "exceptions.h"
@@ -27,6 +28,7 @@
 #include "resolver.h"
 #include "settings.h"
 #include "sqlite_database.h"
+#include "trace.h"
 
 #include <boost/algorithm/string.hpp>
 
@@ -36,6 +38,8 @@
 #include <primitives/templates.h>
 #include <primitives/win32helpers.h>
 
+#include <functional>
+
 #include <primitives/log.h>
 //DECLARE_STATIC_LOGGER(logger, "package_store");
 
@@ -131,6 +135,9 @@ void PackageStore::process(const path &p, Config &root)
         }
     }
 
+    // dependencies are final now, graph is built on the first query
+    graph.reset();
+
     // TODO: if we got a download we might need to refresh configs
     // but we do not know what projects we should clear
     // so clear the whole AT
@@ -139,11 +146,26 @@ void PackageStore::process(const path &p, Config &root)
 
     // gather (merge) checks, options etc.
     // add more necessary actions here
+    CheckPackages check_packages;
     for (auto &cc : *this)
     {
         if (cc.first == Package())
             continue;
-        root.getDefaultProject().checks += cc.second.config->getDefaultProject().checks;
+        auto &checks = cc.second.config->getDefaultProject().checks;
+        root.getDefaultProject().checks += checks;
+
+        // for checks report
+        auto &hashes = check_packages[cc.first.ppath.toString()];
+        for (auto &c : checks.checks)
+            hashes.insert(c->getHash());
+    }
+    try
+    {
+        getServiceDatabase().addCheckPackages(check_packages);
+    }
+    catch (std::exception &e)
+    {
+        LOG_DEBUG(logger, "Cannot write check packages: " << e.what());
     }
 
     // make sure we have new printer every time
@@ -160,8 +182,14 @@ void PackageStore::process(const path &p, Config &root)
         printer->access_table = &access_table;
         printer->d = d;
         printer->cwd = d.getDirObj();
-        printer->print();
-        printer->print_meta();
+        {
+            TRACE_SCOPE("print " + d.target_name);
+            printer->print();
+        }
+        {
+            TRACE_SCOPE("print_meta " + d.target_name);
+            printer->print_meta();
+        }
     }
 
     // have some influence on printer->print_meta();
@@ -173,7 +201,14 @@ void PackageStore::process(const path &p, Config &root)
     printer->access_table = &access_table;
     printer->d = root.pkg;
     printer->cwd = cp.get_cwd();
-    printer->print_meta();
+    {
+        TRACE_SCOPE("print_meta root");
+        printer->print_meta();
+    }
+
+    // background write errors are reported here,
+    // the table destructor does not throw
+    access_table.flush();
 }
 
 void PackageStore::resolve_dependencies(const Config &c)
@@ -184,6 +219,8 @@ void PackageStore::resolve_dependencies(const Config &c)
     if (!packages[c.pkg].dependencies.empty())
         return;
 
+    graph.reset();
+
     Packages deps;
 
     // remove some packages
@@ -368,6 +405,7 @@ PackageStore::read_packages_from_file(path p, const String &config_name, bool di
 
     auto read_from_cpp = [&conf, &config_name](const path &fn)
     {
+        counter_add(Counter::FilesRead);
         auto s = read_file_without_bom(fn);
         auto comments = extract_comments(s);
 
@@ -661,3 +699,213 @@ path PackageStore::get_local_package_dir(const ProjectPath &ppath) const
         return i->second;
     return path();
 }
+
+Files PackageStore::get_local_package_dirs() const
+{
+    Files dirs;
+    for (auto &lp : local_packages)
+        dirs.insert(lp.second);
+    return dirs;
+}
+
+void PackageStore::clear_local_packages()
+{
+    auto is_local = [](const Package &p)
+    {
+        return p == Package() || p.ppath.is_loc() || p.flags[pfLocalProject];
+    };
+
+    for (auto i = packages.begin(); i != packages.end();)
+    {
+        if (is_local(i->first))
+            i = packages.erase(i);
+        else
+            ++i;
+    }
+    for (auto i = config_store.begin(); i != config_store.end();)
+    {
+        if (is_local((*i)->pkg))
+            i = config_store.erase(i);
+        else
+            ++i;
+    }
+
+    local_packages.clear();
+    known_local_packages.clear();
+    graph.reset();
+
+    // next run must not think it downloaded something
+    downloads = 0;
+    deps_changed = false;
+}
+
+void PackageStore::build_graph()
+{
+    graph.emplace();
+    auto &g = graph.value();
+
+    auto by_name = [](const Package &p1, const Package &p2) { return p1.target_name < p2.target_name; };
+
+    // deterministic post order, dependencies go first
+    std::unordered_set<Package> visiting;
+    std::function<void(const Package &)> visit = [&](const Package &p)
+    {
+        if (g.index.find(p) != g.index.end() || !visiting.insert(p).second)
+            return;
+        auto i = packages.find(p);
+        if (i != packages.end())
+        {
+            std::vector<Package> children;
+            for (auto &d : i->second.dependencies)
+            {
+                auto j = packages.find(d.second);
+                children.push_back(j != packages.end() ? j->first : d.second);
+            }
+            std::sort(children.begin(), children.end(), by_name);
+            for (auto &c : children)
+                visit(c);
+        }
+        g.index[p] = g.order.size();
+        g.order.push_back(i != packages.end() ? i->first : p);
+    };
+
+    std::vector<Package> roots;
+    for (auto &c : packages)
+        roots.push_back(c.first);
+    std::sort(roots.begin(), roots.end(), by_name);
+    for (auto &p : roots)
+        visit(p);
+
+    const auto n = g.order.size();
+    const auto copy_all_libraries = Settings::get_local_settings().copy_all_libraries_to_output;
+
+    auto copy_to_output_dir = [this](const Package &d)
+    {
+        auto i = packages.find(d);
+        return i != packages.end() && i->second.config && i->second.config->getDefaultProject().copy_to_output_dir;
+    };
+
+    auto is_copied = [&](const Package &d)
+    {
+        if (!d.flags[pfExecutable])
+            return true;
+        if (!copy_to_output_dir(d))
+            return false;
+        // copy only direct executables
+        if (!copy_all_libraries)
+            return d.flags[pfLocalProject] && d.flags[pfDirectDependency];
+        return (bool)d.flags[pfDirectDependency];
+    };
+
+    g.out.resize(n);
+    g.in.resize(n);
+    for (size_t from = 0; from < n; from++)
+    {
+        auto i = packages.find(g.order[from]);
+        if (i == packages.end())
+            continue;
+        for (auto &dp : i->second.dependencies)
+        {
+            auto &d = dp.second;
+            bool built = !d.flags[pfHeaderOnly] && !d.flags[pfIncludeDirectoriesOnly];
+            bool exe = d.flags[pfExecutable];
+
+            DependencyGraph::Edge e{ from, g.index[d], dp };
+            e.valid[(int)DependencyClosure::All] = true;
+            e.valid[(int)DependencyClosure::Build] = built && !exe;
+            e.valid[(int)DependencyClosure::Copy] = built && is_copied(d);
+            e.build_executable = built && exe;
+
+            g.out[from].push_back(g.edges.size());
+            g.in[e.to].push_back(g.edges.size());
+            g.edges.push_back(std::move(e));
+        }
+    }
+
+    // closures of dependencies are ready before their dependents,
+    // so one pass is enough unless there are cycles
+    for (auto &c : g.closures)
+        c.assign(n, boost::dynamic_bitset<>(n));
+    for (auto &c : g.cache)
+        c.assign(n, {});
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t from = 0; from < n; from++)
+        {
+            for (int t = 0; t < 3; t++)
+            {
+                auto &c = g.closures[t][from];
+                auto old = c;
+                for (auto e : g.out[from])
+                {
+                    auto &edge = g.edges[e];
+                    if (!edge.valid[t])
+                        continue;
+                    c.set(edge.to);
+                    c |= g.closures[t][edge.to];
+                }
+                changed |= c != old;
+            }
+        }
+    }
+}
+
+std::vector<Package> PackageStore::get_topological_order()
+{
+    if (!graph)
+        build_graph();
+    return graph->order;
+}
+
+Packages PackageStore::get_transitive_dependencies(const Package &p, DependencyClosure type)
+{
+    if (!graph)
+        build_graph();
+    auto i = graph->index.find(p);
+    if (i == graph->index.end())
+    {
+        // package was added after the graph was built
+        build_graph();
+        i = graph->index.find(p);
+        if (i == graph->index.end())
+            throw std::logic_error("Package is not in dependency graph: " + p.target_name);
+    }
+
+    auto &g = graph.value();
+    const auto n = i->second;
+    const auto t = (int)type;
+
+    auto &cached = g.cache[t][n];
+    if (cached)
+        return cached.value();
+    cached = Packages();
+    auto &out = cached.value();
+
+    // direct edges carry flags and conditions of this package
+    auto members = g.closures[t][n];
+    for (auto e : g.out[n])
+    {
+        auto &edge = g.edges[e];
+        if (edge.valid[t] || (type == DependencyClosure::Build && edge.build_executable))
+        {
+            out.insert(edge.dependency);
+            members.reset(edge.to);
+        }
+    }
+
+    // others take the first edge from a package inside the closure
+    for (auto m = members.find_first(); m != members.npos; m = members.find_next(m))
+    {
+        for (auto e : g.in[m])
+        {
+            auto &edge = g.edges[e];
+            if (!edge.valid[t] || (edge.from != n && !g.closures[t][n][edge.from]))
+                continue;
+            out.insert(edge.dependency);
+            break;
+        }
+    }
+    return out;
+}
@@ -19,11 +19,24 @@
 #include "cppan_string.h"
 #include "dependency.h"
 
+#include <boost/dynamic_bitset.hpp>
 #include <primitives/stdcompat/optional.h>
 
 struct Config;
 class ProjectPath;
 
+enum class DependencyClosure
+{
+    // all transitive dependencies
+    All,
+    // dependencies that are built before the package:
+    // no header only and include directories only deps,
+    // executables are taken only from direct dependencies
+    Build,
+    // dependencies that are copied to the output dir
+    Copy,
+};
+
 class PackageStore
 {
 public:
@@ -55,6 +68,19 @@ public:
     bool rebuild_configs() const { return has_downloads() || deps_changed; }
     bool has_downloads() const { return downloads > 0; }
 
+    // used by resident (watch) mode between runs,
+    // remote packages stay resolved and loaded
+    void clear_local_packages();
+    Files get_local_package_dirs() const;
+
+    // graph queries, computed once after dependencies are resolved,
+    // results are returned by value as a later query may rebuild the graph
+    // dependencies go before their dependents
+    std::vector<Package> get_topological_order();
+    // values have flags and conditions of the edge that brought the package,
+    // direct edges of p are preferred
+    Packages get_transitive_dependencies(const Package &p, DependencyClosure type);
+
 public:
     PackageConfig &operator[](const Package &p);
     const PackageConfig &operator[](const Package &p) const;
@@ -74,6 +100,29 @@ public:
 public:
     std::unordered_set<Package> known_local_packages;
 
+private:
+    struct DependencyGraph
+    {
+        struct Edge
+        {
+            size_t from;
+            size_t to;
+            Packages::value_type dependency;
+            // per DependencyClosure, for Build only libraries
+            bool valid[3];
+            bool build_executable;
+        };
+
+        std::vector<Package> order;
+        std::unordered_map<Package, size_t> index;
+        std::vector<Edge> edges;
+        std::vector<std::vector<size_t>> out;
+        std::vector<std::vector<size_t>> in;
+        // per DependencyClosure, indices are positions in order
+        std::vector<boost::dynamic_bitset<>> closures[3];
+        std::vector<optional<Packages>> cache[3];
+    };
+
 private:
     PackageConfigs packages;
     std::set<std::unique_ptr<Config>> config_store;
@@ -85,8 +134,11 @@ private:
     int downloads = 0;
     bool deps_changed = false;
 
+    optional<DependencyGraph> graph;
+
     void write_index() const;
     void check_deps_changed();
+    void build_graph();
 
     friend class Resolver;
 };
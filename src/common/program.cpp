@@ -16,6 +16,8 @@
 
 #include "program.h"
 
+#include "counters.h"
+#include "jobserver.h"
 #include "stamp.h"
 
 #include <primitives/command.h>
@@ -91,6 +93,8 @@ String get_cmake_version()
     c.program = "cmake";
     c.args = { "--version" };
     std::error_code ec;
+    JobToken t;
+    counter_add(Counter::ProcessesSpawned);
     c.execute(ec);
     if (ec)
         throw std::runtime_error(err);
@@ -19,8 +19,11 @@
 #include "bazel/bazel.h"
 #include "checks_detail.h"
 #include "config.h"
+#include "counters.h"
 #include "http.h"
+#include "jobserver.h"
 #include "resolver.h"
+#include "trace.h"
 
 #include "printers/printer.h"
 
@@ -31,7 +34,9 @@
 #include <primitives/command.h>
 #include <primitives/pack.h>
 
+#include <fstream>
 #include <regex>
+#include <unordered_set>
 
 #include <primitives/log.h>
 //DECLARE_STATIC_LOGGER(logger, "project");
@@ -138,6 +143,8 @@ bool is_valid_file_type(const MimeTypes &types, const path &p, String *error = n
     c.program = "file";
     c.args.push_back("-ib");
     c.args.push_back(p.string());
+    JobToken t;
+    counter_add(Counter::ProcessesSpawned);
     c.execute();
     return is_valid_file_type(types, p, c.out.text, error, check_ext);
 }
@@ -207,7 +214,11 @@ void check_file_types(const Files &files)
     c.program = "sh";
     c.args.push_back(fn.string());
     std::error_code ec;
-    c.execute(ec);
+    {
+        JobToken t;
+        counter_add(Counter::ProcessesSpawned);
+        c.execute(ec);
+    }
     fs::remove(fn);
 
     if (ec)
@@ -356,14 +367,16 @@ void Patch::patchSources(const Files &files) const
     std::vector<std::pair<std::regex, String>> regex_prepared;
     for (auto &p : regex_replace)
         regex_prepared.emplace_back(std::regex(p.first), p.second);
+    counter_add(Counter::RegexCompiled, regex_prepared.size());
     for (auto &f : files)
     {
+        counter_add(Counter::FilesRead);
         auto s = read_file(f);
         for (auto &p : replace)
             boost::algorithm::replace_all(s, p.first, p.second);
         for (auto &p : regex_prepared)
             s = std::regex_replace(s, p.first, p.second);
-        write_file_if_different(f, s);
+        write_file_if_changed(f, s);
     }
 }
 
@@ -379,6 +392,8 @@ Project::Project(const ProjectPath &root_project)
 
 void Project::findSources(path p)
 {
+    TRACE_SCOPE("findSources " + pkg.target_name);
+
     // output file list (files) must contain absolute paths
     //
 
@@ -448,6 +463,7 @@ void Project::findSources(path p)
         s = escape_regex_symbols(s);
         if (!s.empty() && s.back() != '/')
             s += "/";
+        counter_add(Counter::RegexCompiled);
         return std::regex(s + e);
     };
 
@@ -459,6 +475,7 @@ void Project::findSources(path p)
     {
         for (auto &f : fs::recursive_directory_iterator(p))
         {
+            counter_add(Counter::FilesStat);
             if (!fs::is_regular_file(f))
                 continue;
 
@@ -673,6 +690,8 @@ void Project::load(const yaml &root)
     YAML_EXTRACT_AUTO(default_api_start);
     YAML_EXTRACT_AUTO(build_dependencies_with_same_config);
     YAML_EXTRACT_AUTO(copy_to_output_dir);
+    YAML_EXTRACT_VAR(root, unity_build, "unity_build", bool);
+    pch = get_sequence<String>(root, "pch");
 
     api_name = get_sequence_set<String>(root, "api_name");
 
@@ -1038,6 +1057,7 @@ void Project::load(const yaml &root)
     read_sources(build_files, "build");
     read_sources(exclude_from_package, "exclude_from_package");
     read_sources(exclude_from_build, "exclude_from_build");
+    read_sources(unity_build_exclude, "unity_build_exclude");
     read_sources(public_headers, "public_headers");
     include_hints = get_sequence_set<String>(root, "include_hints");
 
@@ -1276,6 +1296,8 @@ yaml Project::save() const
     ADD_IF_NOT_EMPTY(default_api_start);
     ADD_IF_VAL_TRIPLE(build_dependencies_with_same_config);
     ADD_IF_NOT_VAL_TRIPLE(copy_to_output_dir);
+    if (unity_build)
+        root["unity_build"] = unity_build.value();
 
     ADD_SET(api_name, api_name);
 
@@ -1283,6 +1305,11 @@ yaml Project::save() const
     ADD_SET(build, build_files);
     ADD_SET(exclude_from_package, exclude_from_package);
     ADD_SET(exclude_from_build, exclude_from_build);
+    ADD_SET(unity_build_exclude, unity_build_exclude);
+    if (pch.size() == 1)
+        root["pch"] = pch[0];
+    else
+        ADD_SET(pch, pch);
     ADD_SET(public_headers, public_headers);
     ADD_SET(include_hints, include_hints);
 
@@ -1330,7 +1357,7 @@ void Project::prepareExports() const
         boost::algorithm::replace_all(s, CPPAN_PROLOG, p);
         boost::algorithm::replace_all(s, CPPAN_EPILOG, e);
 
-        write_file_if_different(f, s);
+        write_file_if_changed(f, s);
     }*/
 }
 
@@ -1339,6 +1366,119 @@ void Project::patchSources() const
     patch.patchSources(getSources());
 }
 
+// Returns the most frequently included external headers of c++ sources.
+// Own headers are not returned, they change too often.
+// Only includes outside of #if blocks are counted, so platform specific
+// headers do not get into precompiled header.
+// Sources that define macros before includes (e.g., _GNU_SOURCE)
+// cannot use precompiled header, they are returned in skip.
+Strings Project::findPrecompiledHeaders(size_t max_headers, Files &skip) const
+{
+    static const std::set<String> cpp_extensions{
+        ".cc",
+        ".cpp",
+        ".cxx",
+        ".c++",
+        ".C++",
+        ".CPP",
+        ".C",
+    };
+
+    auto &srcs = getSources();
+
+    // all path suffixes of own files, so "a/b.h" and "b.h" are found for "dir/a/b.h"
+    std::unordered_set<String> own;
+    for (auto &f : srcs)
+    {
+        auto s = normalize_path(f);
+        own.insert(s);
+        for (auto p = s.find('/'); p != s.npos; p = s.find('/', p + 1))
+            own.insert(s.substr(p + 1));
+    }
+
+    std::map<String, size_t> counts;
+    size_t n_sources = 0;
+    for (auto &f : srcs)
+    {
+        if (cpp_extensions.find(f.extension().string()) == cpp_extensions.end())
+            continue;
+        std::ifstream ifs(f);
+        if (!ifs)
+            continue;
+
+        std::set<String> includes;
+        int depth = 0;
+        bool defines = false;
+        bool skip_file = false;
+        String line;
+        while (std::getline(ifs, line))
+        {
+            auto b = line.find_first_not_of(" \t");
+            if (b == line.npos || line[b] != '#')
+                continue;
+            b = line.find_first_not_of(" \t", b + 1);
+            if (b == line.npos)
+                continue;
+            auto e = line.find_first_of(" \t<\"", b);
+            auto directive = line.substr(b, e == line.npos ? line.npos : e - b);
+
+            if (directive.compare(0, 2, "if") == 0)
+                depth++;
+            else if (directive == "endif")
+                depth--;
+            else if (directive == "define" || directive == "undef")
+                defines = true;
+            else if (directive == "include")
+            {
+                if (defines)
+                {
+                    skip_file = true;
+                    break;
+                }
+                if (depth > 0 || e == line.npos)
+                    continue;
+                b = line.find_first_of("<\"", e);
+                if (b == line.npos)
+                    continue;
+                e = line.find_first_of(">\"", b + 1);
+                if (e == line.npos)
+                    continue;
+                auto h = line.substr(b + 1, e - b - 1);
+                if (own.find(h) == own.end())
+                    includes.insert(h);
+            }
+        }
+
+        if (skip_file)
+        {
+            skip.insert(f);
+            continue;
+        }
+        n_sources++;
+        for (auto &h : includes)
+            counts[h]++;
+    }
+
+    // header must be used by at least a quarter of sources
+    std::vector<std::pair<String, size_t>> headers;
+    for (auto &c : counts)
+    {
+        if (c.second >= 2 && c.second * 4 >= n_sources)
+            headers.push_back(c);
+    }
+    std::stable_sort(headers.begin(), headers.end(), [](const auto &a, const auto &b)
+    {
+        return a.second > b.second;
+    });
+    if (headers.size() > max_headers)
+        headers.resize(max_headers);
+
+    Strings r;
+    for (auto &h : headers)
+        r.push_back("<" + h.first + ">");
+    return r;
+}
+
 const Files &Project::getSources() const
 {
     if (!files.empty())
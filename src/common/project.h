@@ -199,6 +199,8 @@ public:
     Sources build_files;
     Sources exclude_from_package;
     Sources exclude_from_build;
+    // regexes of files that are not compiled in unity files
+    Sources unity_build_exclude;
 
     Sources public_headers;
     Sources include_hints;
@@ -243,6 +245,10 @@ public:
     bool create_default_api = false;
     String default_api_start;
     bool copy_to_output_dir = true;
+    // overrides global unity_build setting
+    optional<bool> unity_build;
+    // precompiled header: "auto", "off" or list of headers
+    Strings pch;
 
     StringSet api_name;
     String output_name; // file name
@@ -298,6 +304,7 @@ public:
     bool writeArchive(const path &fn) const;
     void prepareExports() const;
     void patchSources() const;
+    Strings findPrecompiledHeaders(size_t max_headers, Files &skip) const;
 
     void setRelativePath(const String &name);
 
@@ -18,6 +18,12 @@
 
 #include "enums.h"
 
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+
 bool is_valid_project_path_symbol(int c)
 {
     return
@@ -38,11 +44,59 @@ void fix_root_project(yaml &root, const ProjectPath &ppath)
         rp = ppath.toString();
 }
 
+const ProjectPath::Data *ProjectPath::intern(PathElements &&pe)
+{
+    // '\0' cannot be in elements, so keys are unique
+    String key;
+    for (auto &e : pe)
+    {
+        key += e;
+        key += '\0';
+    }
+
+    // never destroyed, paths may be used during static destruction
+    static auto &m = *new std::shared_mutex;
+    static auto &table = *new std::unordered_map<std::string_view, std::unique_ptr<std::pair<String, Data>>>;
+
+    {
+        std::shared_lock<std::shared_mutex> lk(m);
+        auto i = table.find(key);
+        if (i != table.end())
+            return &i->second->second;
+    }
+
+    std::unique_lock<std::shared_mutex> lk(m);
+    auto i = table.find(key);
+    if (i != table.end())
+        return &i->second->second;
+
+    auto v = std::make_unique<std::pair<String, Data>>();
+    auto &d = v->second;
+    d.hash = std::hash<String>()(key);
+    for (auto &e : pe)
+        d.string += e + ".";
+    if (!d.string.empty())
+        d.string.resize(d.string.size() - 1);
+    d.elements = std::move(pe);
+    v->first = std::move(key);
+    auto r = &d;
+    std::string_view k = v->first;
+    table.emplace(k, std::move(v));
+    return r;
+}
+
+ProjectPath::ProjectPath()
+{
+    static const auto empty = intern({});
+    data = empty;
+}
+
 ProjectPath::ProjectPath(String s)
 {
     if (s.size() > 2048)
         throw std::runtime_error("Too long project path (must be <= 2048)");
 
+    PathElements path_elements;
     auto prev = s.begin();
     for (auto i = s.begin(); i != s.end(); ++i)
     {
@@ -59,19 +113,22 @@ ProjectPath::ProjectPath(String s)
     }
     if (!s.empty())
         path_elements.emplace_back(prev, s.end());
+    data = intern(std::move(path_elements));
 }
 
 ProjectPath::ProjectPath(const PathElements &pe)
-    : path_elements(pe)
+    : data(intern(PathElements(pe)))
 {
 }
 
 String ProjectPath::toString(const String &delim) const
 {
+    if (delim == ".")
+        return data->string;
     String p;
-    if (path_elements.empty())
+    if (empty())
         return p;
-    for (auto &e : path_elements)
+    for (auto &e : elements())
         p += e + delim;
     p.resize(p.size() - delim.size());
     return p;
@@ -88,10 +145,10 @@ path ProjectPath::toFileSystemPath() const
 {
     // TODO: replace with hash, affects both server and client
     path p;
-    if (path_elements.empty())
+    if (elements().empty())
         return p;
     int i = 0;
-    for (auto &e : path_elements)
+    for (auto &e : elements())
     {
         if (i++ == toIndex(PathElementType::Owner))
         {
@@ -105,16 +162,16 @@ path ProjectPath::toFileSystemPath() const
 
 bool ProjectPath::operator<(const ProjectPath &p) const
 {
-    if (path_elements.empty() && p.path_elements.empty())
+    if (elements().empty() && p.elements().empty())
         return false;
-    if (path_elements.empty())
+    if (elements().empty())
         return true;
-    if (p.path_elements.empty())
+    if (p.elements().empty())
         return false;
-    auto &p0 = path_elements[0];
-    auto &pp0 = p.path_elements[0];
+    auto &p0 = elements()[0];
+    auto &pp0 = p.elements()[0];
     if (p0 == pp0)
-        return path_elements < p.path_elements;
+        return elements() < p.elements();
     // ??
     if (p0 == "org")
         return true;
@@ -129,21 +186,16 @@ bool ProjectPath::operator<(const ProjectPath &p) const
 
 bool ProjectPath::has_namespace() const
 {
-    if (path_elements.empty())
+    if (elements().empty())
         return false;
-    if (path_elements[0] == pvt().path_elements[0] ||
-        path_elements[0] == org().path_elements[0] ||
-        path_elements[0] == com().path_elements[0] ||
-        path_elements[0] == loc().path_elements[0])
-        return true;
-    return false;
+    return is_pvt() || is_org() || is_com() || is_loc();
 }
 
 ProjectPath::PathElement ProjectPath::get_owner() const
 {
-    if (path_elements.size() < 2)
+    if (elements().size() < 2)
         return PathElement();
-    return path_elements[1];
+    return elements()[1];
 }
 
 bool ProjectPath::is_absolute(const String &username) const
@@ -152,11 +204,11 @@ bool ProjectPath::is_absolute(const String &username) const
         return false;
     if (username.empty())
     {
-        if (path_elements.size() > 1)
+        if (elements().size() > 1)
             return true;
         return false;
     }
-    if (path_elements.size() > 2 && path_elements[1] == username)
+    if (elements().size() > 2 && elements()[1] == username)
         return true;
     return false;
 }
@@ -168,29 +220,29 @@ bool ProjectPath::is_relative(const String &username) const
 
 ProjectPath ProjectPath::operator[](PathElementType e) const
 {
-    if (path_elements.empty())
+    if (elements().empty())
         return *this;
     switch (e)
     {
     case PathElementType::Namespace:
-        return path_elements[0];
+        return elements()[0];
     case PathElementType::Owner:
         return get_owner();
     case PathElementType::Tail:
-        if (path_elements.size() < 2)
+        if (elements().size() < 2)
             return ProjectPath();
-        return PathElements{ path_elements.begin() + 2, path_elements.end() };
+        return PathElements{ elements().begin() + 2, elements().end() };
     }
     return *this;
 }
 
 bool ProjectPath::is_root_of(const ProjectPath &rhs) const
 {
-    if (path_elements.size() >= rhs.path_elements.size())
+    if (elements().size() >= rhs.elements().size())
         return false;
-    for (size_t i = 0; i < path_elements.size(); i++)
+    for (size_t i = 0; i < elements().size(); i++)
     {
-        if (path_elements[i] != rhs.path_elements[i])
+        if (elements()[i] != rhs.elements()[i])
             return false;
     }
     return true;
@@ -201,22 +253,21 @@ ProjectPath ProjectPath::back(const ProjectPath &root) const
     ProjectPath p;
     if (!root.is_root_of(*this))
         return p;
-    for (size_t i = 0; i < root.path_elements.size(); i++)
+    auto &pe = elements();
+    auto &re = root.elements();
+    for (size_t i = 0; i < re.size(); i++)
     {
-        if (path_elements[i] != root.path_elements[i])
-        {
-            p.path_elements.assign(path_elements.begin() + i, path_elements.end());
-            break;
-        }
+        if (pe[i] != re[i])
+            return PathElements(pe.begin() + i, pe.end());
     }
-    if (p.path_elements.empty())
-        p.path_elements.assign(path_elements.end() - (path_elements.size() - root.path_elements.size()), path_elements.end());
-    return p;
+    return PathElements(pe.end() - (pe.size() - re.size()), pe.end());
 }
 
 void ProjectPath::push_back(const PathElement &pe)
 {
-    path_elements.push_back(pe);
+    auto e = elements();
+    e.push_back(pe);
+    data = intern(std::move(e));
 }
 
 ProjectPath ProjectPath::operator/(const String &e) const
@@ -230,9 +281,9 @@ ProjectPath ProjectPath::operator/(const String &e) const
 
 ProjectPath ProjectPath::operator/(const ProjectPath &e) const
 {
-    auto tmp = *this;
-    tmp.path_elements.insert(tmp.path_elements.end(), e.path_elements.begin(), e.path_elements.end());
-    return tmp;
+    auto pe = elements();
+    pe.insert(pe.end(), e.begin(), e.end());
+    return pe;
 }
 
 ProjectPath &ProjectPath::operator/=(const String &e)
@@ -247,10 +298,8 @@ ProjectPath &ProjectPath::operator/=(const ProjectPath &e)
 
 ProjectPath ProjectPath::slice(int start, int end) const
 {
-    auto p = *this;
+    auto &pe = elements();
     if (end == -1)
-        p.path_elements = decltype(path_elements)(path_elements.begin() + start, path_elements.end());
-    else
-        p.path_elements = decltype(path_elements)(path_elements.begin() + start, path_elements.begin() + end);
-    return p;
+        return PathElements(pe.begin() + start, pe.end());
+    return PathElements(pe.begin() + start, pe.begin() + end);
 }
@@ -29,9 +29,9 @@
     }                                     \
     bool is_##name() const                \
     {                                     \
-        if (path_elements.empty())        \
+        if (empty())                      \
             return false;                 \
-        return path_elements[0] == #name; \
+        return elements()[0] == #name;    \
     }
 
 bool is_valid_project_path_symbol(int c);
@@ -43,17 +43,21 @@ enum class PathElementType
     Tail,
 };
 
+// Paths are interned: equal paths share one immutable copy of their elements,
+// so a path is a pointer, and compare and hash do not touch strings.
+// Interned data lives until the end of the program.
 class ProjectPath
 {
 public:
     using PathElement = String;
     using PathElements = std::vector<PathElement>;
 
-    using iterator = PathElements::iterator;
+    // elements are shared, so they cannot be changed in place
+    using iterator = PathElements::const_iterator;
     using const_iterator = PathElements::const_iterator;
 
 public:
-    ProjectPath() {}
+    ProjectPath();
     ProjectPath(const PathElements &pe);
     ProjectPath(String s);
 
@@ -61,42 +65,33 @@ public:
     String toPath() const;
     path toFileSystemPath() const;
 
-    iterator begin()
-    {
-        return path_elements.begin();
-    }
-    iterator end()
-    {
-        return path_elements.end();
-    }
-
     const_iterator begin() const
     {
-        return path_elements.begin();
+        return elements().begin();
     }
     const_iterator end() const
     {
-        return path_elements.end();
+        return elements().end();
     }
 
     size_t size() const
     {
-        return path_elements.size();
+        return elements().size();
     }
 
     bool empty() const
     {
-        return path_elements.empty();
+        return elements().empty();
     }
 
     auto front() const
     {
-        return path_elements.front();
+        return elements().front();
     }
 
     auto back() const
     {
-        return path_elements.back();
+        return elements().back();
     }
     ProjectPath back(const ProjectPath &root) const;
 
@@ -104,7 +99,7 @@ public:
 
     bool operator==(const ProjectPath &rhs) const
     {
-        return path_elements == rhs.path_elements;
+        return data == rhs.data;
     }
     bool operator!=(const ProjectPath &rhs) const
     {
@@ -133,7 +128,7 @@ public:
 
     PathElement get_owner() const;
     auto get_name() const { return back(); }
-    ProjectPath parent() const { return PathElements(path_elements.begin(), path_elements.end() - 1); }
+    ProjectPath parent() const { return PathElements(elements().begin(), elements().end() - 1); }
 
     ProjectPath slice(int start, int end = -1) const;
 
@@ -150,7 +145,19 @@ public:
     ROOT_PROJECT_PATH(pvt);
 
 private:
-    PathElements path_elements;
+    struct Data
+    {
+        PathElements elements;
+        // elements joined with '.'
+        String string;
+        size_t hash;
+    };
+
+    const Data *data;
+
+    const PathElements &elements() const { return data->elements; }
+
+    static const Data *intern(PathElements &&pe);
 
     friend struct std::hash<ProjectPath>;
 };
@@ -164,10 +171,7 @@ template<> struct hash<ProjectPath>
 {
     size_t operator()(const ProjectPath& ppath) const
     {
-        size_t h = 0;
-        for (const auto &e : ppath.path_elements)
-            hash_combine(h, std::hash<String>()(e));
-        return h;
+        return ppath.data->hash;
     }
 };
 
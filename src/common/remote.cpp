@@ -16,6 +16,7 @@
 
 #include "remote.h"
 
+#include "counters.h"
 #include "hash.h"
 #include "package.h"
 
@@ -45,7 +46,9 @@ bool Remote::downloadPackage(const Package &d, const String &hash, const path &f
     {
         try
         {
+            counter_add("remote." + name + ".requests");
             download_file(s(*this, d), fn);
+            counter_add("remote." + name + ".bytes", fs::file_size(fn));
         }
         catch (const std::exception&)
         {
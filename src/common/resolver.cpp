@@ -18,6 +18,7 @@
 
 #include "access_table.h"
 #include "config.h"
+#include "counters.h"
 #include "database.h"
 #include "directories.h"
 #include "exceptions.h"
@@ -25,6 +26,7 @@
 #include "project.h"
 #include "settings.h"
 #include "sqlite_database.h"
+#include "trace.h"
 #include "verifier.h"
 
 #include <boost/algorithm/string.hpp>
@@ -127,6 +129,8 @@ void Resolver::resolve_and_download(const Package &p, const path &fn)
 
 void Resolver::resolve(const Packages &deps, std::function<void()> resolve_action)
 {
+    TRACE_SCOPE("Resolver::resolve");
+
     if (!resolve_action)
         throw std::logic_error("Empty resolve action!");
 
@@ -246,7 +250,10 @@ void Resolver::download_and_unpack()
 
         // maybe d.target_name instead of version_dir.string()?
         path fn = make_archive_name((temp_directory_path("dl") / d.target_name).string());
-        download(d, fn);
+        {
+            TRACE_SCOPE("download " + d.target_name);
+            download(d, fn);
+        }
 
         // verify before cleaning old pkg
         if (Settings::get_local_settings().verify_all)
@@ -262,6 +269,7 @@ void Resolver::download_and_unpack()
         Files files;
         try
         {
+            TRACE_SCOPE("unpack " + d.target_name);
             files = unpack_file(fn, version_dir);
         }
         catch (std::exception &e)
@@ -560,7 +568,9 @@ Resolver::Dependencies getDependenciesFromRemote(const Packages &deps, const Rem
                 req.type = HttpRequest::Post;
                 req.url = current_remote->url + "/api/find_dependencies";
                 req.data = ptree2string(request);
+                counter_add("remote." + current_remote->name + ".requests");
                 resp = url_request(req);
+                counter_add("remote." + current_remote->name + ".bytes", resp.response.size());
                 if (resp.http_code != 200)
                     throw std::runtime_error("Cannot get deps");
                 dependency_tree = string2ptree(resp.response);
@@ -137,6 +137,15 @@ void Settings::load_main(const yaml &root, const SettingsType type)
         throw std::runtime_error("Unknown '" + key + "'. Should be one of [local, user, system]");
     };
 
+    auto printer_type_from_string = [](const String &s)
+    {
+        if (s == "cmake")
+            return PrinterType::CMake;
+        if (s == "ninja")
+            return PrinterType::Ninja;
+        throw std::runtime_error("Unknown 'printer'. Should be one of [cmake, ninja]");
+    };
+
     get_map_and_iterate(root, "remotes", [this](auto &kv)
     {
         auto n = kv.first.template as<String>();
@@ -185,10 +194,13 @@ void Settings::load_main(const yaml &root, const SettingsType type)
     build_dir_type = packages_dir_type_from_string(get_scalar<String>(root, "build_dir_type", "system"), "build_dir_type");
     if (root["build_dir"].IsDefined())
         build_dir_type = SettingsType::None;
+    if (root["printer"].IsDefined())
+        printerType = printer_type_from_string(root["printer"].template as<String>());
 
     // read these first from local settings
     // and they'll be overriden in bs (if they exist there)
     YAML_EXTRACT_AUTO(use_cache);
+    YAML_EXTRACT_AUTO(aggregate_dependency_builds);
     YAML_EXTRACT_AUTO(show_ide_projects);
     YAML_EXTRACT_AUTO(add_run_cppan_target);
     YAML_EXTRACT_AUTO(cmake_verbose);
@@ -201,8 +213,15 @@ void Settings::load_main(const yaml &root, const SettingsType type)
     additional_build_args = get_sequence<String>(root["additional_build_args"]);
     YAML_EXTRACT_AUTO(full_path_executables);
     YAML_EXTRACT_AUTO(var_check_jobs);
+    YAML_EXTRACT_AUTO(native_checks);
     YAML_EXTRACT_AUTO(install_prefix);
     YAML_EXTRACT_AUTO(build_warning_level);
+    YAML_EXTRACT_AUTO(object_cache);
+    YAML_EXTRACT_AUTO(artifact_store);
+    YAML_EXTRACT_AUTO(unity_build);
+    YAML_EXTRACT_AUTO(unity_build_batch_size);
+    YAML_EXTRACT_AUTO(auto_pch);
+    YAML_EXTRACT_AUTO(auto_pch_max_headers);
     YAML_EXTRACT_AUTO(meta_target_suffix);
 
     // read build settings
@@ -283,6 +302,7 @@ void Settings::load_build(const yaml &root)
     YAML_EXTRACT_VAR(root, use_shared_libs, "build_shared_libs", bool);
     YAML_EXTRACT_AUTO(silent);
     YAML_EXTRACT_AUTO(use_cache);
+    YAML_EXTRACT_AUTO(aggregate_dependency_builds);
     YAML_EXTRACT_AUTO(show_ide_projects);
     YAML_EXTRACT_AUTO(add_run_cppan_target);
     YAML_EXTRACT_AUTO(cmake_verbose);
@@ -295,8 +315,15 @@ void Settings::load_build(const yaml &root)
     additional_build_args = get_sequence<String>(root["additional_build_args"]);
     YAML_EXTRACT_AUTO(full_path_executables);
     YAML_EXTRACT_AUTO(var_check_jobs);
+    YAML_EXTRACT_AUTO(native_checks);
     YAML_EXTRACT_AUTO(install_prefix);
     YAML_EXTRACT_AUTO(build_warning_level);
+    YAML_EXTRACT_AUTO(object_cache);
+    YAML_EXTRACT_AUTO(artifact_store);
+    YAML_EXTRACT_AUTO(unity_build);
+    YAML_EXTRACT_AUTO(unity_build_batch_size);
+    YAML_EXTRACT_AUTO(auto_pch);
+    YAML_EXTRACT_AUTO(auto_pch_max_headers);
     YAML_EXTRACT_AUTO(meta_target_suffix);
 
     YAML_EXTRACT_AUTO(crosscompilation);
@@ -117,12 +117,26 @@ struct Settings
 
     // number of parallel jobs for variable checks
     int var_check_jobs = 0;
+    // run compiler directly for simple checks instead of cmake workers
+    bool native_checks = true;
 
     // level of warnings on dependencies
     int build_warning_level = 0;
+    // reuse compiled objects of dependencies by hash of preprocessed sources
+    bool object_cache = false;
+    // directory or http(s) url with prebuilt dependencies
+    String artifact_store;
+    // compile sources of dependencies in groups of unity_build_batch_size
+    bool unity_build = false;
+    int unity_build_batch_size = 8;
+    // generate precompiled headers from the most frequently included headers
+    bool auto_pch = false;
+    int auto_pch_max_headers = 16;
 
     // following settings can be overriden in current build config
     bool use_cache = true;
+    // build all outdated dependencies in one build tree instead of one by one
+    bool aggregate_dependency_builds = false;
     bool show_ide_projects = false;
     // auto re-run cppan when spec file is changed
     bool add_run_cppan_target = false;
@@ -16,6 +16,7 @@
 
 #include "sqlite_database.h"
 
+#include "counters.h"
 #include "lock.h"
 
 #include <boost/algorithm/string.hpp>
@@ -243,7 +244,11 @@ bool SqliteDatabase::execute(String sql, void *object, Sqlite3Callback callback,
     LOG_TRACE(logger, "Executing sql statement: " << sql);
     char *errmsg;
     String error;
-    sqlite3_exec(db, sql.c_str(), callback, object, &errmsg);
+    {
+        counter_add(Counter::SqliteStatements);
+        ScopedCounterTime sct(Counter::SqliteTimeUs);
+        sqlite3_exec(db, sql.c_str(), callback, object, &errmsg);
+    }
     if (errmsg)
     {
         auto s = sql.substr(0, MAX_ERROR_SQL_LENGTH);
@@ -289,7 +294,12 @@ bool SqliteDatabase::execute(String sql, DatabaseCallback callback, bool nothrow
             return (*f)(ncols, cols, names);
         return 0;
     };
-    int rc = sqlite3_exec(db, sql.c_str(), cb, &callback, &errmsg);
+    int rc;
+    {
+        counter_add(Counter::SqliteStatements);
+        ScopedCounterTime sct(Counter::SqliteTimeUs);
+        rc = sqlite3_exec(db, sql.c_str(), cb, &callback, &errmsg);
+    }
     if (errmsg)
     {
         auto s = sql.substr(0, MAX_ERROR_SQL_LENGTH);
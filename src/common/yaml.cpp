@@ -17,6 +17,7 @@
 #include "yaml.h"
 
 #include "checks.h"
+#include "counters.h"
 #include "project.h"
 
 #include <boost/algorithm/string.hpp>
@@ -81,6 +82,7 @@ void prepare_config_for_reading(yaml &root)
 
 yaml load_yaml_config(const path &p)
 {
+    counter_add(Counter::FilesRead);
     auto s = read_file(p);
     return load_yaml_config(s);
 }
@@ -0,0 +1,231 @@
+########################################
+# builds all outdated dependencies of the root project
+# in one build tree with one build tool invocation
+#
+# input: packages (topologically sorted), ${p}_target, ${p}_obj, ${p}_stamp, ${p}_hash,
+#        STORAGE_DIR, CONFIG, CONFIG_DIR, BUILD_DIR, GENERATOR, TOOLSET, C_COMPILER, CXX_COMPILER,
+#        TOOLCHAIN, MAKE_PROGRAM, LINKER, SYSTEM_VERSION, CMAKE_FILES_DIR
+########################################
+
+set(rebuild)
+foreach(p ${packages})
+    set(bdir ${${p}_obj}/build/${CONFIG_DIR})
+    if (NOT EXISTS ${bdir})
+        message(STATUS "Build dir does not exists for package ${${p}_target} (${bdir})")
+        message(STATUS "Re-run cppan to fix this warning.")
+        continue()
+    endif()
+
+    set(REBUILD 1)
+    if (EXISTS ${${p}_stamp})
+        file(READ ${${p}_stamp} f1)
+        if (EXISTS ${bdir}/cppan_sources.stamp)
+            file(READ ${bdir}/cppan_sources.stamp f2)
+            if ("${f1}" STREQUAL "${f2}")
+                set(REBUILD 0)
+            endif()
+        endif()
+    endif()
+
+    set(TARGET_FILE)
+    if (EXISTS ${bdir}/cppan_target_info_${CONFIG}.cmake)
+        include(${bdir}/cppan_target_info_${CONFIG}.cmake)
+    endif()
+
+    if (REBUILD OR NOT EXISTS ${TARGET_FILE})
+        set(rebuild ${rebuild} ${p})
+    endif()
+endforeach()
+
+if (NOT rebuild)
+    return()
+endif()
+
+########################################
+# locks
+########################################
+
+file(MAKE_DIRECTORY ${BUILD_DIR})
+
+# aggregate tree is shared between configurations of multi-config generators
+set(lock ${BUILD_DIR}/cppan_aggregate.lock)
+file(LOCK ${lock} RESULT_VARIABLE lock_result)
+if (NOT ${lock_result} EQUAL 0)
+    message(FATAL_ERROR "Lock error: ${lock_result}")
+endif()
+
+# same locks as in build.cmake, so standalone builds of these packages wait for us
+# take them in the same order everywhere to avoid deadlocks
+set(locks)
+foreach(p ${rebuild})
+    set(locks ${locks} ${${p}_obj}/build/${CONFIG_DIR}/cppan_build.lock)
+endforeach()
+list(SORT locks)
+foreach(l ${locks})
+    file(LOCK ${l} RESULT_VARIABLE lock_result)
+    if (NOT ${lock_result} EQUAL 0)
+        message(FATAL_ERROR "Lock error: ${lock_result}")
+    endif()
+endforeach()
+
+# prebuilt packages are not built
+if (CPPAN_ARTIFACT_STORE)
+    set(build)
+    foreach(p ${rebuild})
+        set(bdir ${${p}_obj}/build/${CONFIG_DIR})
+        cppan_artifact_name(${p}_artifact ${${p}_hash} ${bdir} ${CONFIG} ${${p}_stamp})
+        cppan_artifact_fetch(fetched ${CPPAN_ARTIFACT_STORE} ${${p}_artifact} ${STORAGE_DIR} ${bdir} ${CONFIG})
+        if (fetched)
+            if (EXISTS ${${p}_stamp})
+                execute_process(COMMAND ${CMAKE_COMMAND} -E copy ${${p}_stamp} ${bdir}/cppan_sources.stamp)
+            endif()
+        else()
+            set(build ${build} ${p})
+        endif()
+    endforeach()
+    set(rebuild ${build})
+endif()
+
+if (NOT rebuild)
+    foreach(l ${locks})
+        file(LOCK ${l} RELEASE)
+    endforeach()
+    file(LOCK ${lock} RELEASE)
+    return()
+endif()
+
+########################################
+# aggregate tree
+########################################
+
+# obj configs set their output dirs and read their variables
+# exactly like in standalone build trees
+# CPPAN_AGGREGATE_BUILD disables nested builds of dependencies
+set(lists "cmake_minimum_required(VERSION 3.2.0)\n")
+set(lists "${lists}project(cppan_dependencies C CXX)\n")
+set(lists "${lists}set(CPPAN_AGGREGATE_BUILD 1)\n")
+foreach(p ${rebuild})
+    message(STATUS "Building ${${p}_target}")
+    set(lists "${lists}set(VARIABLES_FILE \"${${p}_obj}/build/${CONFIG_DIR}.gen.vars\")\n")
+    set(lists "${lists}add_subdirectory(\"${${p}_obj}\" ${p})\n")
+endforeach()
+
+set(src_dir ${BUILD_DIR}/src)
+set(bin_dir ${BUILD_DIR}/bin)
+
+# do not touch the file when it's the same, so the tree is not regenerated
+set(old)
+if (EXISTS ${src_dir}/CMakeLists.txt)
+    file(READ ${src_dir}/CMakeLists.txt old)
+endif()
+if (NOT "${old}" STREQUAL "${lists}")
+    file(WRITE ${src_dir}/CMakeLists.txt "${lists}")
+endif()
+
+# copy cmake cache for faster bootstrapping
+set(to ${bin_dir}/CMakeFiles/${CMAKE_VERSION})
+if (NOT EXISTS ${to} AND CMAKE_FILES_DIR AND EXISTS ${CMAKE_FILES_DIR})
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} -E copy_directory ${CMAKE_FILES_DIR} ${to}
+        RESULT_VARIABLE ret
+    )
+    check_result_variable(${ret})
+    file(WRITE ${bin_dir}/CMakeCache.txt "CMAKE_PLATFORM_INFO_INITIALIZED:INTERNAL=1\n")
+endif()
+
+set(args)
+if (TOOLCHAIN)
+    set(args ${args} -DCMAKE_TOOLCHAIN_FILE=${TOOLCHAIN})
+else()
+    set(args ${args} -DCMAKE_C_COMPILER=${C_COMPILER} -DCMAKE_CXX_COMPILER=${CXX_COMPILER})
+endif()
+if (TOOLSET)
+    set(args ${args} -T${TOOLSET})
+endif()
+if (MAKE_PROGRAM)
+    set(args ${args} -DCMAKE_MAKE_PROGRAM=${MAKE_PROGRAM})
+endif()
+if (LINKER)
+    set(args ${args} -DCMAKE_LINKER=${LINKER})
+endif()
+if (SYSTEM_VERSION)
+    set(args ${args} -DCMAKE_SYSTEM_VERSION=${SYSTEM_VERSION})
+endif()
+
+set(OUTPUT_QUIET)
+set(ERROR_QUIET)
+if (DEFINED CPPAN_BUILD_VERBOSE AND NOT CPPAN_BUILD_VERBOSE)
+    set(OUTPUT_QUIET OUTPUT_QUIET)
+    set(ERROR_QUIET ERROR_QUIET)
+endif()
+
+cppan_debug_message("COMMAND ${CMAKE_COMMAND} -H${src_dir} -B${bin_dir} -G \"${GENERATOR}\" ${args}")
+execute_process(
+    COMMAND ${CMAKE_COMMAND}
+        -H${src_dir} -B${bin_dir}
+        -G "${GENERATOR}"
+        -DCMAKE_BUILD_TYPE=${CMAKE_BUILD_TYPE}
+        ${args}
+    ${OUTPUT_QUIET}
+    ${ERROR_QUIET}
+    RESULT_VARIABLE ret
+)
+check_result_variable(${ret})
+
+########################################
+# build
+########################################
+
+set(config)
+if (CONFIG)
+    set(config --config ${CONFIG})
+endif()
+
+cppan_debug_message("COMMAND ${CMAKE_COMMAND} --build ${bin_dir} ${config}")
+execute_process(
+    COMMAND ${CMAKE_COMMAND} --build ${bin_dir} ${config}
+    ${OUTPUT_QUIET}
+    ${ERROR_QUIET}
+    RESULT_VARIABLE ret
+)
+
+# failed package is unknown here, so all unity builds are turned off
+if (NOT ret EQUAL 0)
+    set(unity_failed 0)
+    foreach(p ${rebuild})
+        set(bdir ${${p}_obj}/build/${CONFIG_DIR})
+        if (EXISTS ${bdir}/cppan_unity.used AND NOT EXISTS ${bdir}/cppan_unity.failed)
+            file(WRITE ${bdir}/cppan_unity.failed "")
+            set(unity_failed 1)
+        endif()
+    endforeach()
+    if (unity_failed)
+        message(STATUS "Unity build failed, building without it")
+        execute_process(COMMAND ${CMAKE_COMMAND} ${bin_dir} ${OUTPUT_QUIET} ${ERROR_QUIET} RESULT_VARIABLE ret)
+        check_result_variable(${ret})
+        execute_process(
+            COMMAND ${CMAKE_COMMAND} --build ${bin_dir} ${config}
+            ${OUTPUT_QUIET}
+            ${ERROR_QUIET}
+            RESULT_VARIABLE ret
+        )
+    endif()
+endif()
+check_result_variable(${ret})
+
+# save stamps only after successful build
+foreach(p ${rebuild})
+    if (EXISTS ${${p}_stamp})
+        execute_process(COMMAND ${CMAKE_COMMAND} -E copy ${${p}_stamp} ${${p}_obj}/build/${CONFIG_DIR}/cppan_sources.stamp)
+    endif()
+    if (CPPAN_ARTIFACT_STORE)
+        cppan_artifact_store(${CPPAN_ARTIFACT_STORE} ${${p}_artifact} ${STORAGE_DIR} ${${p}_obj}/build/${CONFIG_DIR} ${CONFIG})
+    endif()
+endforeach()
+
+foreach(l ${locks})
+    file(LOCK ${l} RELEASE)
+endforeach()
+file(LOCK ${lock} RELEASE)
+
+########################################
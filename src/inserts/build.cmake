@@ -51,6 +51,17 @@ if (NOT REBUILD AND EXISTS ${TARGET_FILE})
     return()
 endif()
 
+# prebuilt files of the same package, config and sources
+if (CPPAN_ARTIFACT_STORE)
+    cppan_artifact_name(artifact ${PACKAGE_HASH} ${BUILD_DIR} ${CONFIG} ${fn1})
+    cppan_artifact_fetch(fetched ${CPPAN_ARTIFACT_STORE} ${artifact} ${STORAGE_DIR} ${BUILD_DIR} ${CONFIG})
+    if (fetched)
+        execute_process(COMMAND ${CMAKE_COMMAND} -E copy ${fn1} ${fn2})
+        file(LOCK ${lock} RELEASE)
+        return()
+    endif()
+endif()
+
 # save file
 execute_process(COMMAND ${CMAKE_COMMAND} -E copy ${fn1} ${fn2})
 
@@ -200,8 +211,30 @@ else()
     endif()
 endif()
 
+# unity build failed, build sources separately
+if (NOT ret EQUAL 0 AND EXISTS ${BUILD_DIR}/cppan_unity.used AND NOT EXISTS ${BUILD_DIR}/cppan_unity.failed)
+    message(STATUS "Unity build of ${PACKAGE_STRING} failed, building without it")
+    file(WRITE ${BUILD_DIR}/cppan_unity.failed "")
+    execute_process(COMMAND ${CMAKE_COMMAND} ${BUILD_DIR} ${OUTPUT_QUIET} ${ERROR_QUIET} RESULT_VARIABLE ret)
+    check_result_variable(${ret})
+    set(config)
+    if (CONFIG)
+        set(config --config ${CONFIG})
+    endif()
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} --build ${BUILD_DIR} ${config}
+        ${OUTPUT_QUIET}
+        ${ERROR_QUIET}
+        RESULT_VARIABLE ret
+    )
+endif()
+
 check_result_variable(${ret})
 
+if (CPPAN_ARTIFACT_STORE)
+    cppan_artifact_store(${CPPAN_ARTIFACT_STORE} ${artifact} ${STORAGE_DIR} ${BUILD_DIR} ${CONFIG})
+endif()
+
 file(LOCK ${lock} RELEASE)
 
 ########################################
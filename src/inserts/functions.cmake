@@ -683,6 +683,584 @@ function(check_result_variable ret)
     message(FATAL_ERROR "Last execute_process() with message '${ARGN}' failed with error: ${ret}")
 endfunction(check_result_variable)
 
+########################################
+# FUNCTION cppan_set_dependency_dirs
+########################################
+
+# arguments are pairs of variable and directory
+function(cppan_set_dependency_dirs)
+    set(args ${ARGN})
+    list(LENGTH args n)
+    while (n GREATER 1)
+        list(GET args 0 var)
+        list(GET args 1 dir)
+        set_cache_var(${var} ${dir})
+        list(REMOVE_AT args 0 1)
+        list(LENGTH args n)
+    endwhile()
+endfunction(cppan_set_dependency_dirs)
+
+########################################
+# MACRO cppan_set_warning_level
+########################################
+
+macro(cppan_set_warning_level)
+    if (DEFINED CPPAN_BUILD_WARNING_LEVEL AND
+        CPPAN_BUILD_WARNING_LEVEL GREATER -1 AND CPPAN_BUILD_WARNING_LEVEL LESS 5)
+        if (MSVC)
+            # clear old flag (/W3) by default
+            #string(REPLACE "/W3" "" CMAKE_C_FLAGS "${CMAKE_C_FLAGS}")
+            #string(REPLACE "/W3" "" CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS}")
+
+            set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} /W${CPPAN_BUILD_WARNING_LEVEL}")
+            set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} /W${CPPAN_BUILD_WARNING_LEVEL}")
+        endif()
+        if (CLANG OR GCC)
+            set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -w")
+            set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -w")
+        endif()
+    endif()
+endmacro(cppan_set_warning_level)
+
+########################################
+# MACRO cppan_set_compiler_settings
+########################################
+
+macro(cppan_set_compiler_settings)
+    if (MSVC)
+        if (NOT CLANG)
+            set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} /MP")
+            set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} /MP")
+        endif()
+
+        # not working for some reason
+        #set(CMAKE_RC_FLAGS "${CMAKE_RC_FLAGS} /nologo")
+
+        if (CPPAN_MT_BUILD)
+            set(CMAKE_C_FLAGS_RELEASE "${CMAKE_C_FLAGS_RELEASE} /MT")
+            set(CMAKE_C_FLAGS_RELWITHDEBINFO "${CMAKE_C_FLAGS_RELWITHDEBINFO} /MT")
+            set(CMAKE_C_FLAGS_MINSIZEREL "${CMAKE_C_FLAGS_MINSIZEREL} /MT")
+            set(CMAKE_C_FLAGS_DEBUG "${CMAKE_C_FLAGS_DEBUG} /MTd")
+
+            set(CMAKE_CXX_FLAGS_RELEASE "${CMAKE_CXX_FLAGS_RELEASE} /MT")
+            set(CMAKE_CXX_FLAGS_RELWITHDEBINFO "${CMAKE_CXX_FLAGS_RELWITHDEBINFO} /MT")
+            set(CMAKE_CXX_FLAGS_MINSIZEREL "${CMAKE_CXX_FLAGS_MINSIZEREL} /MT")
+            set(CMAKE_CXX_FLAGS_DEBUG "${CMAKE_CXX_FLAGS_DEBUG} /MTd")
+        endif()
+    endif()
+
+    # objects are shared between configs and storage dirs
+    # launchers work with makefile and ninja generators only
+    if (CPPAN_OBJECT_CACHE AND NOT MSVC AND NOT CMAKE_CXX_COMPILER_LAUNCHER)
+        # paths under storage and source dirs do not go into cache keys
+        set(CMAKE_C_COMPILER_LAUNCHER ${CPPAN_COMMAND} internal-compile ${CPPAN_OBJECT_CACHE} ${STORAGE_DIR} ${CMAKE_SOURCE_DIR} --)
+        set(CMAKE_CXX_COMPILER_LAUNCHER ${CPPAN_COMMAND} internal-compile ${CPPAN_OBJECT_CACHE} ${STORAGE_DIR} ${CMAKE_SOURCE_DIR} --)
+    endif()
+endmacro(cppan_set_compiler_settings)
+
+########################################
+# FUNCTION cppan_add_private_definitions
+########################################
+
+function(cppan_add_private_definitions target)
+    if (MSVC)
+        target_compile_definitions(${target}
+            PRIVATE _CRT_SECURE_NO_WARNINGS # disable warning about non-standard functions
+        )
+        target_compile_options(${target}
+            PRIVATE /wd4005 # macro redefinition
+            PRIVATE /wd4996 # The POSIX name for this item is deprecated.
+        )
+    endif()
+
+    if (CLANG)
+        target_compile_options(${target}
+            PRIVATE -Wno-macro-redefined
+        )
+    endif()
+endfunction(cppan_add_private_definitions)
+
+########################################
+# FUNCTION cppan_link_system_libraries
+########################################
+
+function(cppan_link_system_libraries target)
+    if (WIN32)
+        target_link_libraries(${target}
+            PUBLIC Ws2_32
+        )
+    else()
+        foreach(l m pthread rt dl)
+            find_library(${l} ${l})
+            if (NOT ${${l}} STREQUAL "${l}-NOTFOUND")
+                target_link_libraries(${target}
+                    PUBLIC ${l}
+                )
+            endif()
+        endforeach()
+    endif()
+endfunction(cppan_link_system_libraries)
+
+########################################
+# MACRO cppan_build_dependencies_setup
+########################################
+
+# sets config, config_exe and rest (variables passed to children)
+macro(cppan_build_dependencies_setup)
+    set(CPPAN_GET_CHILDREN_VARIABLES 1)
+    get_configuration_with_generator(config) # children
+    if (CPPAN_BUILD_EXECUTABLES_WITH_SAME_CONFIG)
+        get_configuration_with_generator(config_exe)
+    else()
+        get_configuration_exe(config_exe)
+    endif()
+    set(CPPAN_GET_CHILDREN_VARIABLES 0)
+
+    # we do not pass CPPAN_BUILD_EXECUTABLES_WITH_SAME_CONFIG to children
+    set(rest)
+    foreach(_v
+        CPPAN_BUILD_EXECUTABLES_WITH_SAME_CONFIGURATION
+        CMAKE_BUILD_TYPE
+        CPPAN_BUILD_VERBOSE
+        CPPAN_BUILD_WARNING_LEVEL
+        CPPAN_ARTIFACT_STORE
+        CPPAN_RC_ENABLED
+        CPPAN_COPY_ALL_LIBRARIES_TO_OUTPUT
+        N_CORES
+        XCODE
+        NINJA
+        NINJA_FOUND
+        VISUAL_STUDIO
+        CLANG
+    )
+        set(rest "${rest}-D${_v}=${${_v}} ")
+    endforeach()
+endmacro(cppan_build_dependencies_setup)
+
+########################################
+# FUNCTION cppan_add_build_dependencies
+########################################
+
+# appends commands running build.cmake of dependencies
+# arguments are pairs of dependency object dir and executable flag
+function(cppan_add_build_dependencies commands multicore)
+    set(at)
+    if (WIN32)
+        set(at @)
+    endif()
+
+    set(c ${${commands}})
+    set(args ${ARGN})
+    list(LENGTH args n)
+    while (n GREATER 1)
+        list(GET args 0 dir)
+        list(GET args 1 executable)
+        list(REMOVE_AT args 0 1)
+        list(LENGTH args n)
+
+        # this also probably must consider CPPAN_BUILD_EXECUTABLES_WITH_SAME_CONFIG
+        if (executable)
+            set(cfg Release)
+            set(bdir ${dir}/build/${config_exe})
+        else()
+            # aggregate tree already builds all libraries,
+            # nested builds would wait for its locks forever
+            if (CPPAN_AGGREGATE_BUILD)
+                continue()
+            endif()
+            set(cfg $<CONFIG>)
+            set(bdir ${dir}/build/${config})
+        endif()
+
+        list(APPEND c "${at}\"${CMAKE_COMMAND}\" -DCONFIG=${cfg} \"-DBUILD_DIR=${bdir}\" -DEXECUTABLE=${executable} -DMULTICORE=${multicore} ${rest} -P \"${dir}/build.cmake\"")
+    endwhile()
+    set(${commands} ${c} PARENT_SCOPE)
+endfunction(cppan_add_build_dependencies)
+
+########################################
+# FUNCTION cppan_add_aggregate_build
+########################################
+
+# appends command running aggregate.cmake of the root project
+function(cppan_add_aggregate_build commands script)
+    set(generator ${CMAKE_GENERATOR})
+    set(toolset ${CMAKE_GENERATOR_TOOLSET})
+    if (VISUAL_STUDIO_ACCELERATE_CLANG)
+        set(generator Ninja)
+        set(toolset)
+    endif()
+    set(linker)
+    if (WIN32 AND (VISUAL_STUDIO_ACCELERATE_CLANG OR NINJA))
+        set(linker ${CMAKE_LINKER})
+    endif()
+    set(system_version)
+    if (WIN32 OR APPLE)
+        set(system_version ${CMAKE_SYSTEM_VERSION})
+    endif()
+
+    set(at)
+    if (WIN32)
+        set(at @)
+    endif()
+
+    set(${commands} ${${commands}}
+        "${at}\"${CMAKE_COMMAND}\" -DCONFIG=$<CONFIG> -DCONFIG_DIR=${config} \"-DBUILD_DIR=${CMAKE_BINARY_DIR}/cppan-deps/${config}\" \"-DGENERATOR=${generator}\" -DTOOLSET=${toolset} \"-DC_COMPILER=${CMAKE_C_COMPILER}\" \"-DCXX_COMPILER=${CMAKE_CXX_COMPILER}\" \"-DTOOLCHAIN=${CMAKE_TOOLCHAIN_FILE}\" \"-DMAKE_PROGRAM=${CMAKE_MAKE_PROGRAM}\" \"-DLINKER=${linker}\" -DSYSTEM_VERSION=${system_version} \"-DCMAKE_FILES_DIR=${CMAKE_BINARY_DIR}/CMakeFiles/${CMAKE_VERSION}\" ${rest} -P \"${script}\""
+        PARENT_SCOPE)
+endfunction(cppan_add_aggregate_build)
+
+########################################
+# FUNCTION cppan_add_copy_dependencies
+########################################
+
+# appends commands copying dependencies to the output dir of target
+# arguments are triples of dependency target, output dir and file name
+function(cppan_add_copy_dependencies commands target copy_import_lib)
+    set(at)
+    if (WIN32)
+        set(at @)
+    endif()
+
+    set(c ${${commands}})
+    set(args ${ARGN})
+    list(LENGTH args n)
+    while (n GREATER 2)
+        list(GET args 0 dep)
+        list(GET args 1 dir)
+        list(GET args 2 name)
+        list(REMOVE_AT args 0 1 2)
+        list(LENGTH args n)
+
+        get_target_property(type ${dep} TYPE)
+        if ("${type}" STREQUAL STATIC_LIBRARY AND NOT CPPAN_COPY_ALL_LIBRARIES_TO_OUTPUT)
+            continue()
+        endif()
+
+        list(APPEND c "${at}\"${CMAKE_COMMAND}\" -E copy_if_different $<TARGET_FILE:${dep}> \"${dir}${name}\"")
+        add_dependencies(${target} ${dep})
+
+        # import library for shared libs
+        if (copy_import_lib AND "${type}" STREQUAL SHARED_LIBRARY)
+            list(APPEND c "${at}\"${CMAKE_COMMAND}\" -E copy_if_different $<TARGET_LINKER_FILE:${dep}> \"${dir}$<TARGET_LINKER_FILE_NAME:${dep}>\"")
+        endif()
+    endwhile()
+    set(${commands} ${c} PARENT_SCOPE)
+endfunction(cppan_add_copy_dependencies)
+
+########################################
+# FUNCTION cppan_add_imported_byproducts
+########################################
+
+# appends imported files of targets for current configuration,
+# properties are given without config suffix (e.g., IMPORTED_LOCATION)
+function(cppan_add_imported_byproducts out)
+    cmake_parse_arguments(IB "" "" "PROPERTIES;TARGETS" ${ARGN})
+
+    string(TOUPPER "${CMAKE_BUILD_TYPE}" type)
+    set(files ${${out}})
+    foreach(t ${IB_TARGETS})
+        foreach(p ${IB_PROPERTIES})
+            get_target_property(f ${t} ${p}_${type})
+            if (f)
+                list(APPEND files ${f})
+            endif()
+        endforeach()
+    endforeach()
+    set(${out} ${files} PARENT_SCOPE)
+endfunction(cppan_add_imported_byproducts)
+
+########################################
+# FUNCTION cppan_generate_script
+########################################
+
+# writes shell (batch on windows) script running commands at generate time
+# file is given without extension,
+# out is set to the command line running the script
+function(cppan_generate_script out file commands)
+    if (WIN32)
+        set(file ${file}.bat)
+        set(content "@setlocal\n")
+        foreach(c IN LISTS ${commands})
+            set(content "${content}${c}\n@if %errorlevel% neq 0 goto :cmEnd\n")
+        endforeach()
+        set(content "${content}@exit /b 0\n:cmEnd\n@endlocal & @call :cmErrorLevel %errorlevel%\n:cmErrorLevel\n@exit /b %1\n")
+    else()
+        set(file ${file}.sh)
+        set(content "#!/bin/sh\n")
+        foreach(c IN LISTS ${commands})
+            set(content "${content}${c}\n")
+        endforeach()
+    endif()
+
+    file(GENERATE OUTPUT ${file} CONTENT "${content}")
+
+    if (ANDROID)
+        set(${out} ${file} PARENT_SCOPE)
+    elseif (UNIX)
+        set(${out} chmod u+x ${file} COMMAND ${file} PARENT_SCOPE)
+    else()
+        set(${out} ${file} PARENT_SCOPE)
+    endif()
+endfunction(cppan_generate_script)
+
+########################################
+# FUNCTION cppan_source_group
+########################################
+
+# files are names relative to dir
+function(cppan_source_group name dir)
+    set(files)
+    foreach(f ${ARGN})
+        set(files ${files} "${dir}/${f}")
+    endforeach()
+    source_group("${name}" FILES ${files})
+endfunction(cppan_source_group)
+
+########################################
+# FUNCTION cppan_unity_build
+########################################
+
+# groups c and c++ sources into unity files of batch_size sources each
+# EXCLUDE sources (paths relative to BASE), header only sources
+# and sources in other languages are built as usual
+# when build.cmake finds that unity build failed, it creates
+# cppan_unity.failed file in state_dir and sources are built as usual
+function(cppan_unity_build src_var batch_size state_dir)
+    cmake_parse_arguments(UB "" "BASE" "EXCLUDE" ${ARGN})
+
+    if (EXISTS ${state_dir}/cppan_unity.failed)
+        return()
+    endif()
+    if (NOT batch_size OR batch_size LESS 2)
+        return()
+    endif()
+
+    set(c)
+    set(cpp)
+    foreach(f ${${src_var}})
+        get_source_file_property(header_only ${f} HEADER_FILE_ONLY)
+        get_source_file_property(skip_pch ${f} SKIP_PRECOMPILE_HEADERS)
+        if (header_only OR skip_pch)
+            continue()
+        endif()
+
+        set(excluded 0)
+        if (UB_BASE)
+            file(RELATIVE_PATH rel ${UB_BASE} ${f})
+            list(FIND UB_EXCLUDE "${rel}" i)
+            if (NOT i EQUAL -1)
+                set(excluded 1)
+            endif()
+        endif()
+        if (excluded)
+            continue()
+        endif()
+
+        string(REGEX MATCH "\\.[^./]*$" ext "${f}")
+        if ("${ext}" STREQUAL ".c")
+            list(APPEND c ${f})
+        elseif ("${ext}" MATCHES "^\\.(cpp|cxx|cc|c\\+\\+|C)$")
+            list(APPEND cpp ${f})
+        endif()
+    endforeach()
+
+    set(unity_dir ${CMAKE_CURRENT_BINARY_DIR}/cppan_unity)
+    set(unity)
+    foreach(lang c cpp)
+        list(LENGTH ${lang} total)
+        if (total LESS 2)
+            continue()
+        endif()
+
+        set(i 0)
+        set(n 0)
+        set(k 0)
+        set(text)
+        set(files)
+        foreach(f ${${lang}})
+            set(text "${text}#include \"${f}\"\n")
+            list(APPEND files ${f})
+            math(EXPR n "${n} + 1")
+            math(EXPR k "${k} + 1")
+            if (n EQUAL batch_size OR k EQUAL total)
+                # do not touch the same file, so it is not rebuilt
+                set(u ${unity_dir}/unity_${i}.${lang})
+                set(old)
+                if (EXISTS ${u})
+                    file(READ ${u} old)
+                endif()
+                if (NOT "${old}" STREQUAL "${text}")
+                    file(WRITE ${u} "${text}")
+                endif()
+                set_source_files_properties(${files} PROPERTIES HEADER_FILE_ONLY ON)
+                list(APPEND unity ${u})
+
+                math(EXPR i "${i} + 1")
+                set(n 0)
+                set(text)
+                set(files)
+            endif()
+        endforeach()
+    endforeach()
+
+    if (unity)
+        file(WRITE ${state_dir}/cppan_unity.used "")
+        set(${src_var} ${${src_var}} ${unity} PARENT_SCOPE)
+    endif()
+endfunction(cppan_unity_build)
+
+########################################
+# FUNCTION cppan_artifact_name
+########################################
+
+# package hash / config dir / build type - sources hash
+function(cppan_artifact_name out hash bdir config stamp)
+    get_filename_component(config_dir ${bdir} NAME)
+    set(sources_hash none)
+    if (EXISTS ${stamp})
+        file(SHA256 ${stamp} sources_hash)
+    endif()
+    set(${out} ${hash}/${config_dir}/${config}-${sources_hash}.tar.xz PARENT_SCOPE)
+endfunction(cppan_artifact_name)
+
+########################################
+# FUNCTION cppan_artifact_fetch
+########################################
+
+# store is a directory or http(s) url
+# files are unpacked relative to the storage dir
+# out is set to 1 when target files are restored
+function(cppan_artifact_fetch out store name storage_dir bdir config)
+    set(${out} 0 PARENT_SCOPE)
+
+    set(tmp ${bdir}/cppan_artifact)
+    set(archive ${tmp}/artifact.tar.xz)
+    file(REMOVE_RECURSE ${tmp})
+    file(MAKE_DIRECTORY ${tmp})
+
+    if ("${store}" MATCHES "^https?://")
+        file(DOWNLOAD ${store}/${name} ${archive} STATUS status)
+        list(GET status 0 status)
+        if (NOT status EQUAL 0)
+            file(REMOVE_RECURSE ${tmp})
+            return()
+        endif()
+    elseif (EXISTS ${store}/${name})
+        execute_process(COMMAND ${CMAKE_COMMAND} -E copy ${store}/${name} ${archive} RESULT_VARIABLE ret)
+        if (NOT ret EQUAL 0)
+            file(REMOVE_RECURSE ${tmp})
+            return()
+        endif()
+    else()
+        file(REMOVE_RECURSE ${tmp})
+        return()
+    endif()
+
+    execute_process(COMMAND ${CMAKE_COMMAND} -E tar xf ${archive} WORKING_DIRECTORY ${tmp} RESULT_VARIABLE ret)
+    if (NOT ret EQUAL 0 OR NOT EXISTS ${tmp}/files.cmake)
+        file(REMOVE_RECURSE ${tmp})
+        return()
+    endif()
+
+    set(artifact_files)
+    set(artifact_target_file)
+    set(artifact_linker_file)
+    include(${tmp}/files.cmake)
+    foreach(f ${artifact_files})
+        get_filename_component(dir ${storage_dir}/${f} DIRECTORY)
+        file(COPY ${tmp}/files/${f} DESTINATION ${dir})
+    endforeach()
+
+    # same contents as written by the build
+    set(info "set(TARGET_FILE ${storage_dir}/${artifact_target_file})\n")
+    if (artifact_linker_file)
+        set(info "${info}set(TARGET_LINKER_FILE ${storage_dir}/${artifact_linker_file})\n")
+    endif()
+    file(WRITE ${bdir}/cppan_target_info_${config}.cmake "${info}")
+    file(REMOVE_RECURSE ${tmp})
+
+    message(STATUS "Fetched prebuilt ${name}")
+    set(${out} 1 PARENT_SCOPE)
+endfunction(cppan_artifact_fetch)
+
+########################################
+# FUNCTION cppan_artifact_store
+########################################
+
+# packs target files written by the last build
+function(cppan_artifact_store store name storage_dir bdir config)
+    set(info ${bdir}/cppan_target_info_${config}.cmake)
+    if (NOT EXISTS ${info})
+        return()
+    endif()
+    set(TARGET_FILE)
+    set(TARGET_LINKER_FILE)
+    include(${info})
+    if (NOT EXISTS "${TARGET_FILE}")
+        return()
+    endif()
+
+    set(files)
+    foreach(f ${TARGET_FILE} ${TARGET_LINKER_FILE})
+        if (NOT EXISTS ${f})
+            continue()
+        endif()
+        file(RELATIVE_PATH r ${storage_dir} ${f})
+        # cannot be restored on other machines
+        if ("${r}" MATCHES "^\\.\\.")
+            return()
+        endif()
+        list(APPEND files ${r})
+    endforeach()
+    list(REMOVE_DUPLICATES files)
+    file(RELATIVE_PATH target ${storage_dir} ${TARGET_FILE})
+    set(linker)
+    if (TARGET_LINKER_FILE AND EXISTS ${TARGET_LINKER_FILE})
+        file(RELATIVE_PATH linker ${storage_dir} ${TARGET_LINKER_FILE})
+    endif()
+
+    set(tmp ${bdir}/cppan_artifact)
+    file(REMOVE_RECURSE ${tmp})
+    foreach(f ${files})
+        get_filename_component(dir ${tmp}/files/${f} DIRECTORY)
+        file(COPY ${storage_dir}/${f} DESTINATION ${dir})
+    endforeach()
+    file(WRITE ${tmp}/files.cmake
+        "set(artifact_files \"${files}\")\n"
+        "set(artifact_target_file \"${target}\")\n"
+        "set(artifact_linker_file \"${linker}\")\n"
+    )
+
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} -E tar cJf artifact.tar.xz files.cmake files
+        WORKING_DIRECTORY ${tmp}
+        RESULT_VARIABLE ret
+    )
+    if (NOT ret EQUAL 0)
+        file(REMOVE_RECURSE ${tmp})
+        return()
+    endif()
+
+    # store errors do not fail the build
+    if ("${store}" MATCHES "^https?://")
+        file(UPLOAD ${tmp}/artifact.tar.xz ${store}/${name} STATUS status)
+        list(GET status 0 code)
+        if (NOT code EQUAL 0)
+            message(STATUS "Cannot upload ${name}: ${status}")
+        endif()
+    else()
+        # other builders may store the same artifact at the same time
+        get_filename_component(dir ${store}/${name} DIRECTORY)
+        file(MAKE_DIRECTORY ${dir})
+        string(RANDOM r)
+        execute_process(COMMAND ${CMAKE_COMMAND} -E copy ${tmp}/artifact.tar.xz ${store}/${name}.${r} RESULT_VARIABLE ret)
+        if (ret EQUAL 0)
+            file(RENAME ${store}/${name}.${r} ${store}/${name})
+        endif()
+    endif()
+
+    file(REMOVE_RECURSE ${tmp})
+endfunction(cppan_artifact_store)
+
 ########################################
 # FUNCTION file_write_once
 ########################################
@@ -156,6 +156,11 @@ if (NOT EXISTS ${import} OR
         add_variable(GEN_CHILD_VARS CPPAN_DEBUG_STACK_SPACE)
         add_variable(GEN_CHILD_VARS CPPAN_BUILD_VERBOSE)
         add_variable(GEN_CHILD_VARS CPPAN_BUILD_WARNING_LEVEL)
+        add_variable(GEN_CHILD_VARS CPPAN_OBJECT_CACHE)
+        add_variable(GEN_CHILD_VARS CPPAN_ARTIFACT_STORE)
+        add_variable(GEN_CHILD_VARS CPPAN_UNITY_BUILD)
+        add_variable(GEN_CHILD_VARS CPPAN_UNITY_BUILD_BATCH_SIZE)
+        add_variable(GEN_CHILD_VARS CPPAN_AUTO_PCH)
         add_variable(GEN_CHILD_VARS CPPAN_COPY_ALL_LIBRARIES_TO_OUTPUT)
         add_variable(GEN_CHILD_VARS XCODE)
         add_variable(GEN_CHILD_VARS VISUAL_STUDIO)
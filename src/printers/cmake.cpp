@@ -17,15 +17,20 @@
 #include "cmake.h"
 
 #include <access_table.h>
+#include <checks_detail.h>
+#include <checks_native.h>
+#include <counters.h>
 #include <database.h>
 #include <directories.h>
 #include <exceptions.h>
 #include <hash.h>
+#include <jobserver.h>
 #include <lock.h>
 #include <inserts.h>
 #include <program.h>
 #include <resolver.h>
 #include <settings.h>
+#include <trace.h>
 
 #include <boost/algorithm/string.hpp>
 
@@ -34,6 +39,8 @@
 #include <primitives/executor.h>
 #include <primitives/win32helpers.h>
 
+#include <regex>
+
 #ifdef _WIN32
 #include <WinReg.hpp>
 #endif
@@ -63,7 +70,7 @@ const String cppan_cmake_config_filename = "CPPANConfig.cmake";
 const String cmake_export_import_filename = "export.cmake";
 const String cmake_helpers_filename = "helpers.cmake";
 const String cppan_stamp_filename = "cppan_sources.stamp";
-const String cppan_checks_yml = "checks.yml";
+const String cppan_checks_file = "checks.bin";
 const String parallel_checks_file = "vars.txt";
 
 const String cmake_src_actions_filename = "actions.cmake";
@@ -71,6 +78,8 @@ const String cmake_src_include_guard_filename = "include.cmake";
 
 const String cmake_cppan_location_filename = "cppan_location.cmake";
 const String cmake_obj_build_filename = "build.cmake";
+const String cmake_obj_aggregate_filename = "aggregate.cmake";
+const String cmake_aggregate_deps_filename = "build_deps.cmake";
 const String cmake_obj_generate_filename = "generate.cmake";
 const String cmake_obj_exports_filename = "exports.cmake";
 const String cmake_obj_include_script_filename = "include_script.cmake";
@@ -131,17 +140,46 @@ public:
     }
 };
 
+// Prints one call for all unconditional packages
+// and one call per package with conditions.
+template <class F>
+void print_packages_call(CMakeContext &ctx, const String &call, const std::vector<Package> &pkgs, F &&args)
+{
+    auto unconditional = [](const Package &p)
+    {
+        return std::all_of(p.conditions.begin(), p.conditions.end(), [](const auto &c) { return c.empty(); });
+    };
+
+    if (std::any_of(pkgs.begin(), pkgs.end(), unconditional))
+    {
+        ctx.increaseIndent(call);
+        for (auto &p : pkgs)
+        {
+            if (unconditional(p))
+                ctx.addLine(args(p));
+        }
+        ctx.decreaseIndent(")");
+    }
+    for (auto &p : pkgs)
+    {
+        if (unconditional(p))
+            continue;
+        ScopedDependencyCondition sdc(ctx, p, false);
+        ctx.addLine(call + (call.back() == '(' ? "" : " ") + args(p) + ")");
+    }
+}
+
 void registerCmakePackage()
 {
 #ifdef _WIN32
     // if we write into HKLM, we won't be able to access the pkg file in admins folder
     winreg::RegKey icon(/*is_elevated() ? HKEY_LOCAL_MACHINE : */HKEY_CURRENT_USER, L"Software\\Kitware\\CMake\\Packages\\CPPAN");
     icon.SetStringValue(L"", directories.get_static_files_dir().wstring().c_str());
-    write_file_if_different(directories.get_static_files_dir() / cppan_cmake_config_filename, cppan_cmake_config);
+    write_file_if_changed(directories.get_static_files_dir() / cppan_cmake_config_filename, cppan_cmake_config);
 #else
     auto cppan_cmake_dir = get_home_directory() / ".cmake" / "packages";
-    write_file_if_different(cppan_cmake_dir / "CPPAN" / "1", cppan_cmake_dir.string());
-    write_file_if_different(cppan_cmake_dir / cppan_cmake_config_filename, cppan_cmake_config);
+    write_file_if_changed(cppan_cmake_dir / "CPPAN" / "1", cppan_cmake_dir.string());
+    write_file_if_changed(cppan_cmake_dir / cppan_cmake_config_filename, cppan_cmake_config);
 #endif
 }
 
@@ -266,7 +304,7 @@ void print_local_project_files(CMakeContext &ctx, const Project &p)
 {
     ctx.increaseIndent("set(src");
     for (auto &f : FilesSorted(p.files.begin(), p.files.end()))
-        ctx.addLine("\"" + normalize_path(f) + "\"");
+        ctx.addLine("\"", normalize_path(f), "\"");
     ctx.decreaseIndent(")");
 }
 
@@ -364,17 +402,6 @@ String get_binary_path(const Package &d)
     return get_binary_path(d, "${CMAKE_BINARY_DIR}");
 }
 
-void gather_all_deps(const Packages &dd, Packages &out)
-{
-    for (auto &dp : dd)
-    {
-        auto &d = dp.second;
-        auto i = out.insert(dp);
-        if (i.second)
-            gather_all_deps(rd[d].dependencies, out);
-    }
-}
-
 void print_dependencies(CMakeContext &ctx, const Package &d, bool use_cache)
 {
     const auto &dd = rd[d].dependencies;
@@ -391,16 +418,20 @@ void print_dependencies(CMakeContext &ctx, const Package &d, bool use_cache)
     //ctx.addLine("set(CPPAN_BUILD_EXECUTABLES_WITH_SAME_CONFIG 0)");
     //ctx.addLine();
 
-    for (auto &p : dd)
+    auto print_dirs = [&dd](CMakeContext &ctx)
     {
-        auto &dep = p.second;
+        std::vector<Package> deps;
+        for (auto &p : dd)
+            deps.push_back(p.second);
+        print_packages_call(ctx, "cppan_set_dependency_dirs(", deps, [](const auto &dep)
+        {
+            if (dep.flags[pfLocalProject])
+                return dep.variable_no_version_name + "_DIR \"" + normalize_path(rd[dep].config->getDefaultProject().root_directory) + "\"";
+            return dep.variable_no_version_name + "_DIR \"" + normalize_path(dep.getDirSrc()) + "\"";
+        });
+    };
 
-        ScopedDependencyCondition sdc(ctx, dep);
-        if (dep.flags[pfLocalProject])
-            ctx.addLine("set_cache_var(" + dep.variable_no_version_name + "_DIR " + normalize_path(rd[dep].config->getDefaultProject().root_directory) + ")");
-        else
-            ctx.addLine("set_cache_var(" + dep.variable_no_version_name + "_DIR " + normalize_path(dep.getDirSrc()) +  ")");
-    }
+    print_dirs(ctx);
     ctx.emptyLines();
 
     for (auto &p : dd)
@@ -423,13 +454,13 @@ void print_dependencies(CMakeContext &ctx, const Package &d, bool use_cache)
             // MUST be here!
             // actions are executed from include_directories only projects
             ScopedDependencyCondition sdc(ctx_actions, dep);
-            ctx_actions.addLine("# " + dep.target_name);
+            ctx_actions.addLine("# ", dep.target_name);
             ctx_actions.addLine("cppan_include(\"" + normalize_path(dir / cmake_src_actions_filename) + "\")");
         }
         else if (!use_cache || dep.flags[pfHeaderOnly])
         {
             ScopedDependencyCondition sdc(ctx, dep);
-            ctx.addLine("# " + dep.target_name);
+            ctx.addLine("# ", dep.target_name);
             add_subdirectory(ctx, dir.string());
         }
         else if (dep.flags[pfLocalProject])
@@ -447,7 +478,7 @@ void print_dependencies(CMakeContext &ctx, const Package &d, bool use_cache)
         {
             // add local build includes
             ScopedDependencyCondition sdc2(ctx2, dep);
-            ctx2.addLine("# " + dep.target_name);
+            ctx2.addLine("# ", dep.target_name);
             add_subdirectory(ctx2, dep.getDirSrc().string());
             includes.push_back(dep);
         }
@@ -469,8 +500,8 @@ void print_dependencies(CMakeContext &ctx, const Package &d, bool use_cache)
         for (auto &dep : includes)
         {
             ScopedDependencyCondition sdc(ctx, dep);
-            ctx.addLine("# " + dep.target_name + "\n" +
-                "cppan_include(\"" + normalize_path(dep.getDirObj() / cmake_obj_generate_filename) + "\")");
+            ctx.addLine("# ", dep.target_name, "\n",
+                "cppan_include(\"", normalize_path(dep.getDirObj() / cmake_obj_generate_filename), "\")");
         }
 
         ctx.else_();
@@ -489,16 +520,7 @@ void print_dependencies(CMakeContext &ctx, const Package &d, bool use_cache)
         }*/
     }
 
-    for (auto &p : dd)
-    {
-        auto &dep = p.second;
-
-        ScopedDependencyCondition sdc(ctx, dep);
-        if (dep.flags[pfLocalProject])
-            ctx.addLine("set_cache_var(" + dep.variable_no_version_name + "_DIR " + normalize_path(rd[dep].config->getDefaultProject().root_directory) + ")");
-        else
-            ctx.addLine("set_cache_var(" + dep.variable_no_version_name + "_DIR " + normalize_path(dep.getDirSrc()) + ")");
-    }
+    print_dirs(ctx);
 
     // after all deps
     ctx += ctx_actions;
@@ -511,10 +533,8 @@ void print_dependencies(CMakeContext &ctx, const Package &d, bool use_cache)
     if (!all_deps)
     {
         all_deps.emplace();
-        Packages out;
-        gather_all_deps(dd, out);
         StringMap<Package> real_values;
-        for (auto &p : out)
+        for (auto &p : rd.get_transitive_dependencies(d, DependencyClosure::All))
         {
             auto &dep = p.second;
 
@@ -532,8 +552,8 @@ void print_dependencies(CMakeContext &ctx, const Package &d, bool use_cache)
             continue;
         print_includes = true;
         ScopedDependencyCondition sdc(ctx_includes, dep);
-        ctx_includes.addLine("# " + dep.target_name + "\n" +
-            "include(" + normalize_path(dep.getDirObj()) + "/" + cmake_obj_include_script_filename + ")");
+        ctx_includes.addLine("# ", dep.target_name, "\n",
+            "include(", normalize_path(dep.getDirObj()), "/", cmake_obj_include_script_filename, ")");
     }
     if (!rd[d].config->getDefaultProject().include_script.empty())
     {
@@ -547,55 +567,36 @@ void print_dependencies(CMakeContext &ctx, const Package &d, bool use_cache)
     ctx.splitLines();
 }
 
-void gather_build_deps(const Packages &dd, Packages &out, bool recursive = false, int depth = 0)
+// build deps that are built together in one aggregate tree,
+// dependencies go before their dependents
+std::vector<Package> gather_aggregate_deps(const Packages &build_deps)
 {
-    for (auto &dp : dd)
+    PackagesMap deps;
+    for (auto &dp : build_deps)
     {
-        auto &d = dp.second;
-        if (d.flags[pfHeaderOnly] || d.flags[pfIncludeDirectoriesOnly])
-            continue;
-        // add only direct dependencies of the invocation package
-        if (d.flags[pfExecutable])
-        {
-            if (depth == 0)
-                out.insert(dp);
+        auto &p = dp.second;
+        // local projects are always built inside solution,
+        // executables are built with their own configuration,
+        // conditional deps are known only during cmake run
+        if (p.flags[pfLocalProject] || p.flags[pfExecutable] || !p.conditions.empty())
             continue;
-        }
-        auto i = out.insert(dp);
-        if (i.second && recursive)
-            gather_build_deps(rd[d].dependencies, out, recursive, depth + 1);
+        deps.emplace(p, p);
     }
-}
 
-void gather_copy_deps(const Packages &dd, Packages &out)
-{
-    for (auto &dp : dd)
+    std::vector<Package> out;
+    for (auto &p : rd.get_topological_order())
     {
-        auto &d = dp.second;
-        if (d.flags[pfHeaderOnly] || d.flags[pfIncludeDirectoriesOnly])
-            continue;
-        if (d.flags[pfExecutable])
-        {
-            if (!rd[d].config->getDefaultProject().copy_to_output_dir)
-                continue;
-            if (!Settings::get_local_settings().copy_all_libraries_to_output)
-            {
-                if (!d.flags[pfLocalProject])
-                    continue;
-                if (d.flags[pfLocalProject] && !d.flags[pfDirectDependency])
-                    continue; // but maybe copy its deps?
-            }
-            else
-            {
-                // copy only direct executables
-                if (!d.flags[pfDirectDependency])
-                    continue;
-            }
-        }
-        auto i = out.insert(dp);
-        if (i.second)
-            gather_copy_deps(rd[d].dependencies, out);
+        auto i = deps.find(p);
+        if (i != deps.end())
+            out.push_back(i->second);
     }
+    return out;
+}
+
+// compiled objects are shared between all storage dirs
+path get_object_cache_dir()
+{
+    return get_user_directories().storage_dir / "cache" / "obj";
 }
 
 auto run_command(const Settings &bs, primitives::Command &c)
@@ -603,7 +604,12 @@ auto run_command(const Settings &bs, primitives::Command &c)
     if (bs.build_system_verbose)
         c.inherit = true;
     std::error_code ec;
-    c.execute(ec);
+    {
+        // children (cmake, make, nested cppan) share our jobserver
+        JobToken t;
+        counter_add(Counter::ProcessesSpawned);
+        c.execute(ec);
+    }
     if (ec)
         throw std::runtime_error("Run command '" + c.print() + "', error: " + boost::trim_copy(ec.message()));
     if (!bs.build_system_verbose)
@@ -642,34 +648,29 @@ void CMakePrinter::print_build_dependencies(CMakeContext &ctx, const String &tar
     // Run building of dependencies before project building.
     // We build all deps because if some dep is removed,
     // build system give you and error about this.
-    Packages build_deps;
-    gather_build_deps(rd[d].dependencies, build_deps, true);
+    auto build_deps = rd.get_transitive_dependencies(d, DependencyClosure::Build);
+
+    // root project builds these deps in one aggregate tree
+    std::set<String> aggregated;
+    if (d.empty() && settings.aggregate_dependency_builds)
+    {
+        for (auto &p : gather_aggregate_deps(build_deps))
+            aggregated.insert(p.target_name);
+    }
 
     if (!build_deps.empty())
     {
         CMakeContext local;
-        local.addLine("set(CPPAN_GET_CHILDREN_VARIABLES 1)");
-        local.addLine("get_configuration_with_generator(config)"); // children
-        local.if_("CPPAN_BUILD_EXECUTABLES_WITH_SAME_CONFIG");
-        local.addLine("get_configuration_with_generator(config_exe)");
-        local.else_();
-        local.addLine("get_configuration_exe(config_exe)");
-        local.endif();
-        local.addLine("set(CPPAN_GET_CHILDREN_VARIABLES 0)");
-
-        local.emptyLines();
-        local.addLine("string(TOUPPER \"${CMAKE_BUILD_TYPE}\" CMAKE_BUILD_TYPE_UPPER)");
-        local.emptyLines();
+        // sets config, config_exe and rest
+        local.addLine("cppan_build_dependencies_setup()");
 
         // we're in helper, set this var to build target
         if (d.empty())
             local.addLine("set(this " + target + ")");
         local.emptyLines();
 
-        // TODO: check with ninja and remove if ok
-        //Packages build_deps_all;
-        //gather_build_deps(rd[d].dependencies, build_deps_all, true);
-        //for (auto &dp : build_deps_all)
+        local.addLine("set(build_commands)");
+        std::vector<Package> built, imported;
         for (auto &dp : build_deps)
         {
             auto &p = dp.second;
@@ -678,145 +679,29 @@ void CMakePrinter::print_build_dependencies(CMakeContext &ctx, const String &tar
             if (p.flags[pfLocalProject])
                 continue;
 
-            ScopedDependencyCondition sdc(local, p);
-            local.addLine("get_target_property(implib_" + p.variable_name + " " + p.target_name + " IMPORTED_IMPLIB_${CMAKE_BUILD_TYPE_UPPER})");
-            local.addLine("get_target_property(imploc_" + p.variable_name + " " + p.target_name + " IMPORTED_LOCATION_${CMAKE_BUILD_TYPE_UPPER})");
-            local.addLine("get_target_property(impson_" + p.variable_name + " " + p.target_name + " IMPORTED_SONAME_${CMAKE_BUILD_TYPE_UPPER})");
+            imported.push_back(p);
+            if (aggregated.find(p.target_name) == aggregated.end())
+                built.push_back(p);
         }
-        local.emptyLines();
-
-#define ADD_VAR(v) rest += "-D" #v "=${" #v "} "
-        String rest;
-        // we do not pass this var to children
-        //ADD_VAR(CPPAN_BUILD_EXECUTABLES_WITH_SAME_CONFIG);
-        ADD_VAR(CPPAN_BUILD_EXECUTABLES_WITH_SAME_CONFIGURATION);
-        ADD_VAR(CMAKE_BUILD_TYPE);
-        ADD_VAR(CPPAN_BUILD_VERBOSE);
-        ADD_VAR(CPPAN_BUILD_WARNING_LEVEL);
-        ADD_VAR(CPPAN_RC_ENABLED);
-        ADD_VAR(CPPAN_COPY_ALL_LIBRARIES_TO_OUTPUT);
-        ADD_VAR(N_CORES);
-        ADD_VAR(XCODE);
-        ADD_VAR(NINJA);
-        ADD_VAR(NINJA_FOUND);
-        ADD_VAR(VISUAL_STUDIO);
-        ADD_VAR(CLANG);
-#undef ADD_VAR
-
-        local.addLine("set(rest \"" + rest + "\")");
-        local.emptyLines();
-
-        local.addLine(R"(set(ext sh)
-if (WIN32)
-    set(ext bat)
-endif()
-)");
-        local.emptyLines();
-
-        if (d.empty())
-            local.addLine("set(file ${BDIR}/cppan_build_deps_$<CONFIG>.${ext})");
-        else
-            // FIXME: this is probably incorrect
-            local.addLine("set(file ${BDIR}/cppan_build_deps_" + d.target_name_hash + "_$<CONFIG>.${ext})");
-        local.emptyLines();
-
-        local.addLine(R"(#if (NOT CPPAN_BUILD_LEVEL)
-    #set(CPPAN_BUILD_LEVEL 0)
-#else()
-    #math(EXPR CPPAN_BUILD_LEVEL "${CPPAN_BUILD_LEVEL} + 1")
-#endif()
-
-set(bat_file_error)
-if (WIN32)
-    set(bat_file_error "@if %errorlevel% neq 0 goto :cmEnd")
-endif()
-
-set(at_symbol)
-if (WIN32)
-    set(at_symbol @)
-endif()
-)");
-
-        bool has_build_deps = false;
-        for (auto &dp : build_deps)
+        bool has_build_deps = !built.empty();
+        print_packages_call(local, "cppan_add_build_dependencies(build_commands "s + (d.empty() ? "1" : "0"), built, [](const auto &p)
+        {
+            return "\"" + normalize_path(p.getDirObj()) + "\" " + (p.flags[pfExecutable] ? "1" : "0");
+        });
+        if (!aggregated.empty())
         {
-            auto &p = dp.second;
-
-            // local projects are always built inside solution
-            if (p.flags[pfLocalProject])
-                continue;
-
-            String cfg = "config";
-            if (p.flags[pfExecutable] && !p.flags[pfLocalProject])
-                cfg = "config_exe";
-
             has_build_deps = true;
-            ScopedDependencyCondition sdc(local, p, false);
-            local.addLine("set(bd_" + p.variable_name + " \"");
-            //local.addLine("@echo Building " + p.target_name + ": ${" + cfg + "}");
-            local.addNoNewLine("${at_symbol}");
-            local.addText("\\\"${CMAKE_COMMAND}\\\" ");
-            //local.addText("-DCPPAN_BUILD_LEVEL=${CPPAN_BUILD_LEVEL} ");
-            //local.addText("-DTARGET_VAR=" + p.variable_name + " "); // remove!
-            //local.addText("-DTARGET_FILE=$<TARGET_FILE:" + p.target_name + "> ");
-
-            // this also probably must consider CPPAN_BUILD_EXECUTABLES_WITH_SAME_CONFIG
-            if (p.flags[pfExecutable] /* and not CPPAN_BUILD_EXECUTABLES_WITH_SAME_CONFIG */)
-                local.addText("-DCONFIG=Release ");
-            else
-                local.addText("-DCONFIG=$<CONFIG> ");
-
-            local.addText("-DBUILD_DIR=" + normalize_path(p.getDirObj()) + "/build/${" + cfg + "} ");
-            local.addText("-DEXECUTABLE="s + (p.flags[pfExecutable] ? "1" : "0") + " ");
-            if (d.empty())
-                local.addText("-DMULTICORE=1 ");
-            local.addText("${rest} ");
-
-            local.addText("-P " + normalize_path(p.getDirObj()) + "/" + cmake_obj_build_filename);
-#ifndef _WIN32
-            // causes system overloads
-            //local.addText(" &");
-#endif
-            local.addText("\n${bat_file_error}\")");
+            local.addLine("cppan_add_aggregate_build(build_commands \"" + normalize_path(cwd / settings.cppan_dir / cmake_aggregate_deps_filename) + "\")");
         }
         local.emptyLines();
 
-        local.addLine("set(bat_file_begin)");
-        local.if_("WIN32");
-        local.addLine("set(bat_file_begin @setlocal)");
-        local.addLine(R"(set(bat_file_error "\n
-@exit /b 0
-:cmEnd
-@endlocal & @call :cmErrorLevel %errorlevel%
-:cmErrorLevel
-@exit /b %1
-"))");
-        local.else_();
-        local.addLine("set(bat_file_begin \"#!/bin/sh\\n\")");
-        local.endif();
-
-        local.increaseIndent("file(GENERATE OUTPUT ${file} CONTENT \"${bat_file_begin}");
-        for (auto &dp : build_deps)
-        {
-            auto &p = dp.second;
-
-            // local projects are always built inside solution
-            if (p.flags[pfLocalProject])
-                continue;
-
-            local.addLine("${bd_" + p.variable_name + "}");
-        }
-        local.addLine("${bat_file_error}");
-        local.decreaseIndent("\")");
+        if (d.empty())
+            local.addLine("cppan_generate_script(file ${BDIR}/cppan_build_deps_$<CONFIG> build_commands)");
+        else
+            // FIXME: this is probably incorrect
+            local.addLine("cppan_generate_script(file ${BDIR}/cppan_build_deps_" + d.target_name_hash + "_$<CONFIG> build_commands)");
         local.emptyLines();
 
-        local.addLine(R"(
-if (ANDROID)
-elseif (UNIX)
-    set(file chmod u+x ${file} COMMAND ${file})
-endif()
-)");
-
         bool deps = false;
         String build_deps_tgt = "${this}";
         if (d.empty() && target.find("-b") != target.npos)
@@ -831,20 +716,12 @@ endif()
         // add custom target and add a dependency below
         // second way is to use add custom target + add custom command (POST?(PRE)_BUILD)
         local.addLine("set(bp)");
-        //for (auto &dp : build_deps_all)
-        for (auto &dp : build_deps)
+        // TODO: check with ninja and remove if ok
+        //for (auto &dp : rd.get_transitive_dependencies(d, DependencyClosure::Build))
+        print_packages_call(local, "cppan_add_imported_byproducts(bp PROPERTIES IMPORTED_IMPLIB IMPORTED_LOCATION IMPORTED_SONAME TARGETS", imported, [](const auto &p)
         {
-            auto &p = dp.second;
-
-            // local projects are always built inside solution
-            if (p.flags[pfLocalProject])
-                continue;
-
-            ScopedDependencyCondition sdc(local, p, false);
-            local.addLine("set(bp ${bp} ${implib_" + p.variable_name + "})");
-            local.addLine("set(bp ${bp} ${imploc_" + p.variable_name + "})");
-            local.addLine("set(bp ${bp} ${impson_" + p.variable_name + "})");
-        }
+            return p.target_name;
+        });
         local.emptyLines();
 
         local.increaseIndent("add_custom_target(" + build_deps_tgt);
@@ -895,21 +772,6 @@ void CMakePrinter::print_copy_dependencies(CMakeContext &ctx, const String &targ
     if (cache_cond)
         ctx.if_("CPPAN_USE_CACHE");
 
-    // prepare copy files
-    ctx.addLine("set(ext sh)");
-    ctx.if_("WIN32");
-    ctx.addLine("set(ext bat)");
-    ctx.endif();
-    ctx.emptyLines();
-    ctx.addLine("set(file ${BDIR}/cppan_copy_deps_$<CONFIG>.${ext})");
-    ctx.emptyLines();
-    ctx.addLine("set(copy_content)");
-    ctx.if_("WIN32");
-    ctx.addLine("set(copy_content \"${copy_content} @setlocal\\n\")");
-    ctx.else_();
-    ctx.addLine("set(copy_content \"#!/bin/sh\\n\")");
-    ctx.endif();
-
     // we're in helper, set this var to build target
     if (d.empty())
         ctx.addLine("set(this " + target + ")");
@@ -935,15 +797,12 @@ void CMakePrinter::print_copy_dependencies(CMakeContext &ctx, const String &targ
         ctx.addLine("set(output_dir $<TARGET_FILE_DIR:${this}>)");
     ctx.addLine();
 
-    ctx.addLine(R"(
-set(at_symbol)
-if (WIN32)
-    set(at_symbol @)
-endif()
-)");
+    ctx.addLine("set(copy_commands)");
+    ctx.emptyLines();
 
-    Packages copy_deps;
-    gather_copy_deps(rd[d].dependencies, copy_deps);
+    // conditions are changed below
+    auto copy_deps = rd.get_transitive_dependencies(d, DependencyClosure::Copy);
+    std::vector<Package> copied, imported;
     for (auto &dp : copy_deps)
     {
         auto &p = dp.second;
@@ -961,125 +820,54 @@ endif()
             ctx.emptyLines();
         }
 
-        config_section_title(ctx, "Copy " + p.target_name);
-
-        ScopedDependencyCondition sdc(ctx, p);
-        ctx.addLine("set(copy 1)");
-        ctx.addLine("get_target_property(type " + p.target_name + " TYPE)");
-
-        ctx.if_("\"${type}\" STREQUAL STATIC_LIBRARY");
-        ctx.addLine("set(copy 0)");
-        ctx.endif();
-        ctx.addLine();
-
-        ctx.if_("CPPAN_COPY_ALL_LIBRARIES_TO_OUTPUT");
-        ctx.addLine("set(copy 1)");
-        ctx.endif();
-        ctx.addLine();
+        copied.push_back(p);
+        // local projects are always built inside solution
+        if (!p.flags[pfLocalProject])
+            imported.push_back(p);
+    }
 
+    config_section_title(ctx, "copy");
+    // import library for shared libs
+    auto copy_import_lib = settings.copy_import_libs || settings.copy_all_libraries_to_output;
+    print_packages_call(ctx, "cppan_add_copy_dependencies(copy_commands " + target + " " + (copy_import_lib ? "1" : "0"), copied, [this](const auto &p)
+    {
         auto prj = rd[p].config->getDefaultProject();
 
         auto output_directory = "${output_dir}/"s;
         output_directory += prj.output_directory + "/";
 
-        ctx.if_("copy");
+        String name;
+        if (!prj.output_name.empty())
+            name = prj.output_name;
+        else
         {
-            String s;
-            s += "set(copy_content \"${copy_content} ${at_symbol}\")\n";
-            s += "        set(copy_content \"${copy_content} \\\"${CMAKE_COMMAND}\\\" -E copy_if_different ";
-            String name;
-            if (!prj.output_name.empty())
-                name = prj.output_name;
-            else
+            if (p.flags[pfExecutable] || (p.flags[pfLocalProject] && prj.type == ProjectType::Executable))
             {
-                if (p.flags[pfExecutable] || (p.flags[pfLocalProject] && rd[p].config->getDefaultProject().type == ProjectType::Executable))
-                {
-                    if (settings.full_path_executables)
-                        name = "$<TARGET_FILE_NAME:" + p.target_name + ">";
-                    else
-                        name = p.ppath.back() + "${CMAKE_EXECUTABLE_SUFFIX}";
-                }
-                else
-                {
-                    // if we change non-exe name, we still won't fix linker information about dependencies' names
+                if (settings.full_path_executables)
                     name = "$<TARGET_FILE_NAME:" + p.target_name + ">";
-                }
+                else
+                    name = p.ppath.back() + "${CMAKE_EXECUTABLE_SUFFIX}";
+            }
+            else
+            {
+                // if we change non-exe name, we still won't fix linker information about dependencies' names
+                name = "$<TARGET_FILE_NAME:" + p.target_name + ">";
             }
-            s += "$<TARGET_FILE:" + p.target_name + "> " + output_directory + name;
-            s += "\\n\")";
-            ctx.addLine(s);
-            ctx.addLine("add_dependencies(" + target + " " + p.target_name + ")");
-
-            ctx.if_("WIN32");
-            ctx.addLine("set(copy_content \"${copy_content} @if %errorlevel% neq 0 goto :cmEnd\\n\")");
-            ctx.endif();
-        }
-        ctx.addLine();
-
-        // import library for shared libs
-        if (settings.copy_import_libs || settings.copy_all_libraries_to_output)
-        {
-            ctx.if_("\"${type}\" STREQUAL SHARED_LIBRARY");
-            String s;
-            s += "set(copy_content \"${copy_content} \\\"${CMAKE_COMMAND}\\\" -E copy_if_different ";
-            s += "$<TARGET_LINKER_FILE:" + p.target_name + "> " + output_directory + "$<TARGET_LINKER_FILE_NAME:" + p.target_name + ">";
-            s += "\\n\")";
-            ctx.addLine(s);
-
-            ctx.if_("WIN32");
-            ctx.addLine("set(copy_content \"${copy_content} @if %errorlevel% neq 0 goto :cmEnd\\n\")");
-            ctx.endif();
-
-            ctx.endif();
         }
+        return p.target_name + " \"" + output_directory + "\" \"" + name + "\"";
+    });
+    ctx.emptyLines();
 
-        ctx.endif();
-        ctx.addLine();
-    }
-
-    ctx.if_("WIN32");
-    ctx.addLine(R"(set(copy_content "${copy_content}\n
-@exit /b 0
-:cmEnd
-@endlocal & @call :cmErrorLevel %errorlevel%
-:cmErrorLevel
-@exit /b %1
-"))");
-    ctx.endif();
-
-    ctx.addLine(R"(
-file(GENERATE OUTPUT ${file} CONTENT "${copy_content}
-")
-if (ANDROID)
-elseif (UNIX)
-    set(file chmod u+x ${file} COMMAND ${file})
-endif()
-add_custom_command(TARGET )" + target + R"( POST_BUILD
-    COMMAND ${file}
-)
-)");
+    ctx.addLine("cppan_generate_script(file ${BDIR}/cppan_copy_deps_$<CONFIG> copy_commands)");
+    ctx.increaseIndent("add_custom_command(TARGET " + target + " POST_BUILD");
+    ctx.addLine("COMMAND ${file}");
+    ctx.decreaseIndent(")");
+    ctx.addLine();
 
     {
         // like with build deps
         // only for ninja at the moment
         ctx.if_("NINJA AND WIN32");
-        for (auto &dp : copy_deps)
-        {
-            auto &p = dp.second;
-
-            // local projects are always built inside solution
-            if (p.flags[pfLocalProject])
-                continue;
-
-            ScopedDependencyCondition sdc(ctx, p);
-            ctx.addLine("get_target_property(imploc_" + p.variable_name + " " + p.target_name + " IMPORTED_LOCATION_${CMAKE_BUILD_TYPE_UPPER})");
-
-            // FIXME: on apple some targets fail to find above var
-            //ctx.if_("\"${imploc_" + p.variable_name + "}\" STREQUAL \"imploc_" + p.variable_name + "-NOTFOUND\"");
-            //ctx.addLine("set(imploc_" + p.variable_name + ")");
-            //ctx.endif();
-        }
-        ctx.emptyLines();
 
         bool deps = false;
         String build_deps_tgt = "${this}";
@@ -1094,19 +882,12 @@ add_custom_command(TARGET )" + target + R"( POST_BUILD
         // do not use add_custom_command as it doesn't work
         // add custom target and add a dependency below
         // second way is to use add custom target + add custom command (POST?(PRE)_BUILD)
+        // FIXME: on apple some targets fail to find imported location
         ctx.addLine("set(bp)");
-        //for (auto &dp : build_deps_all)
-        for (auto &dp : copy_deps)
+        print_packages_call(ctx, "cppan_add_imported_byproducts(bp PROPERTIES IMPORTED_LOCATION TARGETS", imported, [](const auto &p)
         {
-            auto &p = dp.second;
-
-            // local projects are always built inside solution
-            if (p.flags[pfLocalProject])
-                continue;
-
-            ScopedDependencyCondition sdc(ctx, p, false);
-            ctx.addLine("set(bp ${bp} ${imploc_" + p.variable_name + "})");
-        }
+            return p.target_name;
+        });
         ctx.emptyLines();
 
         ctx.increaseIndent("add_custom_target(" + build_deps_tgt);
@@ -1333,11 +1114,13 @@ endif()
 
     file_footer(ctx, d);
 
-    write_file_if_different(bs.source_directory / cmake_config_filename, ctx.getText());
+    write_file_if_changed(bs.source_directory / cmake_config_filename, ctx.getText());
 }
 
 int CMakePrinter::generate(const BuildSettings &bs) const
 {
+    TRACE_SCOPE("generate");
+
     LOG_INFO(logger, "Generating build files...");
 
     auto &s = Settings::get_local_settings();
@@ -1377,6 +1160,13 @@ int CMakePrinter::generate(const BuildSettings &bs) const
     c.args.push_back("-DCPPAN_BUILD_VERBOSE="s + (s.build_system_verbose ? "1" : "0"));
     c.args.push_back("-DCPPAN_BUILD_WARNING_LEVEL="s + std::to_string(s.build_warning_level));
     c.args.push_back("-DCPPAN_USE_CACHE="s + (s.use_cache ? "1" : "0"));
+    if (s.object_cache)
+        c.args.push_back("-DCPPAN_OBJECT_CACHE=" + normalize_path(get_object_cache_dir()));
+    if (!s.artifact_store.empty())
+        c.args.push_back("-DCPPAN_ARTIFACT_STORE=" + s.artifact_store);
+    c.args.push_back("-DCPPAN_UNITY_BUILD="s + (s.unity_build ? "1" : "0"));
+    c.args.push_back("-DCPPAN_UNITY_BUILD_BATCH_SIZE=" + std::to_string(s.unity_build_batch_size));
+    c.args.push_back("-DCPPAN_AUTO_PCH="s + (s.auto_pch ? "1" : "0"));
     if (s.short_local_names)
         c.args.push_back("-DCPPAN_SHORT_LOCAL_NAMES="s + (s.short_local_names ? "1" : "0"));
     //c.args.push_back("-DCPPAN_TEST_RUN="s + (bs.test_run ? "1" : "0"));
@@ -1455,6 +1245,8 @@ int CMakePrinter::generate(const BuildSettings &bs) const
 
 int CMakePrinter::build(const BuildSettings &bs) const
 {
+    TRACE_SCOPE("build");
+
     LOG_INFO(logger, "Starting build process...");
 
     primitives::Command c;
@@ -1556,6 +1348,7 @@ void CMakePrinter::print_meta() const
     access_table->write_if_older(directories.get_static_files_dir() / cmake_export_import_filename, cmake_export_import_file);
     access_table->write_if_older(directories.get_static_files_dir() / cmake_obj_generate_filename, cmake_generate_file);
     access_table->write_if_older(directories.get_static_files_dir() / cmake_obj_build_filename, cmake_build_file);
+    access_table->write_if_older(directories.get_static_files_dir() / cmake_obj_aggregate_filename, cmake_aggregate_file);
     access_table->write_if_older(directories.get_static_files_dir() / "branch.rc.in", branch_rc_in);
     access_table->write_if_older(directories.get_static_files_dir() / "version.rc.in", version_rc_in);
     access_table->write_if_older(directories.get_include_dir() / CPP_HEADER_FILENAME, cppan_h);
@@ -1566,7 +1359,10 @@ void CMakePrinter::print_meta() const
         access_table->write_if_older(cwd / settings.cppan_dir / CPP_HEADER_FILENAME, cppan_h);
 
         // checks file
-        access_table->write_if_older(cwd / settings.cppan_dir / cppan_checks_yml, rd[d].config->getDefaultProject().checks.save());
+        access_table->write_if_older(cwd / settings.cppan_dir / cppan_checks_file, rd[d].config->getDefaultProject().checks.save_binary());
+
+        if (settings.aggregate_dependency_builds)
+            print_aggregate_file(cwd / settings.cppan_dir / cmake_aggregate_deps_filename);
     }
 }
 
@@ -1940,6 +1736,101 @@ void CMakePrinter::print_src_config_file(const path &fn) const
 
     print_bs_insertion(ctx, p, "post sources", &BuildSystemConfigInsertions::post_sources);
 
+    // precompiled headers, c++ only
+    if (!d.flags[pfHeaderOnly])
+    {
+        bool pch_auto = p.pch.size() == 1 && p.pch[0] == "auto";
+        bool pch_off = p.pch.size() == 1 && (p.pch[0] == "off" || p.pch[0] == "false");
+
+        Strings headers;
+        Files skip;
+        String cond = "COMMAND target_precompile_headers";
+        if (pch_off)
+            ;
+        else if (!p.pch.empty() && !pch_auto)
+        {
+            for (auto &h : p.pch)
+                headers.push_back(h[0] == '<' ? h : "${SDIR}/" + normalize_string_copy(h));
+        }
+        // dependency configs are printed once, so headers are always found for them
+        else if (pch_auto || !d.flags[pfLocalProject] || settings.auto_pch)
+        {
+            headers = p.findPrecompiledHeaders(settings.auto_pch_max_headers, skip);
+            if (!pch_auto)
+                cond += " AND CPPAN_AUTO_PCH";
+        }
+
+        if (!headers.empty())
+        {
+            config_section_title(ctx, "precompiled headers");
+            // cmake 3.16
+            ctx.if_(cond);
+            ctx.increaseIndent("target_precompile_headers(${this} PRIVATE");
+            for (auto &h : headers)
+                ctx.addLine("\"$<$<COMPILE_LANGUAGE:CXX>:" + boost::replace_all_copy(h, ">", "$<ANGLE-R>") + ">\"");
+            ctx.decreaseIndent(")");
+            for (auto &f : FilesSorted(skip.begin(), skip.end()))
+                ctx.addLine("set_source_files_properties(\"" + normalize_path(f) + "\" PROPERTIES SKIP_PRECOMPILE_HEADERS ON)");
+            ctx.endif();
+            ctx.addLine();
+        }
+    }
+
+    // unity build, only for dependencies
+    if (!d.flags[pfLocalProject] && !d.flags[pfHeaderOnly] && p.unity_build.value_or(true))
+    {
+        config_section_title(ctx, "unity build");
+        ctx.if_(p.unity_build ? "CPPAN_UNITY_BUILD_BATCH_SIZE" : "CPPAN_UNITY_BUILD");
+        ctx.increaseIndent("cppan_unity_build(src ${CPPAN_UNITY_BUILD_BATCH_SIZE} \"" + normalize_path(d.getDirObj()) + "/build/${config_dir}\"");
+        ctx.addLine("BASE ${SDIR}");
+        if (!p.unity_build_exclude.empty())
+        {
+            // regexes are matched here like in exclude_from_build,
+            // cmake gets plain file names relative to SDIR
+            std::vector<std::regex> excludes;
+            for (auto &e : p.unity_build_exclude)
+            {
+                try
+                {
+                    excludes.emplace_back(e);
+                }
+                catch (std::regex_error &ex)
+                {
+                    LOG_WARN(logger, d.target_name + ": bad unity_build_exclude regex '" + e + "': " + ex.what());
+                }
+            }
+            counter_add(Counter::RegexCompiled, excludes.size());
+
+            const auto root = d.getDirSrc();
+            auto files = p.files;
+            if (files.empty())
+            {
+                for (auto &f : fs::recursive_directory_iterator(root))
+                {
+                    if (fs::is_regular_file(f))
+                        files.insert(f);
+                }
+            }
+
+            std::set<String> excluded;
+            for (auto &f : files)
+            {
+                auto r = normalize_path(f.lexically_relative(root));
+                if (std::any_of(excludes.begin(), excludes.end(), [&r](const auto &e) { return std::regex_match(r, e); }))
+                    excluded.insert(r);
+            }
+            if (!excluded.empty())
+            {
+                ctx.addLine("EXCLUDE");
+                for (auto &e : excluded)
+                    ctx.addLine("\"", e, "\"");
+            }
+        }
+        ctx.decreaseIndent(")");
+        ctx.endif();
+        ctx.addLine();
+    }
+
     for (auto &ol : p.options)
         for (auto &ll : ol.second.link_directories)
             ctx.addLine("link_directories(" + ll + ")");
@@ -1955,23 +1846,8 @@ void CMakePrinter::print_src_config_file(const path &fn) const
 
     // warning level, before target
     config_section_title(ctx, "warning levels");
-    ctx.addLine(R"(
-if (DEFINED CPPAN_BUILD_WARNING_LEVEL AND
-    CPPAN_BUILD_WARNING_LEVEL GREATER -1 AND CPPAN_BUILD_WARNING_LEVEL LESS 5)
-    if (MSVC)
-        # clear old flag (/W3) by default
-        #string(REPLACE "/W3" "" CMAKE_C_FLAGS \"${CMAKE_C_FLAGS}\")
-        #string(REPLACE "/W3" "" CMAKE_CXX_FLAGS \"${CMAKE_CXX_FLAGS}\")
-
-        set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} /W${CPPAN_BUILD_WARNING_LEVEL}")
-        set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} /W${CPPAN_BUILD_WARNING_LEVEL}")
-    endif()
-    if (CLANG OR GCC)
-        set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -w")
-        set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -w")
-    endif()
-endif()
-)");
+    ctx.addLine("cppan_set_warning_level()");
+    ctx.addLine();
 
     // target sources
     {
@@ -2422,22 +2298,8 @@ endif()
         config_section_title(ctx, "private definitions");
 
         // some compiler options
-        ctx.addLine(R"(if (MSVC)
-    target_compile_definitions(${this}
-        PRIVATE _CRT_SECURE_NO_WARNINGS # disable warning about non-standard functions
-    )
-    target_compile_options(${this}
-        PRIVATE /wd4005 # macro redefinition
-        PRIVATE /wd4996 # The POSIX name for this item is deprecated.
-    )
-endif()
-
-if (CLANG)
-    target_compile_options(${this}
-        PRIVATE -Wno-macro-redefined
-    )
-endif()
-)");
+        ctx.addLine("cppan_add_private_definitions(${this})");
+        ctx.addLine();
     }
 
     // public definitions
@@ -2500,25 +2362,7 @@ endif()
         // common link libraries
         if (!d.flags[pfHeaderOnly])
         {
-            ctx.increaseIndent(R"(if (WIN32)
-    target_link_libraries(${this}
-        PUBLIC Ws2_32
-    )
-else())");
-            auto add_unix_lib = [&ctx](const String &s)
-            {
-                ctx.addLine("find_library(" + s + " " + s + ")");
-                ctx.if_("NOT ${" + s + "} STREQUAL \"" + s + "-NOTFOUND\"");
-                ctx.addLine("target_link_libraries(${this}");
-                ctx.addLine("    PUBLIC " + s + "");
-                ctx.addLine(")");
-                ctx.endif();
-            };
-            add_unix_lib("m");
-            add_unix_lib("pthread");
-            add_unix_lib("rt");
-            add_unix_lib("dl");
-            ctx.endif();
+            ctx.addLine("cppan_link_system_libraries(${this})");
             ctx.addLine();
         }
     }
@@ -2548,6 +2392,9 @@ else())");
         //                                                                 make cmake happy
         //                                                                       v v
         ctx.addLine("COMMAND echo " + q + "set(TARGET_FILE $<TARGET_FILE:${this}> ) " + q + " > " + normalize_path(d.getDirObj()) + "/build/${config_dir}/cppan_target_info_$<CONFIG>.cmake");
+        // import library goes to the artifact store too
+        if (!d.flags[pfExecutable])
+            ctx.addLine("COMMAND echo " + q + "set(TARGET_LINKER_FILE $<TARGET_LINKER_FILE:${this}> ) " + q + " >> " + normalize_path(d.getDirObj()) + "/build/${config_dir}/cppan_target_info_$<CONFIG>.cmake");
         ctx.decreaseIndent(")");
         //ctx.endif();
     }
@@ -2698,7 +2545,7 @@ void CMakePrinter::print_obj_config_file(const path &fn) const
         ctx.addLine("include_guard(GLOBAL)");
         ctx.addLine();
         ctx.addLine(s);
-        write_file_if_different(d.getDirObj() / cmake_obj_include_script_filename, ctx.getText());
+        access_table->write_if_different(d.getDirObj() / cmake_obj_include_script_filename, ctx.getText());
     }
 
     CMakeContext ctx;
@@ -2770,29 +2617,8 @@ endif()
     print_bs_insertion(ctx, p, "post project", &BuildSystemConfigInsertions::post_project);
 
     config_section_title(ctx, "compiler & linker settings");
-    ctx.addLine(R"(
-if (MSVC)
-    if (NOT CLANG)
-        set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} /MP")
-        set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} /MP")
-    endif()
-
-    # not working for some reason
-    #set(CMAKE_RC_FLAGS "${CMAKE_RC_FLAGS} /nologo")
-
-    if (CPPAN_MT_BUILD)
-        set(CMAKE_C_FLAGS_RELEASE "${CMAKE_C_FLAGS_RELEASE} /MT")
-        set(CMAKE_C_FLAGS_RELWITHDEBINFO "${CMAKE_C_FLAGS_RELWITHDEBINFO} /MT")
-        set(CMAKE_C_FLAGS_MINSIZEREL "${CMAKE_C_FLAGS_MINSIZEREL} /MT")
-        set(CMAKE_C_FLAGS_DEBUG "${CMAKE_C_FLAGS_DEBUG} /MTd")
-
-        set(CMAKE_CXX_FLAGS_RELEASE "${CMAKE_CXX_FLAGS_RELEASE} /MT")
-        set(CMAKE_CXX_FLAGS_RELWITHDEBINFO "${CMAKE_CXX_FLAGS_RELWITHDEBINFO} /MT")
-        set(CMAKE_CXX_FLAGS_MINSIZEREL "${CMAKE_CXX_FLAGS_MINSIZEREL} /MT")
-        set(CMAKE_CXX_FLAGS_DEBUG "${CMAKE_CXX_FLAGS_DEBUG} /MTd")
-    endif()
-endif()
-)");
+    ctx.addLine("cppan_set_compiler_settings()");
+    ctx.addLine();
 
     config_section_title(ctx, "cppan setup");
     ctx.addLine("add_subdirectory(" + normalize_path(settings.cppan_dir) + ")");
@@ -2970,6 +2796,8 @@ void CMakePrinter::print_obj_build_file(const path &fn) const
 
     ctx.addLine("set(PACKAGE_NAME " + d.ppath.toString() + ")");
     ctx.addLine("set(PACKAGE_STRING " + d.target_name + ")");
+    ctx.addLine("set(PACKAGE_HASH " + d.getHash() + ")");
+    ctx.addLine("set(STORAGE_DIR \"" + normalize_path(directories.storage_dir) + "\")");
 
     config_section_title(ctx, "macros & functions");
     ctx.addLine("include(" + normalize_path(directories.get_static_files_dir() / cmake_functions_filename) + ")");
@@ -2985,6 +2813,41 @@ void CMakePrinter::print_obj_build_file(const path &fn) const
     write_if_older(fn, ctx.getText());
 }
 
+void CMakePrinter::print_aggregate_file(const path &fn) const
+{
+    auto build_deps = rd.get_transitive_dependencies(d, DependencyClosure::Build);
+
+    CMakeContext ctx;
+    file_header(ctx, d);
+
+    config_section_title(ctx, "macros & functions");
+    ctx.addLine("include(" + normalize_path(directories.get_static_files_dir() / cmake_functions_filename) + ")");
+
+    config_section_title(ctx, "packages");
+    ctx.increaseIndent("set(packages");
+    auto deps = gather_aggregate_deps(build_deps);
+    for (auto &p : deps)
+        ctx.addLine(p.variable_name);
+    ctx.decreaseIndent(")");
+    ctx.addLine();
+    ctx.addLine("set(STORAGE_DIR \"" + normalize_path(directories.storage_dir) + "\")");
+    ctx.addLine();
+    for (auto &p : deps)
+    {
+        ctx.addLine("set(" + p.variable_name + "_target " + p.target_name + ")");
+        ctx.addLine("set(" + p.variable_name + "_hash " + p.getHash() + ")");
+        ctx.addLine("set(" + p.variable_name + "_obj \"" + normalize_path(p.getDirObj()) + "\")");
+        ctx.addLine("set(" + p.variable_name + "_stamp \"" + normalize_path(p.getStampFilename()) + "\")");
+        ctx.addLine();
+    }
+
+    ctx.addLine("include(" + normalize_path(directories.get_static_files_dir() / cmake_obj_aggregate_filename) + ")");
+
+    file_footer(ctx, d);
+
+    write_if_older(fn, ctx.getText());
+}
+
 void CMakePrinter::print_meta_config_file(const path &fn) const
 {
     if (!must_update_contents(fn))
@@ -3056,6 +2919,21 @@ void CMakePrinter::print_meta_config_file(const path &fn) const
     ctx.if_("NOT DEFINED CPPAN_RC_ENABLED");
     ctx.addLine("set_cache_var(CPPAN_RC_ENABLED "s + (settings.rc_enabled ? "1" : "0") + ")");
     ctx.endif();
+    ctx.if_("NOT DEFINED CPPAN_ARTIFACT_STORE");
+    ctx.addLine("set_cache_var(CPPAN_ARTIFACT_STORE \"" + settings.artifact_store + "\")");
+    ctx.endif();
+    ctx.if_("NOT DEFINED CPPAN_UNITY_BUILD");
+    ctx.addLine("set_cache_var(CPPAN_UNITY_BUILD "s + (settings.unity_build ? "1" : "0") + ")");
+    ctx.endif();
+    ctx.if_("NOT DEFINED CPPAN_UNITY_BUILD_BATCH_SIZE");
+    ctx.addLine("set_cache_var(CPPAN_UNITY_BUILD_BATCH_SIZE " + std::to_string(settings.unity_build_batch_size) + ")");
+    ctx.endif();
+    ctx.if_("NOT DEFINED CPPAN_AUTO_PCH");
+    ctx.addLine("set_cache_var(CPPAN_AUTO_PCH "s + (settings.auto_pch ? "1" : "0") + ")");
+    ctx.endif();
+    ctx.if_("NOT DEFINED CPPAN_OBJECT_CACHE");
+    ctx.addLine("set_cache_var(CPPAN_OBJECT_CACHE \"" + (settings.object_cache ? normalize_path(get_object_cache_dir()) : "") + "\")");
+    ctx.endif();
     ctx.addLine(R"(
 if (VISUAL_STUDIO AND CLANG AND NINJA_FOUND AND NOT NINJA)
     set_cache_var(VISUAL_STUDIO_ACCELERATE_CLANG 1)
@@ -3120,12 +2998,11 @@ add_dependencies()" + old_cppan_target + R"( run-cppan)
 
         // groups for local projects
         config_section_title(ctx, "local project groups");
-        Packages out;
-        gather_build_deps({ { "", d } }, out, true);
         ctx.if_("CPPAN_HIDE_LOCAL_DEPENDENCIES");
-        for (auto &dep : out)
+        for (auto &dep : rd.get_transitive_dependencies(d, DependencyClosure::Build))
         {
-            if (dep.second.flags[pfLocalProject])
+            // direct executables stay visible
+            if (dep.second.flags[pfLocalProject] && !dep.second.flags[pfExecutable])
                 print_solution_folder(ctx, dep.second.target_name_hash, local_dependencies_folder);
         }
         ctx.endif();
@@ -3145,8 +3022,7 @@ add_dependencies()" + old_cppan_target + R"( run-cppan)
 
         // install deps
         config_section_title(ctx, "install");
-        Packages copy_deps;
-        gather_copy_deps(rd[d].dependencies, copy_deps);
+        auto copy_deps = rd.get_transitive_dependencies(d, DependencyClosure::Copy);
         for (auto &dp : copy_deps)
         {
             auto &p = dp.second;
@@ -3331,7 +3207,7 @@ endif()
             ctx.addLine("string(RANDOM LENGTH 8 vars_dir)");
             ctx.addLine("set(tmp_dir \"${tmp_dir}/${vars_dir}\")");
             ctx.addLine();
-            ctx.addLine("set(checks_file \"" + normalize_path(cwd / settings.cppan_dir / cppan_checks_yml) + "\")");
+            ctx.addLine("set(checks_file \"" + normalize_path(cwd / settings.cppan_dir / cppan_checks_file) + "\")");
             ctx.addLine();
             ctx.addLine("execute_process(COMMAND ${CMAKE_COMMAND} -E copy_directory ${PROJECT_BINARY_DIR}/CMakeFiles ${tmp_dir}/CMakeFiles/ RESULT_VARIABLE ret)");
             auto cmd = R"(COMMAND ${CPPAN_COMMAND}
@@ -3344,6 +3220,10 @@ endif()
                                 \"${CMAKE_SYSTEM_VERSION}\"
                                 \"${CMAKE_GENERATOR_TOOLSET}\"
                                 \"${CMAKE_TOOLCHAIN_FILE}\"
+                                \"${CMAKE_C_COMPILER}\"
+                                \"${CMAKE_CXX_COMPILER}\"
+                                \"${CMAKE_C_FLAGS}\"
+                                \"${CMAKE_CXX_FLAGS}\"
                             )"s;
             ctx.if_("CPPAN_COMMAND");
             cmake_debug_message(cmd);
@@ -3423,16 +3303,22 @@ void CMakePrinter::parallel_vars_check(const ParallelCheckOptions &o) const
     if (us.var_check_jobs > 0)
         N = std::min<int>(N, us.var_check_jobs);
 
-    if (N <= 1)
+    NativeChecker native_checker(o);
+    const bool native = us.native_checks && native_checker.supported();
+    const auto toolchain = o.getFingerprint();
+
+    if (N <= 1 && !native && toolchain.empty())
     {
         LOG_DEBUG(logger, "-- Sequential checks mode selected");
         return;
     }
 
     Checks checks;
-    checks.load(o.checks_file);
+    checks.load_binary(o.checks_file);
 
     // read known vars
+    // their values are needed by dependent checks
+    CheckValues values;
     if (fs::exists(o.vars_file))
     {
         std::set<String> known_vars;
@@ -3445,42 +3331,86 @@ void CMakePrinter::parallel_vars_check(const ParallelCheckOptions &o) const
         {
             std::vector<String> v;
             boost::split(v, l, boost::is_any_of(";"));
-            if (v.size() == 3)
-                known_vars.insert(v[1]);
+            if (v.size() != 3)
+                continue;
+            known_vars.insert(v[1]);
+            try
+            {
+                values[v[1]] = std::stoi(v[2]);
+            }
+            catch (std::exception &)
+            {
+            }
         }
         checks.remove_known_vars(known_vars);
     }
 
-    auto workers = checks.scatter(N);
-    size_t n_checks = 0;
-    for (auto &w : workers)
-        n_checks += w.checks.size();
+    // results of the same checks done with the same toolchain in other projects
+    Checks stored_checks;
+    if (!toolchain.empty())
+    {
+        try
+        {
+            stored_checks = checks.remove_known_results(getServiceDatabase().getCheckResults(toolchain));
+        }
+        catch (std::exception &e)
+        {
+            LOG_DEBUG(logger, "-- Cannot read check results: " << e.what());
+        }
+    }
+
+    // same checks under different names are evaluated once
+    auto aliases = checks.remove_aliases();
+    if (!aliases.empty())
+        LOG_DEBUG(logger, "-- Merged " << aliases.size() << " checks with equal ones");
 
-    // There are few checks only. Won't go in parallel mode.
-    if (n_checks <= 8)
+    // recorded times of checks, long ones are started first
+    CheckTimes times;
+    try
     {
-        LOG_DEBUG(logger, "-- There are few checks (" << n_checks << ") only. Won't go in parallel mode.");
-        return;
+        times = getServiceDatabase().getCheckTimes(toolchain);
+    }
+    catch (std::exception &e)
+    {
+        LOG_DEBUG(logger, "-- Cannot read check times: " << e.what());
     }
 
+    // decls include headers found by other checks, so they go in the second stage
+    Checks decls;
+    for (auto &c : checks.checks)
+    {
+        if (c->getInformation().type == Check::Decl)
+            decls.checks.insert(c);
+    }
+    for (auto &c : decls.checks)
+        checks.checks.erase(c);
+
     // disable boost logger as it seems broken here for some reason
 #undef LOG_INFO
 #define LOG_INFO(l, m) \
     std::cout << m << std::endl
 
-    LOG_INFO(logger, "-- Performing " << n_checks << " checks using " << N << " thread(s)");
-#ifndef _WIN32
-    LOG_INFO(logger, "-- This process may take up to 5 minutes depending on your hardware");
-#else
-    LOG_INFO(logger, "-- This process may take up to 10-20 minutes depending on your hardware");
-#endif
-    //LOG_FLUSH();
+    struct Batch
+    {
+        Checks checks;
+        int64_t start; // ms
+        int64_t end;
+    };
+    std::vector<std::vector<Batch>> timeline(N);
+    const auto start = std::chrono::steady_clock::now();
+    auto since_start = [&start]
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    };
 
-    auto work = [&o](auto &w, int i)
+    // worker dir is reused for next batches unless cmake failed there
+    auto work = [&o](auto &w, int i, bool fresh, const CheckValues &values)
     {
         if (w.checks.empty())
             return;
 
+        TRACE_SCOPE("parallel_vars_check worker " + std::to_string(i));
+
         auto d = o.dir / std::to_string(i);
         fs::create_directories(d);
 
@@ -3489,13 +3419,19 @@ void CMakePrinter::parallel_vars_check(const ParallelCheckOptions &o) const
         ctx.addLine("project(" + std::to_string(i) + " LANGUAGES C CXX)");
         ctx.addLine(cmake_includes);
         ctx.addLine("include(" + normalize_path(directories.get_static_files_dir() / cmake_functions_filename) + ")");
-        w.write_parallel_checks_for_workers(ctx);
+        w.write_parallel_checks_for_workers(ctx, cppan_variable_result_filename, values);
         write_file(d / cmake_config_filename, ctx.getText());
+        fs::remove(d / cppan_variable_result_filename);
 
-        // copy cached cmake dir
-        copy_dir(o.dir / "CMakeFiles", d / "CMakeFiles");
-        // since cmake 3.8
-        write_file(d / "CMakeCache.txt", "CMAKE_PLATFORM_INFO_INITIALIZED:INTERNAL=1\n");
+        if (fresh)
+        {
+            // copy cached cmake dir
+            error_code ec;
+            fs::remove_all(d / "CMakeFiles", ec);
+            copy_dir(o.dir / "CMakeFiles", d / "CMakeFiles");
+            // since cmake 3.8
+            write_file(d / "CMakeCache.txt", "CMAKE_PLATFORM_INFO_INITIALIZED:INTERNAL=1\n");
+        }
 
         // run cmake
         primitives::Command c;
@@ -3562,7 +3498,11 @@ void CMakePrinter::parallel_vars_check(const ParallelCheckOptions &o) const
             //ret = command::execute_and_capture(args, o);
         //ret = command::execute(args);
         std::error_code ec;
-        c.execute(ec);
+        {
+            JobToken t;
+            counter_add(Counter::ProcessesSpawned);
+            c.execute(ec);
+        }
 
         // do not fail (throw), try to read already found variables
         // commited as it occurs always check cmake error or cmake normal exit has this value
@@ -3583,28 +3523,163 @@ void CMakePrinter::parallel_vars_check(const ParallelCheckOptions &o) const
             //throw_with_trace(std::runtime_error(s));
         }
 
-        w.read_parallel_checks_for_workers(d);
+        w.read_parallel_checks_for_workers(d / cppan_variable_result_filename);
     };
 
-    Executor e(N);
-    std::vector<Future<void>> fs;
+    // evaluates checks natively, then the rest using cmake workers
+    Checks native_checks;
+    size_t n_checks = 0;
+    auto run_stage = [&](Checks &checks, const CheckValues &values)
+    {
+        // simple checks are done by the compiler directly, it takes milliseconds per check
+        if (native)
+        {
+            Checks r;
+            auto t = get_time<std::chrono::milliseconds>([&]
+            {
+                r = native_checker.check(checks, std::max(N, 1), times, values);
+            });
+            if (!r.checks.empty())
+            {
+                LOG_INFO(logger, "-- Performed " << r.checks.size() << " checks natively in " << t << " ms");
+            }
+            native_checks += r;
+        }
 
-    int i = 0;
-    for (auto &w : workers)
-        fs.push_back(e.push([&work, &w, n = i++]() { work(w, n); }));
+        ChecksQueue queue(checks, times, N);
+        size_t n = N > 1 ? queue.size() : 0;
 
-    auto t = get_time<std::chrono::seconds>([&fs]
-    {
+        // There are few checks only. Won't go in parallel mode.
+        if (n <= 8)
+        {
+            LOG_DEBUG(logger, "-- There are few checks (" << n << ") only. Won't go in parallel mode.");
+            return;
+        }
+        n_checks += n;
+
+        LOG_INFO(logger, "-- Performing " << n << " checks using " << N << " thread(s)");
+#ifndef _WIN32
+        LOG_INFO(logger, "-- This process may take up to 5 minutes depending on your hardware");
+#else
+        LOG_INFO(logger, "-- This process may take up to 10-20 minutes depending on your hardware");
+#endif
+        //LOG_FLUSH();
+
+        // workers pull batches from the shared queue until it is drained
+        auto worker = [&work, &queue, &timeline, &since_start, &values](int i)
+        {
+            bool fresh = timeline[i].empty() || !timeline[i].back().checks.valid;
+            while (1)
+            {
+                Batch b;
+                b.checks = queue.pop();
+                if (b.checks.checks.empty())
+                    break;
+                b.start = since_start();
+                work(b.checks, i, fresh, values);
+                b.end = since_start();
+                fresh = !b.checks.valid;
+                // there is no per check time in one cmake run, split it evenly
+                for (auto &c : b.checks.checks)
+                    c->time = int((b.end - b.start) / b.checks.checks.size());
+                timeline[i].push_back(std::move(b));
+            }
+        };
+
+        Executor e(N);
+        std::vector<Future<void>> fs;
+        for (int i = 0; i < N; i++)
+            fs.push_back(e.push([&worker, i]() { worker(i); }));
         for (auto &f : fs)
             f.wait();
         for (auto &f : fs)
             f.get();
+    };
+
+    auto get_evaluated = [&native_checks, &timeline]
+    {
+        Checks checks;
+        checks += native_checks;
+        for (auto &w : timeline)
+        {
+            for (auto &b : w)
+            {
+                if (b.checks.valid)
+                    checks += b.checks;
+            }
+        }
+        return checks;
+    };
+
+    auto t = get_time<std::chrono::seconds>([&]
+    {
+        run_stage(checks, values);
+        if (decls.checks.empty())
+            return;
+
+        // dependencies of decls
+        for (auto &c : stored_checks.checks)
+            values[c->getVariable()] = c->getValue();
+        for (auto &c : get_evaluated().checks)
+        {
+            // if we have duplicate values, choose the ok one
+            auto &v = values[c->getVariable()];
+            if (!v)
+                v = c->getValue();
+        }
+        add_alias_values(aliases, values);
+
+        // decls with not evaluated dependencies are left for sequential mode
+        std::set<String> unresolved;
+        for (auto &c : checks.checks)
+        {
+            if (!c->isEvaluated() && values.find(c->getVariable()) == values.end())
+                unresolved.insert(c->getVariable());
+        }
+        for (auto &[a, c] : aliases)
+        {
+            if (unresolved.count(c->getVariable()))
+                unresolved.insert(a->getVariable());
+        }
+        Checks ready;
+        for (auto &c : decls.checks)
+        {
+            auto deps = ((const CheckDecl *)c.get())->getDependencies();
+            if (std::none_of(deps.begin(), deps.end(), [&unresolved](const auto &d) { return unresolved.count(d); }))
+                ready.checks.insert(c);
+        }
+        run_stage(ready, values);
     });
 
-    checks.checks.clear();
-    for (auto &w : workers)
-        if (w.valid)
-            checks += w;
+    checks = get_evaluated();
+    if (checks.checks.empty() && stored_checks.checks.empty())
+        return;
+
+    try
+    {
+        getServiceDatabase().addCheckTimes(toolchain, checks);
+    }
+    catch (std::exception &e)
+    {
+        LOG_DEBUG(logger, "-- Cannot write check times: " << e.what());
+    }
+
+    if (!toolchain.empty())
+    {
+        try
+        {
+            getServiceDatabase().addCheckResults(toolchain, checks.get_results());
+        }
+        catch (std::exception &e)
+        {
+            LOG_DEBUG(logger, "-- Cannot write check results: " << e.what());
+        }
+    }
+
+    if (!stored_checks.checks.empty())
+        LOG_INFO(logger, "-- Reused " << stored_checks.checks.size() << " check results from previous runs");
+    checks += stored_checks;
+    checks.add_aliases(aliases);
 
     checks.print_values();
     //LOG_FLUSH();
@@ -3613,6 +3688,29 @@ void CMakePrinter::parallel_vars_check(const ParallelCheckOptions &o) const
     checks.print_values(ctx);
     write_file(o.dir / parallel_checks_file, ctx.getText());
 
+    if (!n_checks)
+        return;
+
+    auto sec = [](int64_t ms)
+    {
+        return std::to_string(ms / 1000) + "." + std::to_string(ms % 1000 / 100);
+    };
+
+    LOG_INFO(logger, "-- Workers timeline (seconds):");
+    for (size_t i = 0; i < timeline.size(); i++)
+    {
+        int64_t busy = 0;
+        size_t n = 0;
+        String s;
+        for (auto &b : timeline[i])
+        {
+            busy += b.end - b.start;
+            n += b.checks.checks.size();
+            s += " [" + sec(b.start) + "-" + sec(b.end) + ": " +
+                std::to_string(b.checks.checks.size()) + (b.checks.valid ? "" : ", failed") + "]";
+        }
+        LOG_INFO(logger, "--   #" << i << ": " << n << " checks, busy " << sec(busy) << " s:" << s);
+    }
     LOG_INFO(logger, "-- This operation took " + std::to_string(t) + " seconds to complete");
 }
 
@@ -3630,71 +3728,56 @@ bool CMakePrinter::must_update_contents(const path &fn) const
 void CMakePrinter::write_if_older(const path &fn, const String &s) const
 {
     if (d.ppath.is_loc())
-        return write_file_if_different(fn, s);
+        return access_table->write_if_different(fn, s);
     access_table->write_if_older(fn, s);
 }
 
 void CMakePrinter::print_source_groups(CMakeContext &ctx) const
 {
-    // disabled as very very slow!
-    return;
+    const auto &p = rd[d].config->getDefaultProject();
+    const auto root = d.flags[pfLocalProject] ? p.root_directory : d.getDirSrc();
 
-    // check own data
-    if (sgs.empty())
+    if (!sgs)
     {
-        // check db data
-        auto &sdb = getServiceDatabaseReadOnly();
-        sgs = sdb.getSourceGroups(d);
-        if (sgs.empty())
+        // local files are already in memory
+        if (d.flags[pfLocalProject])
+            sgs = make_source_groups(root, p.files);
+        else
         {
-            if (d.flags[pfLocalProject])
+            // sources of a package version do not change
+            sgs = getServiceDatabaseReadOnly().getSourceGroups(d);
+            if (!sgs)
             {
-                const auto &p = rd[d].config->getDefaultProject();
-                for (auto &f : p.files)
+                auto files = p.files;
+                if (files.empty())
                 {
-                    auto r = fs::relative(f, p.root_directory);
-                    auto s2 = boost::replace_all_copy(r.parent_path().string(), "\\", "\\\\");
-                    boost::replace_all(s2, "/", "\\\\");
-                    sgs[s2].insert(normalize_path(f));
-                }
-            }
-            else
-            {
-                const auto dir = d.getDirSrc();
-                for (auto &f : fs::recursive_directory_iterator(dir))
-                {
-                    if (!fs::is_directory(f))
-                        continue;
-
-                    auto s = fs::relative(f.path(), dir).string();
-                    auto s2 = boost::replace_all_copy(s, "\\", "\\\\");
-                    boost::replace_all(s2, "/", "\\\\");
-
-                    for (auto &f2 : fs::directory_iterator(f))
+                    for (auto &f : fs::recursive_directory_iterator(root))
                     {
-                        if (!fs::is_regular_file(f2))
-                            continue;
-                        auto s3 = normalize_path(f2.path());
-                        sgs[s2].insert(s3);
+                        if (fs::is_regular_file(f))
+                            files.insert(f);
                     }
                 }
+                sgs = make_source_groups(root, files);
+                getServiceDatabase().setSourceGroups(d, sgs.value());
             }
-            // add empty sgs to prevent directory lookup on the next run
-            if (sgs.empty())
-                sgs["__cppan_empty"];
-            getServiceDatabase().setSourceGroups(d, sgs);
         }
     }
 
     // print, there's always generated group
     config_section_title(ctx, "source groups");
     ctx.addLine("source_group(\"generated\" REGULAR_EXPRESSION \"" + normalize_path(d.getDirObj()) + "/*\")");
-    for (auto &sg : sgs)
+    // one line per directory
+    const auto r = normalize_path(root);
+    for (auto &sg : sgs.value())
     {
-        ctx.increaseIndent("source_group(\"" + sg.first + "\" FILES");
+        if (sg.second.empty())
+            continue;
+        auto name = boost::replace_all_copy(sg.first, "/", "\\\\");
+        auto dir = sg.first.empty() ? r : r + "/" + sg.first;
+        ctx.addLine("cppan_source_group(\"", name, "\" \"", dir, "\"");
         for (auto &f : sg.second)
-            ctx.addLine("\"" + f + "\"");
-        ctx.decreaseIndent(")");
+            ctx.addText(" \"", f, "\"");
+        ctx.addText(")");
     }
     ctx.emptyLines();
 }
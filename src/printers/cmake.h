@@ -45,7 +45,7 @@ struct CMakePrinter : Printer
     void parallel_vars_check(const ParallelCheckOptions &options) const override;
 
 private:
-    mutable SourceGroups sgs;
+    mutable optional<SourceGroups> sgs;
 
     void print_configs() const;
     void print_helper_file(const path &fn) const;
@@ -57,6 +57,7 @@ private:
     void print_obj_generate_file(const path &fn) const;
     void print_obj_export_file(const path &fn) const;
     void print_obj_build_file(const path &fn) const;
+    void print_aggregate_file(const path &fn) const;
     void print_bs_insertion(CMakeContext &ctx, const Project &p, const String &name, const String BuildSystemConfigInsertions::*i) const;
     void print_source_groups(CMakeContext &ctx) const;
 
@@ -71,7 +72,7 @@ private:
 };
 
 template <class F>
-void add_aliases(Context &ctx, const Package &d, bool all, const StringSet &aliases, F &&f)
+void add_aliases(CMakeContext &ctx, const Package &d, bool all, const StringSet &aliases, F &&f)
 {
     auto add_line = [&ctx](const auto &s)
     {
@@ -111,14 +112,14 @@ void add_aliases(Context &ctx, const Package &d, bool all, const StringSet &alia
 }
 
 template <class F>
-void add_aliases(Context &ctx, const Package &d, bool all, F &&f)
+void add_aliases(CMakeContext &ctx, const Package &d, bool all, F &&f)
 {
     const auto &aliases = rd[d].config->getDefaultProject().aliases;
     add_aliases(ctx, d, all, aliases, std::forward<F>(f));
 }
 
 template <class F>
-void add_aliases(Context &ctx, const Package &d, F &&f)
+void add_aliases(CMakeContext &ctx, const Package &d, F &&f)
 {
     add_aliases(ctx, d, true, std::forward<F>(f));
 }
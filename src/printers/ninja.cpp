@@ -0,0 +1,969 @@
+/*
+ * Copyright (C) 2016-2017, Egor Pugin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ninja.h"
+
+#include <checks_detail.h>
+#include <checks_native.h>
+#include <counters.h>
+#include <database.h>
+#include <hash.h>
+#include <jobserver.h>
+#include <program.h>
+#include <settings.h>
+#include <trace.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <primitives/command.h>
+
+#include <algorithm>
+#include <regex>
+#include <thread>
+
+#include <primitives/log.h>
+//DECLARE_STATIC_LOGGER(logger, "ninja");
+
+// does not clash with build.ninja of cmake ninja generator
+static const String ninja_config_filename = "cppan.ninja";
+
+// cmake defaults for gcc compatible compilers, same order as configuration_types
+static const Strings configuration_flags = { "-g", "-Os -DNDEBUG", "-O3 -DNDEBUG", "-O2 -g -DNDEBUG" };
+
+namespace
+{
+
+struct Toolchain
+{
+    path cc;
+    path cxx;
+    path ar;
+    path ranlib;
+    String id;
+    String system;
+
+    bool windows() const { return system == "Windows"; }
+};
+
+String read_cmake_variable(const String &text, const String &var)
+{
+    std::smatch m;
+    if (std::regex_search(text, m, std::regex("set\\(" + var + " \"([^\"]*)\"\\)")))
+        return m[1].str();
+    return String();
+}
+
+Toolchain load_toolchain(const BuildSettings &bs, const Settings &s)
+{
+    // written by cmake during test run and copied to every build dir
+    auto dir = bs.binary_directory / "CMakeFiles" / get_cmake_version();
+    if (!fs::exists(dir / "CMakeCXXCompiler.cmake"))
+        throw std::runtime_error("Compiler information is missing in " + normalize_path(dir));
+
+    auto c = read_file(dir / "CMakeCCompiler.cmake");
+    auto cxx = read_file(dir / "CMakeCXXCompiler.cmake");
+    auto sys = fs::exists(dir / "CMakeSystem.cmake") ? read_file(dir / "CMakeSystem.cmake") : String();
+
+    Toolchain t;
+    t.cc = s.c_compiler.empty() ? read_cmake_variable(c, "CMAKE_C_COMPILER") : s.c_compiler;
+    t.cxx = s.cxx_compiler.empty() ? read_cmake_variable(cxx, "CMAKE_CXX_COMPILER") : s.cxx_compiler;
+    t.ar = read_cmake_variable(cxx, "CMAKE_AR");
+    t.ranlib = read_cmake_variable(cxx, "CMAKE_RANLIB");
+    t.id = read_cmake_variable(cxx, "CMAKE_CXX_COMPILER_ID");
+    t.system = read_cmake_variable(sys, "CMAKE_SYSTEM_NAME");
+
+    if (t.id == "MSVC" || read_cmake_variable(cxx, "CMAKE_CXX_SIMULATE_ID") == "MSVC")
+        throw std::runtime_error("Ninja printer supports gcc compatible compilers only, use cmake printer with " + t.id);
+    if (t.cc.empty() || t.cxx.empty())
+        throw std::runtime_error("Cannot find compilers in " + normalize_path(dir));
+    if (t.ar.empty())
+        t.ar = "ar";
+    return t;
+}
+
+// cmake variables used as keys of system_* options
+bool system_matches(String key, const Toolchain &t)
+{
+    boost::to_upper(key);
+    if (key == "WIN32" || key == "WINDOWS")
+        return t.windows();
+    if (key == "UNIX")
+        return !t.windows();
+    if (key == "APPLE")
+        return t.system == "Darwin";
+    if (key == "LINUX")
+        return t.system == "Linux";
+    if (key == "MINGW")
+        return t.windows() && t.id == "GNU";
+    if (key == "CLANG")
+        return t.id.find("Clang") != t.id.npos;
+    if (key == "GNU" || key == "GCC")
+        return t.id == "GNU";
+    if (key != "MSVC")
+        LOG_WARN(logger, "Unknown system condition in options: " + key);
+    return false;
+}
+
+String quote_arg(const String &a, bool windows)
+{
+    if (!a.empty() && a.find_first_of(" \t\"'\\$&|;<>()*?[]#~`!{}") == a.npos)
+        return a;
+    if (windows)
+        return "\"" + boost::replace_all_copy(a, "\"", "\\\"") + "\"";
+    return "'" + boost::replace_all_copy(a, "'", "'\\''") + "'";
+}
+
+String escape_path(const path &p)
+{
+    auto s = normalize_path(p);
+    boost::replace_all(s, "$", "$$");
+    boost::replace_all(s, " ", "$ ");
+    boost::replace_all(s, ":", "$:");
+    return s;
+}
+
+String escape_value(const String &s)
+{
+    return boost::replace_all_copy(s, "$", "$$");
+}
+
+// compile usage requirements
+struct Usage
+{
+    Strings include_directories;
+    Strings definitions;
+    Strings compile_options;
+
+    void append(const Usage &u)
+    {
+        auto add = [](auto &dst, const auto &src) { dst.insert(dst.end(), src.begin(), src.end()); };
+        add(include_directories, u.include_directories);
+        add(definitions, u.definitions);
+        add(compile_options, u.compile_options);
+    }
+};
+
+struct Target
+{
+    Package d;
+    const Project *p = nullptr;
+    path sdir;
+
+    // own build
+    Usage private_;
+    // own part of what dependents get
+    Usage interface_;
+    // link options and libraries of any visibility
+    // static libraries pass them to the final link
+    Strings link;
+
+    Files sources;
+    path output;
+
+    bool has_output() const { return !d.flags[pfHeaderOnly]; }
+};
+
+class NinjaGraph
+{
+public:
+    NinjaGraph(const BuildSettings &bs, const Toolchain &t)
+        : bs(bs), t(t), s(Settings::get_local_settings())
+    {
+    }
+
+    void add(const Package &root)
+    {
+        for (auto &[k, d] : rd[root].dependencies)
+        {
+            if (targets.find(d.target_name) != targets.end())
+                continue;
+            add_target(d);
+            add(d);
+        }
+    }
+
+    Checks get_checks() const
+    {
+        Checks checks;
+        for (auto &[k, tgt] : targets)
+            checks += tgt.p->checks;
+        return checks;
+    }
+
+    void add_check_definitions(const CheckValues &values)
+    {
+        for (auto &[k, tgt] : targets)
+            add_check_definitions(tgt, values);
+    }
+
+    String print() const;
+
+private:
+    const BuildSettings &bs;
+    const Toolchain &t;
+    const Settings &s;
+    std::map<String, Target> targets;
+    mutable std::map<String, Usage> interfaces;
+
+    void add_target(const Package &d);
+    void add_sources(Target &tgt) const;
+    void add_options(Target &tgt, const Options &o) const;
+    void add_check_definitions(Target &tgt, const CheckValues &values) const;
+
+    void add_value(Target &tgt, String visibility, Strings Usage::*m, const String &v) const
+    {
+        if (tgt.d.flags[pfHeaderOnly])
+            visibility = "interface";
+        else if (tgt.d.flags[pfExecutable])
+            visibility = "private";
+        boost::to_lower(visibility);
+        if (visibility != "interface")
+            (tgt.private_.*m).push_back(v);
+        if (visibility != "private")
+            (tgt.interface_.*m).push_back(v);
+    }
+
+    // deps that are built and linked
+    std::vector<const Target *> get_dependencies(const Target &tgt) const;
+    const Usage &get_interface(const Target &tgt) const;
+    Usage get_usage(const Target &tgt) const;
+    std::vector<const Target *> get_link_order(const Target &tgt) const;
+    String get_output_name(const Target &tgt) const;
+};
+
+void NinjaGraph::add_target(const Package &d)
+{
+    auto &tgt = targets[d.target_name];
+    tgt.d = d;
+    tgt.p = &rd[d].config->getDefaultProject();
+    auto &p = *tgt.p;
+
+    if (d.flags[pfLocalProject])
+        tgt.sdir = p.root_directory;
+    else
+        tgt.sdir = d.getDirSrc();
+
+    // conditions, cmake scripts and insertions make the whole build go to cmake printer
+    if (p.shared_only)
+        LOG_WARN(logger, d.target_name + " is shared only, but ninja printer builds static libraries only");
+
+    // include directories
+    auto add_idir = [this, &tgt](const String &visibility, const path &base, const path &i)
+    {
+        // paths relative to cmake variables
+        if (i.string().find("${") == 0)
+            return;
+        add_value(tgt, visibility, &Usage::include_directories, normalize_path(base / i));
+    };
+    for (auto &i : p.include_directories.public_)
+        add_idir("public", tgt.sdir, i);
+    for (auto &i : p.include_directories.private_)
+        add_idir("private", tgt.sdir, i);
+    for (auto &i : p.include_directories.interface_)
+        add_idir("interface", tgt.sdir, i);
+    add_idir("public", tgt.sdir, "");
+    for (auto &[k, dep] : rd[d].dependencies)
+    {
+        if (!dep.flags[pfIncludeDirectoriesOnly])
+            continue;
+        auto ipath = dep.flags[pfLocalProject] ? rd.get_local_package_dir(dep.ppath) : dep.getDirSrc();
+        for (auto &i : rd[dep].config->getDefaultProject().include_directories.public_)
+            add_idir("public", ipath, i);
+    }
+
+    // definitions, same as in cmake printer for static build
+    auto def = [this, &tgt](const String &visibility, const String &v)
+    {
+        add_value(tgt, visibility, &Usage::definitions, v);
+    };
+    auto api = CPPAN_EXPORT_PREFIX + d.variable_name;
+    if (!d.flags[pfHeaderOnly])
+    {
+        def("private", "PACKAGE=\"" + d.ppath.toString() + "\"");
+        def("private", "PACKAGE_NAME=\"" + d.ppath.toString() + "\"");
+        def("private", "PACKAGE_NAME_LAST=\"" + d.ppath.back() + "\"");
+        def("private", "PACKAGE_VERSION=\"" + d.version.toString() + "\"");
+        def("private", "PACKAGE_STRING=\"" + d.target_name_hash + "\"");
+        def("private", "PACKAGE_BUILD_CONFIG=\"" + s.configuration + "\"");
+        def("private", "PACKAGE_BUGREPORT=\"\"");
+        def("private", "PACKAGE_URL=\"\"");
+        def("private", "PACKAGE_COPYRIGHT_YEAR=2018");
+        def("private", "PACKAGE_ROOT_DIR=\"" + normalize_path(d.ppath.is_loc() ? p.root_directory : d.getDirSrc()) + "\"");
+        def("private", "PACKAGE_NAME_WITHOUT_OWNER=\"" + d.ppath.slice(2).toString() + "\"");
+        def("private", "PACKAGE_NAME_CLEAN=\"" + (d.ppath.is_loc() ? d.ppath.slice(2).toString() : d.ppath.toString()) + "\"");
+        if (d.flags[pfExecutable])
+            def("private", "CPPAN_EXECUTABLE");
+        def("private", api + "_EXTERN=");
+        def("private", "CPPAN_STATIC_BUILD");
+        def("private", "CPPAN_CONFIG=\"" + bs.config + "\"");
+        def("interface", api + "_EXTERN=extern");
+    }
+    def("public", api + "=");
+    def("public", "CPPAN");
+    def("public", "CPPAN_BUILD");
+
+    auto api_names = p.api_name;
+    if (p.create_default_api)
+    {
+        auto pp = p.pkg.ppath;
+        while (!pp.empty() && pp.front() != p.default_api_start)
+            pp = pp.slice(1);
+        api_names.insert(boost::to_upper_copy(!pp.empty() ? pp.toString("_") : p.pkg.ppath.back()) + "_API");
+    }
+    for (auto &a : api_names)
+    {
+        def("public", a + "=" + api);
+        def("public", a + "_EXTERN=" + api + "_EXTERN");
+    }
+    if (d.flags[pfLocalProject])
+        def("public", "CPPAN_EXPORT=");
+
+    // compile options
+    if (!d.flags[pfHeaderOnly])
+    {
+        if (s.build_warning_level >= 0 && s.build_warning_level < 5)
+            tgt.private_.compile_options.push_back("-w");
+        if (t.id.find("Clang") != t.id.npos)
+            tgt.private_.compile_options.push_back("-Wno-macro-redefined");
+    }
+
+    for (auto &[k, o] : p.options)
+    {
+        if (k == "any" || k == "static")
+            add_options(tgt, o);
+    }
+
+    // common link libraries
+    if (!d.flags[pfHeaderOnly])
+    {
+        if (t.windows())
+            tgt.link.push_back("-lws2_32");
+        else
+        {
+            tgt.link.push_back("-lm");
+            tgt.link.push_back("-lpthread");
+            if (t.system != "Darwin")
+            {
+                tgt.link.push_back("-lrt");
+                tgt.link.push_back("-ldl");
+            }
+        }
+    }
+
+    add_sources(tgt);
+
+    if (tgt.has_output())
+    {
+        if (d.flags[pfExecutable])
+            tgt.output = bs.binary_directory / "bin" / (get_output_name(tgt) + (t.windows() ? ".exe" : ""));
+        else
+            tgt.output = bs.binary_directory / "lib" / ("lib" + get_output_name(tgt) + ".a");
+    }
+}
+
+void NinjaGraph::add_options(Target &tgt, const Options &o) const
+{
+    auto add_values = [this, &tgt](const Options::ValueContainer &c, Strings Usage::*m, const std::function<String(String)> &f = {})
+    {
+        for (auto &[visibility, v] : c)
+            add_value(tgt, visibility, m, f ? f(v) : v);
+    };
+    auto add_idirs = [&tgt, &add_values](const auto &c)
+    {
+        add_values(c, &Usage::include_directories, [&tgt](const String &i)
+        {
+            return i.find("${") == 0 ? i : normalize_path(tgt.sdir / i);
+        });
+    };
+    auto add_link = [&tgt](const Options::ValueContainer &c, bool libraries)
+    {
+        for (auto &[visibility, v] : c)
+        {
+            if (!libraries || v.empty() || v[0] == '-' || v.find_first_of("/\\") != v.npos)
+                tgt.link.push_back(v);
+            else
+                tgt.link.push_back("-l" + v);
+        }
+    };
+
+    auto add_all = [&](const auto &defs, const auto &idirs, const auto &copts, const auto &lopts, const auto &libs)
+    {
+        add_values(defs, &Usage::definitions);
+        add_idirs(idirs);
+        add_values(copts, &Usage::compile_options);
+        add_link(lopts, false);
+        add_link(libs, true);
+    };
+    add_all(o.definitions, o.include_directories, o.compile_options, o.link_options, o.link_libraries);
+
+    auto system = [this](const auto &m, auto f)
+    {
+        for (auto &[k, v] : m)
+        {
+            if (system_matches(k, t))
+                f(v);
+        }
+    };
+    system(o.system_definitions, [&](const auto &v) { add_values(v, &Usage::definitions); });
+    system(o.system_include_directories, add_idirs);
+    system(o.system_compile_options, [&](const auto &v) { add_values(v, &Usage::compile_options); });
+    system(o.system_link_options, [&](const auto &v) { add_link(v, false); });
+    system(o.system_link_libraries, [&](const auto &v) { add_link(v, true); });
+
+    for (auto &l : o.link_directories)
+        tgt.link.push_back("-L" + l);
+
+    // remove unresolved cmake variables
+    for (auto u : { &tgt.private_, &tgt.interface_ })
+    {
+        for (auto m : { &Usage::include_directories, &Usage::definitions, &Usage::compile_options })
+        {
+            auto &v = u->*m;
+            v.erase(std::remove_if(v.begin(), v.end(), [](const auto &s) { return s.find("${") != s.npos; }), v.end());
+        }
+    }
+}
+
+void NinjaGraph::add_sources(Target &tgt) const
+{
+    if (!tgt.has_output())
+        return;
+
+    auto &p = *tgt.p;
+
+    Files files;
+    auto add_dir = [&files](const path &dir)
+    {
+        for (auto &f : fs::recursive_directory_iterator(dir))
+        {
+            if (fs::is_regular_file(f))
+                files.insert(f.path());
+        }
+    };
+    if (tgt.d.flags[pfLocalProject])
+        files = p.files;
+    else if (p.build_files.empty())
+        add_dir(tgt.sdir);
+    else
+    {
+        for (auto &f : p.build_files)
+        {
+            auto fn = tgt.sdir / f;
+            if (fs::is_directory(fn))
+                add_dir(fn);
+            else
+                files.insert(fn);
+        }
+    }
+
+    std::vector<std::regex> excludes;
+    for (auto &e : p.exclude_from_build)
+    {
+        try
+        {
+            excludes.emplace_back(normalize_path(e));
+        }
+        catch (std::regex_error &ex)
+        {
+            LOG_WARN(logger, tgt.d.target_name + ": bad exclude_from_build regex '" + e + "': " + ex.what());
+        }
+    }
+    auto excluded = [&p, &excludes](const String &r)
+    {
+        for (auto &e : p.exclude_from_build)
+        {
+            auto s = normalize_path(e);
+            if (r == s || r.find(s + "/") == 0)
+                return true;
+        }
+        return std::any_of(excludes.begin(), excludes.end(), [&r](const auto &e) { return std::regex_match(r, e); });
+    };
+
+    static const std::set<String> source_extensions = { ".c", ".cc", ".cpp", ".cxx", ".c++", ".C", ".s", ".S" };
+    for (auto &f : files)
+    {
+        if (source_extensions.find(f.extension().string()) == source_extensions.end())
+            continue;
+        if (excluded(normalize_path(f.lexically_relative(tgt.sdir))))
+            continue;
+        tgt.sources.insert(f);
+    }
+}
+
+void NinjaGraph::add_check_definitions(Target &tgt, const CheckValues &values) const
+{
+    auto &p = *tgt.p;
+    auto def = [this, &tgt, &p](const String &var, Check::Value value)
+    {
+        add_value(tgt, "public", &Usage::definitions, var + "=" + std::to_string(value));
+        for (auto &prefix : p.checks_prefixes)
+            add_value(tgt, "public", &Usage::definitions, prefix + var + "=" + std::to_string(value));
+    };
+
+    // WORDS_BIGENDIAN is not probed here, supported targets are little endian
+    for (auto &c : p.checks.checks)
+    {
+        auto i = values.find(c->getVariable());
+        auto v = i == values.end() ? 0 : i->second;
+        auto type = c->getInformation().type;
+
+        // decl is always defined
+        if (type == Check::Decl)
+        {
+            def(c->getVariable(), v);
+            continue;
+        }
+        if (!v)
+            continue;
+
+        def(c->getVariable(), type == Check::Alignment ? v : 1);
+        if (type == Check::Type)
+        {
+            def(CheckType(c->getData(), "SIZEOF_").getVariable(), v);
+            def(CheckType(c->getData(), "SIZE_OF_").getVariable(), v);
+        }
+    }
+}
+
+std::vector<const Target *> NinjaGraph::get_dependencies(const Target &tgt) const
+{
+    std::vector<const Target *> deps;
+    for (auto &[k, dep] : rd[tgt.d].dependencies)
+    {
+        if (dep.flags[pfExecutable] || dep.flags[pfIncludeDirectoriesOnly])
+            continue;
+        auto i = targets.find(dep.target_name);
+        if (i != targets.end())
+            deps.push_back(&i->second);
+    }
+    return deps;
+}
+
+const Usage &NinjaGraph::get_interface(const Target &tgt) const
+{
+    auto i = interfaces.find(tgt.d.target_name);
+    if (i != interfaces.end())
+        return i->second;
+
+    Usage u = tgt.interface_;
+    for (auto dep : get_dependencies(tgt))
+    {
+        if (tgt.d.flags[pfHeaderOnly] || !dep->d.flags[pfPrivateDependency])
+            u.append(get_interface(*dep));
+    }
+    return interfaces[tgt.d.target_name] = u;
+}
+
+Usage NinjaGraph::get_usage(const Target &tgt) const
+{
+    Usage u = tgt.private_;
+    for (auto dep : get_dependencies(tgt))
+        u.append(get_interface(*dep));
+    return u;
+}
+
+std::vector<const Target *> NinjaGraph::get_link_order(const Target &tgt) const
+{
+    // dependents go before their dependencies
+    std::vector<const Target *> order;
+    std::set<const Target *> visited;
+    std::function<void(const Target &)> visit = [&](const Target &t)
+    {
+        for (auto dep : get_dependencies(t))
+        {
+            if (visited.insert(dep).second)
+            {
+                visit(*dep);
+                order.push_back(dep);
+            }
+        }
+    };
+    visit(tgt);
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+String NinjaGraph::get_output_name(const Target &tgt) const
+{
+    auto &d = tgt.d;
+    if (!tgt.p->output_name.empty())
+        return tgt.p->output_name;
+    if (!s.short_local_names)
+        return d.target_name;
+    if (d.flags[pfLocalProject])
+        return d.ppath.back();
+    return d.ppath.back() + "-" + d.version.toString();
+}
+
+String NinjaGraph::print() const
+{
+    auto q = [this](const String &a) { return escape_value(quote_arg(a, t.windows())); };
+    auto join = [&q](const Strings &v, const String &prefix = String())
+    {
+        // keep the first occurrence, so order is preserved
+        String r;
+        StringSet seen;
+        for (auto &a : v)
+        {
+            if (seen.insert(a).second)
+                r += " " + q(prefix + a);
+        }
+        return r;
+    };
+
+    int cfg = Settings::Release;
+    for (int i = 0; i < Settings::CMakeConfigurationType::Max; i++)
+    {
+        if (boost::iequals(configuration_types_normal[i], s.configuration))
+            cfg = i;
+    }
+
+    Context ctx;
+    ctx.addLine("# generated by cppan, do not edit");
+    ctx.addLine();
+    ctx.addLine("ninja_required_version = 1.5");
+    ctx.addLine("builddir = " + escape_path(bs.binary_directory));
+    ctx.addLine();
+    ctx.addLine("cc = " + q(normalize_path(t.cc)));
+    ctx.addLine("cxx = " + q(normalize_path(t.cxx)));
+    ctx.addLine("ar = " + q(normalize_path(t.ar)));
+    ctx.addLine("cflags = " + escape_value(boost::trim_copy(s.c_compiler_flags + " " + s.c_compiler_flags_conf[cfg] + " " + configuration_flags[cfg])));
+    ctx.addLine("cxxflags = " + escape_value(boost::trim_copy(s.cxx_compiler_flags + " " + s.cxx_compiler_flags_conf[cfg] + " " + configuration_flags[cfg])));
+    ctx.addLine("ldflags = " + escape_value(boost::trim_copy(s.link_flags + " " + s.link_flags_conf[cfg])));
+    ctx.addLine("ldlibs = " + escape_value(s.link_libraries));
+    ctx.addLine();
+
+    auto rule = [&ctx](const String &name, const String &command, const String &description, const Strings &more = {})
+    {
+        ctx.addLine("rule " + name);
+        ctx.increaseIndent();
+        ctx.addLine("command = " + command);
+        ctx.addLine("description = " + description);
+        for (auto &m : more)
+            ctx.addLine(m);
+        ctx.decreaseIndent();
+        ctx.addLine();
+    };
+    rule("cc", "$cc $cflags $flags -MD -MF $out.d -c $in -o $out", "Building C object $out", { "depfile = $out.d", "deps = gcc" });
+    rule("cxx", "$cxx $cxxflags $flags -MD -MF $out.d -c $in -o $out", "Building CXX object $out", { "depfile = $out.d", "deps = gcc" });
+    if (t.windows())
+    {
+        rule("ar", "$ar crs $out @$out.rsp", "Linking static library $out", { "rspfile = $out.rsp", "rspfile_content = $in" });
+        rule("link", "$cxx $ldflags @$out.rsp -o $out $libs $ldlibs", "Linking executable $out", { "rspfile = $out.rsp", "rspfile_content = $in" });
+    }
+    else
+    {
+        auto ranlib = t.ranlib.empty() ? String() : " && " + q(normalize_path(t.ranlib)) + " $out";
+        rule("ar", "rm -f $out && $ar qc $out $in" + ranlib, "Linking static library $out");
+        rule("link", "$cxx $ldflags $in -o $out $libs $ldlibs", "Linking executable $out");
+    }
+
+    Strings all;
+    for (auto &[k, tgt] : targets)
+    {
+        if (!tgt.has_output())
+            continue;
+
+        auto &d = tgt.d;
+        auto &p = *tgt.p;
+        auto u = get_usage(tgt);
+
+        auto std_flag = [](int standard, bool extensions, const String &c, const String &gnu)
+        {
+            if (standard == 0)
+                return String();
+            return " -std=" + (extensions ? gnu : c) + std::to_string(standard);
+        };
+        // names accepted by older compilers for the recent standards
+        auto cxx_std_flag = [](int standard, bool extensions)
+        {
+            String v;
+            switch (standard)
+            {
+            case 0:
+                return String();
+            case 17:
+                v = "1z";
+                break;
+            case 20:
+                v = "2a";
+                break;
+            default:
+                v = std::to_string(standard);
+                break;
+            }
+            return " -std=" + String(extensions ? "gnu++" : "c++") + v;
+        };
+        auto flags = join(u.compile_options) + join(u.definitions, "-D") + join(u.include_directories, "-I");
+
+        ctx.addLine("# " + d.target_name);
+        ctx.addLine("cflags_" + d.variable_name + " =" + std_flag(p.c_standard, p.c_extensions, "c", "gnu") + flags);
+        ctx.addLine("cxxflags_" + d.variable_name + " =" +
+            cxx_std_flag(p.cxx_standard, p.cxx_extensions) + flags);
+        ctx.addLine();
+
+        Strings objects;
+        auto obj_dir = bs.binary_directory / "obj" / d.getHashShort();
+        for (auto &f : FilesSorted(tgt.sources.begin(), tgt.sources.end()))
+        {
+            auto r = f.lexically_relative(tgt.sdir);
+            if (r.empty() || *r.begin() == "..")
+                r = path("external") / sha256(normalize_path(f)).substr(0, 8) / f.filename();
+            auto o = escape_path(obj_dir / (r.string() + ".o"));
+            objects.push_back(o);
+
+            auto c = f.extension() == ".c" || f.extension() == ".s" || f.extension() == ".S";
+            ctx.addLine("build " + o + ": " + (c ? "cc " : "cxx ") + escape_path(f));
+            ctx.increaseIndent();
+            ctx.addLine("flags = $" + String(c ? "cflags_" : "cxxflags_") + d.variable_name);
+            ctx.decreaseIndent();
+        }
+
+        auto out = escape_path(tgt.output);
+        if (d.flags[pfExecutable])
+        {
+            Strings libs, link, deps;
+            for (auto dep : get_link_order(tgt))
+            {
+                if (dep->has_output())
+                {
+                    libs.push_back(normalize_path(dep->output));
+                    deps.push_back(escape_path(dep->output));
+                }
+            }
+            link = tgt.link;
+            for (auto dep : get_link_order(tgt))
+                link.insert(link.end(), dep->link.begin(), dep->link.end());
+
+            ctx.addLine("build " + out + ": link " + boost::join(objects, " ") + (deps.empty() ? "" : " | " + boost::join(deps, " ")));
+            ctx.increaseIndent();
+            ctx.addLine("libs =" + join(libs) + join(link));
+            ctx.decreaseIndent();
+        }
+        else
+            ctx.addLine("build " + out + ": ar " + boost::join(objects, " "));
+        ctx.addLine("build " + d.target_name + ": phony " + out);
+        ctx.addLine();
+
+        all.push_back(out);
+    }
+
+    ctx.addLine("build all: phony " + boost::join(all, " "));
+    ctx.addLine("default all");
+
+    return ctx.getText();
+}
+
+bool has_insertions(const BuildSystemConfigInsertions &bsi)
+{
+    bool has = false;
+#define BSI(x) has |= !bsi.x.empty();
+#include <bsi.inl>
+#undef BSI
+    return has;
+}
+
+// features applied only by the cmake printer,
+// returns the first one found in the graph or an empty string
+String get_cmake_only_feature(const Package &root)
+{
+    std::set<Package> seen;
+    std::vector<Package> q{ root };
+    while (!q.empty())
+    {
+        auto pkg = q.back();
+        q.pop_back();
+        for (auto &[k, d] : rd[pkg].dependencies)
+        {
+            if (!seen.insert(d).second)
+                continue;
+            q.push_back(d);
+
+            auto &p = rd[d].config->getDefaultProject();
+            if (!p.condition.empty())
+                return d.target_name + " has condition: " + p.condition;
+            if (!p.include_script.empty() || p.import_from_bazel)
+                return d.target_name + " has cmake scripts";
+            if (has_insertions(p.bs_insertions) ||
+                std::any_of(p.options.begin(), p.options.end(), [](const auto &o) { return has_insertions(o.second.bs_insertions); }))
+                return d.target_name + " has build system insertions";
+            for (auto &c : p.checks.checks)
+            {
+                auto t = c->getInformation().type;
+                if (t == Check::Library || t == Check::Custom)
+                    return d.target_name + " has checks that need cmake: " + c->getVariable();
+            }
+        }
+    }
+    return String();
+}
+
+// evaluated with the compiler directly, same toolchain results are reused
+CheckValues evaluate_checks(Checks checks, const ParallelCheckOptions &o)
+{
+    TRACE_SCOPE("ninja checks");
+
+    const auto &us = Settings::get_user_settings();
+    int N = std::thread::hardware_concurrency();
+    if (us.var_check_jobs > 0)
+        N = std::min<int>(N, us.var_check_jobs);
+    N = std::max(N, 1);
+
+    NativeChecker native_checker(o);
+    if (!native_checker.supported())
+        throw std::runtime_error("Compiler is not supported by the native checker: " + normalize_path(o.cxx_compiler));
+    const auto toolchain = o.getFingerprint();
+
+    auto &db = getServiceDatabase();
+    Checks stored_checks;
+    CheckTimes times;
+    try
+    {
+        stored_checks = checks.remove_known_results(db.getCheckResults(toolchain));
+        times = db.getCheckTimes(toolchain);
+    }
+    catch (std::exception &e)
+    {
+        LOG_DEBUG(logger, "-- Cannot read check results: " << e.what());
+    }
+    auto aliases = checks.remove_aliases();
+
+    // decls include headers found by other checks
+    Checks decls;
+    for (auto &c : checks.checks)
+    {
+        if (c->getInformation().type == Check::Decl)
+            decls.checks.insert(c);
+    }
+    for (auto &c : decls.checks)
+        checks.checks.erase(c);
+
+    auto evaluated = native_checker.check(checks, N, times);
+    CheckValues values;
+    for (auto &c : stored_checks.checks)
+        values[c->getVariable()] = c->getValue();
+    for (auto &c : evaluated.checks)
+        values[c->getVariable()] = c->getValue();
+    add_alias_values(aliases, values);
+    evaluated += native_checker.check(decls, N, times, values);
+
+    // values would be different from the cmake build
+    auto n = checks.checks.size() + decls.checks.size();
+    if (n)
+        throw std::runtime_error(std::to_string(n) + " checks cannot be evaluated without cmake, use cmake printer");
+    if (!evaluated.checks.empty())
+        LOG_INFO(logger, "-- Performed " << evaluated.checks.size() << " checks natively");
+
+    try
+    {
+        db.addCheckTimes(toolchain, evaluated);
+        db.addCheckResults(toolchain, evaluated.get_results());
+    }
+    catch (std::exception &e)
+    {
+        LOG_DEBUG(logger, "-- Cannot write check results: " << e.what());
+    }
+
+    evaluated += stored_checks;
+    evaluated.add_aliases(aliases);
+
+    values.clear();
+    for (auto &c : evaluated.checks)
+        values[c->getVariable()] = c->getValue();
+    return values;
+}
+
+}
+
+bool NinjaPrinter::use_cmake() const
+{
+    if (!cmake_fallback)
+    {
+        auto f = get_cmake_only_feature(d);
+        if (!f.empty())
+            LOG_INFO(logger, "Building with cmake printer: " + f);
+        cmake_fallback = !f.empty();
+    }
+    return cmake_fallback.value();
+}
+
+void NinjaPrinter::prepare_build(const BuildSettings &bs) const
+{
+    // compiler is detected by cmake
+    if (bs.test_run || use_cmake())
+        return CMakePrinter::prepare_build(bs);
+    fs::create_directories(bs.binary_directory);
+}
+
+int NinjaPrinter::generate(const BuildSettings &bs) const
+{
+    if (bs.test_run || use_cmake())
+        return CMakePrinter::generate(bs);
+
+    TRACE_SCOPE("generate");
+
+    LOG_INFO(logger, "Generating build files...");
+
+    auto &s = Settings::get_local_settings();
+    auto t = load_toolchain(bs, s);
+
+    NinjaGraph g(bs, t);
+    g.add(d);
+
+    if (!bs.disable_checks)
+    {
+        ParallelCheckOptions o;
+        o.dir = bs.binary_directory / "checks";
+        o.generator = "Ninja";
+        o.c_compiler = t.cc;
+        o.cxx_compiler = t.cxx;
+        o.c_flags = s.c_compiler_flags;
+        o.cxx_flags = s.cxx_compiler_flags;
+        g.add_check_definitions(evaluate_checks(g.get_checks(), o));
+    }
+
+    write_file_if_changed(bs.binary_directory / ninja_config_filename, g.print());
+    return 0;
+}
+
+int NinjaPrinter::build(const BuildSettings &bs) const
+{
+    if (use_cmake())
+        return CMakePrinter::build(bs);
+
+    TRACE_SCOPE("build");
+
+    LOG_INFO(logger, "Starting build process...");
+
+    primitives::Command c;
+    c.args.push_back("ninja");
+    c.args.push_back("-C");
+    c.args.push_back(normalize_path(bs.binary_directory));
+    c.args.push_back("-f");
+    c.args.push_back(ninja_config_filename);
+    for (auto &a : settings.additional_build_args)
+        c.args.push_back(a);
+
+    if (settings.build_system_verbose)
+        c.inherit = true;
+    std::error_code ec;
+    JobToken t;
+    counter_add(Counter::ProcessesSpawned);
+    c.execute(ec);
+    if (ec)
+        throw std::runtime_error("Run command '" + c.print() + "', error: " + boost::trim_copy(ec.message()));
+    return c.exit_code.value();
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2016-2017, Egor Pugin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "cmake.h"
+
+// Builds the whole resolved graph from a single ninja file
+// that is written directly from package data, so there is no cmake
+// configure step for dependencies.
+//
+// The compiler is detected once by cmake during test run.
+// Package configs are still printed by the cmake printer,
+// so they can be used from cmake projects as before.
+//
+// Limitations: gcc compatible compilers only, static libraries only.
+// Packages with conditions, cmake scripts, build system insertions
+// or checks that need cmake are built by the cmake printer instead.
+struct NinjaPrinter : CMakePrinter
+{
+    virtual ~NinjaPrinter() = default;
+
+    void prepare_build(const BuildSettings &bs) const override;
+    int generate(const BuildSettings &bs) const override;
+    int build(const BuildSettings &bs) const override;
+
+private:
+    mutable optional<bool> cmake_fallback;
+
+    bool use_cmake() const;
+};
@@ -17,6 +17,7 @@
 #include "printer.h"
 
 #include "cmake.h"
+#include "ninja.h"
 #include "settings.h"
 
 const std::vector<String> configuration_types = { "DEBUG", "MINSIZEREL", "RELEASE", "RELWITHDEBINFO" };
@@ -29,6 +30,8 @@ std::unique_ptr<Printer> Printer::create(PrinterType type)
     {
     case PrinterType::CMake:
         return std::make_unique<CMakePrinter>();
+    case PrinterType::Ninja:
+        return std::make_unique<NinjaPrinter>();
     default:
         throw std::runtime_error("Undefined printer");
     }
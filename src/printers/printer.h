@@ -36,7 +36,7 @@ extern const Strings configuration_types_no_rel;
 enum class PrinterType
 {
     CMake,
-    //Ninja,
+    Ninja,
     // add more here
 };
 
@@ -16,9 +16,156 @@
 
 #include "context.h"
 
+CMakeContext::CMakeContext(const CMakeContext &rhs)
+{
+    *this = rhs;
+}
+
+CMakeContext &CMakeContext::operator=(const CMakeContext &rhs)
+{
+    if (this == &rhs)
+        return *this;
+    text = rhs.text;
+    lines = rhs.lines;
+    n_indents = rhs.n_indents;
+    before_ = rhs.before_ ? std::make_unique<CMakeContext>(*rhs.before_) : nullptr;
+    after_ = rhs.after_ ? std::make_unique<CMakeContext>(*rhs.after_) : nullptr;
+    return *this;
+}
+
+void CMakeContext::addLine()
+{
+    lines.push_back({ text.size(), 0, 0 });
+}
+
+void CMakeContext::prepareLastLine()
+{
+    if (lines.empty())
+    {
+        addLine();
+        return;
+    }
+    // only the last line can grow in place
+    auto &l = lines.back();
+    if (l.offset + l.size == text.size())
+        return;
+    auto offset = text.size();
+    text.append(text, l.offset, l.size);
+    l.offset = offset;
+}
+
+void CMakeContext::increaseIndent(int n)
+{
+    n_indents += n;
+}
+
+void CMakeContext::increaseIndent(std::string_view s, int n)
+{
+    addLine(s);
+    increaseIndent(n);
+}
+
+void CMakeContext::decreaseIndent(int n)
+{
+    n_indents -= n;
+}
+
+void CMakeContext::decreaseIndent(std::string_view s, int n)
+{
+    decreaseIndent(n);
+    addLine(s);
+}
+
+void CMakeContext::emptyLines(int n)
+{
+    int e = 0;
+    for (auto i = lines.rbegin(); i != lines.rend() && i->size == 0; ++i)
+        e++;
+    if (e > n)
+        lines.resize(lines.size() - (e - n));
+    for (; e < n; e++)
+        addLine();
+}
+
+void CMakeContext::splitLines()
+{
+    std::vector<Line> ls;
+    ls.reserve(lines.size());
+    for (auto &l : lines)
+    {
+        std::string_view v(text.data() + l.offset, l.size);
+        size_t offset = 0;
+        for (auto p = v.find('\n'); p != v.npos; p = v.find('\n', offset))
+        {
+            ls.push_back({ l.offset + offset, p - offset, l.indent });
+            offset = p + 1;
+        }
+        ls.push_back({ l.offset + offset, l.size - offset, l.indent });
+    }
+    lines = std::move(ls);
+
+    if (before_)
+        before_->splitLines();
+    if (after_)
+        after_->splitLines();
+}
+
+CMakeContext &CMakeContext::before()
+{
+    if (!before_)
+        before_ = std::make_unique<CMakeContext>();
+    return *before_;
+}
+
+CMakeContext &CMakeContext::after()
+{
+    if (!after_)
+        after_ = std::make_unique<CMakeContext>();
+    return *after_;
+}
+
+void CMakeContext::addWithRelativeIndent(const CMakeContext &rhs)
+{
+    // rhs may be this
+    const auto base = text.size();
+    const auto n = rhs.lines.size();
+    text.append(rhs.text);
+    lines.reserve(lines.size() + n);
+    for (size_t i = 0; i < n; i++)
+    {
+        auto l = rhs.lines[i];
+        lines.push_back({ base + l.offset, l.size, l.indent + n_indents });
+    }
+}
+
+CMakeContext &CMakeContext::operator+=(const CMakeContext &rhs)
+{
+    if (rhs.before_)
+        before().addWithRelativeIndent(*rhs.before_);
+    addWithRelativeIndent(rhs);
+    if (rhs.after_)
+        after().addWithRelativeIndent(*rhs.after_);
+    return *this;
+}
+
+size_t CMakeContext::getSize() const
+{
+    size_t n = 0;
+    write([&n](std::string_view s) { n += s.size(); });
+    return n;
+}
+
+String CMakeContext::getText() const
+{
+    String s;
+    s.reserve(getSize());
+    write([&s](std::string_view v) { s.append(v.data(), v.size()); });
+    return s;
+}
+
 void CMakeContext::if_(const String &s)
 {
-    addLine("if (" + s + ")");
+    addLine("if (", s, ")");
     increaseIndent();
 }
 
@@ -26,7 +173,7 @@ void CMakeContext::elseif(const String &s)
 {
     decreaseIndent();
     emptyLines(0);
-    addLine("elseif(" + s + ")");
+    addLine("elseif(", s, ")");
     increaseIndent();
 }
 
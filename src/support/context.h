@@ -16,21 +16,118 @@
 
 #pragma once
 
-#include <primitives/context.h>
 #include <primitives/string.h>
 
-class CMakeContext : public Context
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Text builder for generated cmake files.
+//
+// Text of all lines is stored in one buffer, lines are (offset, size, indent)
+// records into it. Indentation is applied only when text is written out,
+// so adding lines, merging contexts and splitting lines do not copy strings around.
+// addLine() and addText() take several pieces to avoid temporary concatenations:
+//     ctx.addLine("set(", name, " ", value, ")");
+class CMakeContext
 {
 public:
+    CMakeContext() = default;
+    CMakeContext(const CMakeContext &rhs);
+    CMakeContext &operator=(const CMakeContext &rhs);
+    CMakeContext(CMakeContext &&) = default;
+    CMakeContext &operator=(CMakeContext &&) = default;
+
+    void addLine();
+    template <class ... Args>
+    void addLine(const Args & ... args)
+    {
+        auto offset = text.size();
+        append(args...);
+        lines.push_back({ offset, text.size() - offset, n_indents });
+    }
+
+    // appends to the last line
+    template <class ... Args>
+    void addText(const Args & ... args)
+    {
+        prepareLastLine();
+        append(args...);
+        lines.back().size = text.size() - lines.back().offset;
+    }
+
+    void increaseIndent(int n = 1);
+    void increaseIndent(std::string_view s, int n = 1);
+    void decreaseIndent(int n = 1);
+    void decreaseIndent(std::string_view s, int n = 1);
+
+    // leaves exactly n empty lines at the end
+    void emptyLines(int n = 1);
+    // lines with '\n' inside become separate lines with the same indentation
+    void splitLines();
+
+    CMakeContext &before();
+    CMakeContext &after();
+
+    // lines of rhs are indented relative to the current indentation
+    CMakeContext &operator+=(const CMakeContext &rhs);
+    // same, but before() and after() of rhs are dropped
+    void addWithRelativeIndent(const CMakeContext &rhs);
+
     void if_(const String &s);
     void elseif(const String &s);
     void else_();
     void endif();
 
-    // set()
+    // calls f(std::string_view) for every piece of the text in order,
+    // use it to stream text into a file or a hasher
+    template <class F>
+    void write(F &&f) const
+    {
+        if (before_)
+            before_->write(f);
+        for (auto &l : lines)
+        {
+            if (l.size)
+            {
+                for (int i = 0; i < l.indent; i++)
+                    f(indent);
+                f(std::string_view(text).substr(l.offset, l.size));
+            }
+            f(newline);
+        }
+        if (after_)
+            after_->write(f);
+    }
+
+    // size of getText()
+    size_t getSize() const;
+    String getText() const;
+
+private:
+    struct Line
+    {
+        size_t offset;
+        size_t size;
+        int indent;
+    };
+
+    static constexpr std::string_view indent = "    ";
+    static constexpr std::string_view newline = "\n";
+
+    String text;
+    std::vector<Line> lines;
+    int n_indents = 0;
+    std::unique_ptr<CMakeContext> before_;
+    std::unique_ptr<CMakeContext> after_;
+
+    void append() {}
+    template <class ... Args>
+    void append(std::string_view s, const Args & ... args)
+    {
+        text.append(s.data(), s.size());
+        append(args...);
+    }
 
-    // TODO: add
-    //  beginOnce();
-    //  endOnce()
-    // based on ${CMAKE_CURRENT_LIST_FILE} ${CMAKE_CURRENT_LIST_DIR} ${CMAKE_CURRENT_LIST_LINE}
+    void prepareLastLine();
 };
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2016-2017, Egor Pugin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "counters.h"
+
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+static const char *counter_names[] =
+{
+    "sqlite_statements",
+    "sqlite_time_us",
+    "files_stat",
+    "files_read",
+    "files_written",
+    "regex_compiled",
+    "processes_spawned",
+};
+
+static_assert(sizeof(counter_names) / sizeof(counter_names[0]) == (size_t)Counter::Max,
+    "counter_names must match Counter enum");
+
+static std::atomic<int64_t> counters[(int)Counter::Max];
+
+static std::mutex named_counters_mutex;
+static std::map<String, int64_t> named_counters;
+
+static bool print_counters = false;
+
+void counter_add(Counter c, int64_t v)
+{
+    counters[(int)c].fetch_add(v, std::memory_order_relaxed);
+}
+
+void counter_add(const String &name, int64_t v)
+{
+    std::unique_lock<std::mutex> lk(named_counters_mutex);
+    named_counters[name] += v;
+}
+
+void counters_init(bool print_on_exit)
+{
+    print_counters = print_on_exit;
+}
+
+String counters_to_json()
+{
+    String s = "{\n";
+    for (int i = 0; i < (int)Counter::Max; i++)
+        s += String("    \"") + counter_names[i] + "\": " + std::to_string(counters[i].load()) + ",\n";
+
+    std::unique_lock<std::mutex> lk(named_counters_mutex);
+    for (auto &c : named_counters)
+        s += "    \"" + c.first + "\": " + std::to_string(c.second) + ",\n";
+
+    s.resize(s.size() - 2);
+    s += "\n}\n";
+    return s;
+}
+
+void counters_print()
+{
+    if (print_counters)
+        std::cout << counters_to_json();
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2016-2017, Egor Pugin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "cppan_string.h"
+
+#include <chrono>
+#include <stdint.h>
+
+// Cheap always-on counters of hot operations.
+// Printed as json on exit with --stats.
+
+enum class Counter
+{
+    SqliteStatements,
+    SqliteTimeUs,
+    FilesStat,
+    FilesRead,
+    FilesWritten,
+    RegexCompiled,
+    ProcessesSpawned,
+
+    Max
+};
+
+void counter_add(Counter c, int64_t v = 1);
+
+// for keys known only at runtime, e.g. per remote values
+void counter_add(const String &name, int64_t v = 1);
+
+// adds elapsed time in microseconds on scope exit
+class ScopedCounterTime
+{
+public:
+    ScopedCounterTime(Counter c)
+        : c(c), start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~ScopedCounterTime()
+    {
+        counter_add(c, std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    Counter c;
+    std::chrono::steady_clock::time_point start;
+};
+
+void counters_init(bool print_on_exit);
+String counters_to_json();
+void counters_print();
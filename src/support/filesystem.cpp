@@ -16,6 +16,8 @@
 
 #include "filesystem.h"
 
+#include "counters.h"
+
 path get_config_filename()
 {
     return get_root_directory() / CPPAN_FILENAME;
@@ -50,6 +52,19 @@ String make_archive_name(const String &fn)
     return "cppan.tar.gz";
 }
 
+bool write_file_if_changed(const path &p, const String &s)
+{
+    if (fs::exists(p) && fs::file_size(p) == s.size())
+    {
+        counter_add(Counter::FilesRead);
+        if (read_file(p, true) == s)
+            return false;
+    }
+    counter_add(Counter::FilesWritten);
+    write_file(p, s);
+    return true;
+}
+
 void findRootDirectory1(const path &p, path &root, int depth = 0)
 {
     // limit recursion
@@ -93,3 +108,25 @@ path findRootDirectory(const path &p)
     findRootDirectory1(p, root);
     return root;
 }
+
+SourceGroups make_source_groups(const path &root, const Files &files)
+{
+    SourceGroups sgs;
+    auto r = normalize_path(root);
+    if (r.empty())
+        return sgs;
+    if (r.back() != '/')
+        r += '/';
+    for (auto &f : files)
+    {
+        auto s = normalize_path(f);
+        if (s.compare(0, r.size(), r) != 0)
+            continue;
+        auto p = s.rfind('/');
+        if (p < r.size())
+            sgs[""].insert(s.substr(r.size()));
+        else
+            sgs[s.substr(r.size(), p - r.size())].insert(s.substr(p + 1));
+    }
+    return sgs;
+}
@@ -24,7 +24,15 @@
 #define STORAGE_DIR "storage"
 #define CPPAN_FILENAME "cppan.yml"
 
-using Stamps = std::unordered_map<path, fs::file_time_type>;
+struct FileStamp
+{
+    fs::file_time_type time;
+    // hash of contents written by us
+    String hash;
+};
+
+using Stamps = std::unordered_map<path, FileStamp>;
+// directory relative to the package root ('/' separated, empty for root) -> file names
 using SourceGroups = std::map<String, std::set<String>>;
 
 path get_root_directory();
@@ -37,3 +45,10 @@ String get_stamp_filename(const String &prefix);
 String make_archive_name(const String &fn = String());
 
 path findRootDirectory(const path &p);
+
+// write_file_if_different() that counts real file reads and writes
+// returns true when the file was written
+bool write_file_if_changed(const path &p, const String &s);
+
+// one pass over files, files outside of root are skipped
+SourceGroups make_source_groups(const path &root, const Files &files);
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2016-2017, Egor Pugin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jobserver.h"
+
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+struct JobServer
+{
+    bool enabled = false;
+
+#ifdef _WIN32
+    HANDLE semaphore = nullptr;
+#else
+    int rfd = -1;
+    int wfd = -1;
+#endif
+
+    std::mutex m;
+    bool implicit_free = true;
+
+    bool connect(const String &auth)
+    {
+#ifdef _WIN32
+        semaphore = OpenSemaphoreA(SEMAPHORE_MODIFY_STATE | SYNCHRONIZE, FALSE, auth.c_str());
+        return semaphore != nullptr;
+#else
+        // make >= 4.4
+        if (auth.find("fifo:") == 0)
+        {
+            rfd = wfd = open(auth.substr(5).c_str(), O_RDWR);
+            return rfd != -1;
+        }
+        if (sscanf(auth.c_str(), "%d,%d", &rfd, &wfd) != 2)
+            return false;
+        // fds are closed when make did not consider us a recursive make
+        return fcntl(rfd, F_GETFD) != -1 && fcntl(wfd, F_GETFD) != -1;
+#endif
+    }
+
+    bool create(int jobs)
+    {
+        String flags;
+        if (auto e = getenv("MAKEFLAGS"); e && *e)
+            flags = e + " "s;
+        flags += "-j" + std::to_string(jobs);
+
+#ifdef _WIN32
+        auto name = "cppan_jobserver_" + std::to_string(getpid());
+        semaphore = CreateSemaphoreA(nullptr, jobs - 1, jobs - 1, name.c_str());
+        if (!semaphore)
+            return false;
+        flags += " --jobserver-auth=" + name;
+        _putenv_s("MAKEFLAGS", flags.c_str());
+#else
+        // children must inherit the pipe, so no O_CLOEXEC here
+        int fds[2];
+        if (pipe(fds) != 0)
+            return false;
+        rfd = fds[0];
+        wfd = fds[1];
+        for (int i = 1; i < jobs; i++)
+        {
+            if (write(wfd, "+", 1) != 1)
+                return false;
+        }
+        auto fds_s = std::to_string(rfd) + "," + std::to_string(wfd);
+        // old makes understand only --jobserver-fds
+        flags += " --jobserver-fds=" + fds_s + " --jobserver-auth=" + fds_s;
+        setenv("MAKEFLAGS", flags.c_str(), 1);
+#endif
+        return true;
+    }
+
+    bool acquire(char &token)
+    {
+#ifdef _WIN32
+        return WaitForSingleObject(semaphore, INFINITE) == WAIT_OBJECT_0;
+#else
+        while (1)
+        {
+            auto r = read(rfd, &token, 1);
+            if (r == 1)
+                return true;
+            if (r == -1 && errno == EINTR)
+                continue;
+            // make may give us a non-blocking pipe
+            if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                pollfd p{ rfd, POLLIN, 0 };
+                poll(&p, 1, -1);
+                continue;
+            }
+            // do not hang forever on a broken jobserver
+            return false;
+        }
+#endif
+    }
+
+    void release(char token)
+    {
+#ifdef _WIN32
+        ReleaseSemaphore(semaphore, 1, nullptr);
+#else
+        while (write(wfd, &token, 1) == -1 && errno == EINTR)
+            ;
+#endif
+    }
+};
+
+static JobServer &get_jobserver()
+{
+    static JobServer j;
+    return j;
+}
+
+static String get_jobserver_auth()
+{
+    auto e = getenv("MAKEFLAGS");
+    if (!e)
+        return String();
+    String flags = e;
+
+    // the last one wins
+    String auth;
+    for (auto &o : { "--jobserver-fds="s, "--jobserver-auth="s })
+    {
+        auto p = flags.rfind(o);
+        if (p == flags.npos)
+            continue;
+        p += o.size();
+        auth = flags.substr(p, flags.find(' ', p) - p);
+    }
+    return auth;
+}
+
+void jobserver_init(int jobs)
+{
+    auto &j = get_jobserver();
+
+    auto auth = get_jobserver_auth();
+    if (!auth.empty() && j.connect(auth))
+    {
+        j.enabled = true;
+        return;
+    }
+
+    // we are top level (or make did not share its jobserver with us)
+    if (jobs <= 0)
+        jobs = std::thread::hardware_concurrency();
+    if (jobs <= 0)
+        return;
+    j.enabled = j.create(jobs);
+}
+
+JobToken::JobToken()
+{
+    auto &j = get_jobserver();
+    if (!j.enabled)
+        return;
+
+    {
+        std::unique_lock<std::mutex> lk(j.m);
+        if (j.implicit_free)
+        {
+            j.implicit_free = false;
+            implicit = true;
+            return;
+        }
+    }
+
+    acquired = j.acquire(token);
+}
+
+JobToken::~JobToken()
+{
+    auto &j = get_jobserver();
+    if (implicit)
+    {
+        std::unique_lock<std::mutex> lk(j.m);
+        j.implicit_free = true;
+    }
+    else if (acquired)
+        j.release(token);
+}
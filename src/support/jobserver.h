@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2016-2017, Egor Pugin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "cppan_string.h"
+
+// GNU make compatible jobserver.
+//
+// When cppan is started by make (MAKEFLAGS has --jobserver-auth or --jobserver-fds),
+// it takes job tokens from make's jobserver.
+// Top level cppan creates a jobserver itself and passes it to child processes
+// (cmake, make, nested cppan) in MAKEFLAGS, so the whole process tree
+// runs at most N jobs at once.
+//
+// Every process gets one implicit token from its parent,
+// so the first job of a process never waits.
+
+// jobs <= 0 means number of cpus
+void jobserver_init(int jobs);
+
+// holds one job slot while alive
+class JobToken
+{
+public:
+    JobToken();
+    ~JobToken();
+
+    JobToken(const JobToken &) = delete;
+    JobToken &operator=(const JobToken &) = delete;
+
+private:
+    bool implicit = false;
+    bool acquired = false;
+    char token = '+';
+};
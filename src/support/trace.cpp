@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2016-2017, Egor Pugin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "trace.h"
+
+#include <boost/algorithm/string.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#define TRACE_PART_EXTENSION ".part"
+
+struct TraceEvent
+{
+    String name;
+    const char *category;
+    int64_t ts; // us
+    int64_t dur; // us
+    int tid;
+};
+
+struct Tracer
+{
+    std::atomic_bool enabled{ false };
+    bool owner = false;
+    path fn;
+    String process_name;
+
+    std::mutex m;
+    std::vector<TraceEvent> events;
+    int n_threads = 0;
+
+    int get_tid()
+    {
+        // small sequential ids are easier to read than native ones
+        thread_local int tid = -1;
+        if (tid == -1)
+        {
+            std::unique_lock<std::mutex> lk(m);
+            tid = n_threads++;
+        }
+        return tid;
+    }
+};
+
+static Tracer &get_tracer()
+{
+    static Tracer t;
+    return t;
+}
+
+static String escape_json(const String &s)
+{
+    String r;
+    r.reserve(s.size());
+    for (auto c : s)
+    {
+        switch (c)
+        {
+        case '"':
+            r += "\\\"";
+            break;
+        case '\\':
+            r += "\\\\";
+            break;
+        case '\n':
+            r += "\\n";
+            break;
+        default:
+            if ((unsigned char)c >= 0x20)
+                r += c;
+            break;
+        }
+    }
+    return r;
+}
+
+static int64_t to_us(const std::chrono::system_clock::time_point &t)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+}
+
+void trace_init(const path &fn, const String &process_name)
+{
+    auto &t = get_tracer();
+    t.process_name = process_name;
+
+    if (!fn.empty())
+    {
+        t.owner = true;
+        t.fn = fs::absolute(fn);
+        // let child processes know where to write
+#ifdef _WIN32
+        _putenv_s(CPPAN_TRACE_FILE_ENV, t.fn.string().c_str());
+#else
+        setenv(CPPAN_TRACE_FILE_ENV, t.fn.string().c_str(), 1);
+#endif
+    }
+    else
+    {
+        auto e = getenv(CPPAN_TRACE_FILE_ENV);
+        if (!e || !*e)
+            return;
+        t.fn = path(e).string() + "." + std::to_string(getpid()) + TRACE_PART_EXTENSION;
+    }
+    t.enabled = true;
+}
+
+bool trace_enabled()
+{
+    return get_tracer().enabled;
+}
+
+void trace_save()
+{
+    auto &t = get_tracer();
+    if (!t.enabled)
+        return;
+
+    std::unique_lock<std::mutex> lk(t.m);
+
+    auto pid = std::to_string(getpid());
+    String s;
+    s += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + pid +
+        ",\"args\":{\"name\":\"" + escape_json(t.process_name) + "\"}}";
+    for (auto &e : t.events)
+    {
+        s += ",\n{\"name\":\"" + escape_json(e.name) + "\",\"cat\":\"" + e.category +
+            "\",\"ph\":\"X\",\"ts\":" + std::to_string(e.ts) + ",\"dur\":" + std::to_string(e.dur) +
+            ",\"pid\":" + pid + ",\"tid\":" + std::to_string(e.tid) + "}";
+    }
+    t.events.clear();
+
+    if (!t.owner)
+    {
+        write_file(t.fn, s);
+        return;
+    }
+
+    // merge events of child processes
+    auto prefix = t.fn.filename().string() + ".";
+    error_code ec;
+    for (auto &f : fs::directory_iterator(t.fn.parent_path(), ec))
+    {
+        auto fn = f.path().filename().string();
+        if (fn.find(prefix) != 0 || !boost::ends_with(fn, TRACE_PART_EXTENSION))
+            continue;
+        auto p = read_file(f.path());
+        if (!p.empty())
+            s += ",\n" + p;
+        fs::remove(f.path(), ec);
+    }
+
+    write_file(t.fn, "{\"traceEvents\":[\n" + s + "\n],\n\"displayTimeUnit\":\"ms\"}\n");
+}
+
+ScopedTrace::ScopedTrace(const String &name, const char *category)
+    : category(category), enabled(trace_enabled())
+{
+    if (!enabled)
+        return;
+    this->name = name;
+    start = std::chrono::system_clock::now();
+}
+
+ScopedTrace::~ScopedTrace()
+{
+    if (!enabled)
+        return;
+
+    auto &t = get_tracer();
+    TraceEvent e;
+    e.name = std::move(name);
+    e.category = category;
+    e.ts = to_us(start);
+    e.dur = to_us(std::chrono::system_clock::now()) - e.ts;
+    e.tid = t.get_tid();
+
+    std::unique_lock<std::mutex> lk(t.m);
+    t.events.push_back(std::move(e));
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2016-2017, Egor Pugin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "cppan_string.h"
+#include "filesystem.h"
+
+#include <chrono>
+
+// Phase tracing in Chrome/Perfetto trace-event format.
+//
+// The process started with --trace-file owns the output file.
+// Child cppan processes (e.g. internal-parallel-vars-check started by cmake)
+// find the file in environment and write their events to part files
+// which are merged by the owner on exit.
+
+#define CPPAN_TRACE_FILE_ENV "CPPAN_TRACE_FILE"
+
+// fn is empty for child processes
+void trace_init(const path &fn, const String &process_name);
+bool trace_enabled();
+void trace_save();
+
+class ScopedTrace
+{
+public:
+    ScopedTrace(const String &name, const char *category = "cppan");
+    ~ScopedTrace();
+
+private:
+    String name;
+    const char *category;
+    std::chrono::system_clock::time_point start;
+    bool enabled;
+};
+
+#define TRACE_SCOPE_CONCAT2(a, b) a ## b
+#define TRACE_SCOPE_CONCAT(a, b) TRACE_SCOPE_CONCAT2(a, b)
+// name expression is evaluated only when tracing is enabled
+#define TRACE_SCOPE(name) \
+    ScopedTrace TRACE_SCOPE_CONCAT(trace_scope_, __LINE__)(trace_enabled() ? String(name) : String())
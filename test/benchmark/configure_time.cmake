@@ -0,0 +1,413 @@
+#
+# cppan
+#
+
+################################################################################
+#
+# configure time of generated package configs
+#
+# Compares per-package boilerplate inlined into every config (as cppan
+# printed it before) with calls of shared functions from functions.cmake.
+# Packages form a graph where every package depends on up to four previous
+# ones, build dependencies are transitive like in cppan configs.
+#
+# usage (cmake 3.23+):
+#   cmake -DFUNCTIONS=/path/to/src/inserts/functions.cmake [-DN=200] [-DREPEAT=3] -P configure_time.cmake
+#
+################################################################################
+
+if (NOT FUNCTIONS)
+    message(FATAL_ERROR "Set FUNCTIONS to the path of functions.cmake")
+endif()
+if (NOT N)
+    set(N 200)
+endif()
+if (NOT REPEAT)
+    set(REPEAT 3)
+endif()
+
+set(root ${CMAKE_CURRENT_BINARY_DIR}/cppan_configure_benchmark)
+
+########################################
+# templates
+########################################
+
+set(package_begin_inline [=[
+add_library(@name@ STATIC ${CMAKE_CURRENT_SOURCE_DIR}/../dummy.cpp)
+target_link_libraries(@name@ PUBLIC @deps@)
+
+if (DEFINED CPPAN_BUILD_WARNING_LEVEL AND
+    CPPAN_BUILD_WARNING_LEVEL GREATER -1 AND CPPAN_BUILD_WARNING_LEVEL LESS 5)
+    if (MSVC)
+        set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} /W${CPPAN_BUILD_WARNING_LEVEL}")
+        set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} /W${CPPAN_BUILD_WARNING_LEVEL}")
+    endif()
+    if (CLANG OR GCC)
+        set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -w")
+        set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -w")
+    endif()
+endif()
+
+if (MSVC)
+    if (NOT CLANG)
+        set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} /MP")
+        set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} /MP")
+    endif()
+    if (CPPAN_MT_BUILD)
+        set(CMAKE_C_FLAGS_RELEASE "${CMAKE_C_FLAGS_RELEASE} /MT")
+        set(CMAKE_C_FLAGS_RELWITHDEBINFO "${CMAKE_C_FLAGS_RELWITHDEBINFO} /MT")
+        set(CMAKE_C_FLAGS_MINSIZEREL "${CMAKE_C_FLAGS_MINSIZEREL} /MT")
+        set(CMAKE_C_FLAGS_DEBUG "${CMAKE_C_FLAGS_DEBUG} /MTd")
+        set(CMAKE_CXX_FLAGS_RELEASE "${CMAKE_CXX_FLAGS_RELEASE} /MT")
+        set(CMAKE_CXX_FLAGS_RELWITHDEBINFO "${CMAKE_CXX_FLAGS_RELWITHDEBINFO} /MT")
+        set(CMAKE_CXX_FLAGS_MINSIZEREL "${CMAKE_CXX_FLAGS_MINSIZEREL} /MT")
+        set(CMAKE_CXX_FLAGS_DEBUG "${CMAKE_CXX_FLAGS_DEBUG} /MTd")
+    endif()
+endif()
+if (CPPAN_OBJECT_CACHE AND NOT MSVC AND NOT CMAKE_CXX_COMPILER_LAUNCHER)
+    set(CMAKE_C_COMPILER_LAUNCHER ${CPPAN_COMMAND} internal-compile ${CPPAN_OBJECT_CACHE} ${STORAGE_DIR} ${CMAKE_SOURCE_DIR} --)
+    set(CMAKE_CXX_COMPILER_LAUNCHER ${CPPAN_COMMAND} internal-compile ${CPPAN_OBJECT_CACHE} ${STORAGE_DIR} ${CMAKE_SOURCE_DIR} --)
+endif()
+
+if (MSVC)
+    target_compile_definitions(@name@
+        PRIVATE _CRT_SECURE_NO_WARNINGS
+    )
+    target_compile_options(@name@
+        PRIVATE /wd4005
+        PRIVATE /wd4996
+    )
+endif()
+if (CLANG)
+    target_compile_options(@name@
+        PRIVATE -Wno-macro-redefined
+    )
+endif()
+
+if (WIN32)
+    target_link_libraries(@name@
+        PUBLIC Ws2_32
+    )
+else()
+    find_library(m m)
+    if (NOT ${m} STREQUAL "m-NOTFOUND")
+        target_link_libraries(@name@
+            PUBLIC m
+        )
+    endif()
+    find_library(pthread pthread)
+    if (NOT ${pthread} STREQUAL "pthread-NOTFOUND")
+        target_link_libraries(@name@
+            PUBLIC pthread
+        )
+    endif()
+    find_library(rt rt)
+    if (NOT ${rt} STREQUAL "rt-NOTFOUND")
+        target_link_libraries(@name@
+            PUBLIC rt
+        )
+    endif()
+    find_library(dl dl)
+    if (NOT ${dl} STREQUAL "dl-NOTFOUND")
+        target_link_libraries(@name@
+            PUBLIC dl
+        )
+    endif()
+endif()
+
+set(CPPAN_GET_CHILDREN_VARIABLES 1)
+get_configuration_with_generator(config)
+if (CPPAN_BUILD_EXECUTABLES_WITH_SAME_CONFIG)
+    get_configuration_with_generator(config_exe)
+else()
+    get_configuration_exe(config_exe)
+endif()
+set(CPPAN_GET_CHILDREN_VARIABLES 0)
+
+string(TOUPPER "${CMAKE_BUILD_TYPE}" CMAKE_BUILD_TYPE_UPPER)
+set(rest "-DCPPAN_BUILD_EXECUTABLES_WITH_SAME_CONFIGURATION=${CPPAN_BUILD_EXECUTABLES_WITH_SAME_CONFIGURATION} -DCMAKE_BUILD_TYPE=${CMAKE_BUILD_TYPE} -DCPPAN_BUILD_VERBOSE=${CPPAN_BUILD_VERBOSE} -DCPPAN_BUILD_WARNING_LEVEL=${CPPAN_BUILD_WARNING_LEVEL} -DCPPAN_ARTIFACT_STORE=${CPPAN_ARTIFACT_STORE} -DCPPAN_RC_ENABLED=${CPPAN_RC_ENABLED} -DCPPAN_COPY_ALL_LIBRARIES_TO_OUTPUT=${CPPAN_COPY_ALL_LIBRARIES_TO_OUTPUT} -DN_CORES=${N_CORES} -DXCODE=${XCODE} -DNINJA=${NINJA} -DNINJA_FOUND=${NINJA_FOUND} -DVISUAL_STUDIO=${VISUAL_STUDIO} -DCLANG=${CLANG} ")
+
+set(ext sh)
+if (WIN32)
+    set(ext bat)
+endif()
+
+set(file ${CMAKE_CURRENT_BINARY_DIR}/cppan_build_deps_$<CONFIG>.${ext})
+
+set(bat_file_error)
+if (WIN32)
+    set(bat_file_error "@if %errorlevel% neq 0 goto :cmEnd")
+endif()
+
+set(at_symbol)
+if (WIN32)
+    set(at_symbol @)
+endif()
+]=])
+
+set(build_dep_inline [=[
+get_target_property(implib_@dep@ @dep@ IMPORTED_IMPLIB_${CMAKE_BUILD_TYPE_UPPER})
+get_target_property(imploc_@dep@ @dep@ IMPORTED_LOCATION_${CMAKE_BUILD_TYPE_UPPER})
+get_target_property(impson_@dep@ @dep@ IMPORTED_SONAME_${CMAKE_BUILD_TYPE_UPPER})
+if (CPPAN_AGGREGATE_BUILD)
+    set(bd_@dep@)
+else()
+set(bd_@dep@ "
+${at_symbol}\"${CMAKE_COMMAND}\" -DCONFIG=$<CONFIG> -DBUILD_DIR=/obj/@dep@/build/${config} -DEXECUTABLE=0 ${rest} -P /obj/@dep@/build.cmake
+${bat_file_error}")
+endif()
+]=])
+
+set(build_script_inline [=[
+set(bat_file_begin)
+if (WIN32)
+    set(bat_file_begin @setlocal)
+    set(bat_file_error "\n
+@exit /b 0
+:cmEnd
+@endlocal & @call :cmErrorLevel %errorlevel%
+:cmErrorLevel
+@exit /b %1
+")
+else()
+    set(bat_file_begin "#!/bin/sh\n")
+endif()
+file(GENERATE OUTPUT ${file} CONTENT "${bat_file_begin}
+@script@
+${bat_file_error}
+")
+if (ANDROID)
+elseif (UNIX)
+    set(file chmod u+x ${file} COMMAND ${file})
+endif()
+set(bp)
+]=])
+
+set(byproducts_inline [=[
+set(bp ${bp} ${implib_@dep@})
+set(bp ${bp} ${imploc_@dep@})
+set(bp ${bp} ${impson_@dep@})
+]=])
+
+set(copy_begin_inline [=[
+add_custom_target(@name@-b-d
+    COMMAND ${file}
+    BYPRODUCTS ${bp}
+)
+add_dependencies(@name@ @name@-b-d)
+
+set(ext sh)
+if (WIN32)
+    set(ext bat)
+endif()
+set(file ${CMAKE_CURRENT_BINARY_DIR}/cppan_copy_deps_$<CONFIG>.${ext})
+set(copy_content)
+if (WIN32)
+    set(copy_content "${copy_content} @setlocal\n")
+else()
+    set(copy_content "#!/bin/sh\n")
+endif()
+set(output_dir ${CMAKE_BINARY_DIR})
+
+set(at_symbol)
+if (WIN32)
+    set(at_symbol @)
+endif()
+]=])
+
+set(copy_dep_inline [=[
+set(copy 1)
+get_target_property(type @dep@ TYPE)
+if ("${type}" STREQUAL STATIC_LIBRARY)
+    set(copy 0)
+endif()
+if (CPPAN_COPY_ALL_LIBRARIES_TO_OUTPUT)
+    set(copy 1)
+endif()
+if (copy)
+    set(copy_content "${copy_content} ${at_symbol}")
+    set(copy_content "${copy_content} \"${CMAKE_COMMAND}\" -E copy_if_different $<TARGET_FILE:@dep@> ${output_dir}//$<TARGET_FILE_NAME:@dep@>\n")
+    add_dependencies(@name@ @dep@)
+    if (WIN32)
+        set(copy_content "${copy_content} @if %errorlevel% neq 0 goto :cmEnd\n")
+    endif()
+endif()
+]=])
+
+set(copy_end_inline [=[
+if (WIN32)
+    set(copy_content "${copy_content}\n
+@exit /b 0
+:cmEnd
+@endlocal & @call :cmErrorLevel %errorlevel%
+:cmErrorLevel
+@exit /b %1
+")
+endif()
+file(GENERATE OUTPUT ${file} CONTENT "${copy_content}
+")
+if (ANDROID)
+elseif (UNIX)
+    set(file chmod u+x ${file} COMMAND ${file})
+endif()
+add_custom_command(TARGET @name@ POST_BUILD
+    COMMAND ${file}
+)
+]=])
+
+set(package_begin_functions [=[
+add_library(@name@ STATIC ${CMAKE_CURRENT_SOURCE_DIR}/../dummy.cpp)
+target_link_libraries(@name@ PUBLIC @deps@)
+
+cppan_set_warning_level()
+cppan_set_compiler_settings()
+cppan_add_private_definitions(@name@)
+cppan_link_system_libraries(@name@)
+
+cppan_build_dependencies_setup()
+set(build_commands)
+cppan_add_build_dependencies(build_commands 0
+]=])
+
+set(build_dep_functions [=[
+    "/obj/@dep@" 0
+]=])
+
+set(build_script_functions [=[
+)
+cppan_generate_script(file ${CMAKE_CURRENT_BINARY_DIR}/cppan_build_deps_$<CONFIG> build_commands)
+set(bp)
+cppan_add_imported_byproducts(bp PROPERTIES IMPORTED_IMPLIB IMPORTED_LOCATION IMPORTED_SONAME TARGETS
+]=])
+
+set(byproducts_functions [=[
+    @dep@
+]=])
+
+set(copy_begin_functions [=[
+)
+add_custom_target(@name@-b-d
+    COMMAND ${file}
+    BYPRODUCTS ${bp}
+)
+add_dependencies(@name@ @name@-b-d)
+
+set(output_dir ${CMAKE_BINARY_DIR})
+set(copy_commands)
+cppan_add_copy_dependencies(copy_commands @name@ 0
+]=])
+
+set(copy_dep_functions [=[
+    @dep@ "${output_dir}/" "$<TARGET_FILE_NAME:@dep@>"
+]=])
+
+set(copy_end_functions [=[
+)
+cppan_generate_script(file ${CMAKE_CURRENT_BINARY_DIR}/cppan_copy_deps_$<CONFIG> copy_commands)
+add_custom_command(TARGET @name@ POST_BUILD
+    COMMAND ${file}
+)
+]=])
+
+########################################
+# graph
+########################################
+
+math(EXPR last "${N} - 1")
+foreach(i RANGE ${last})
+    set(direct_${i})
+    set(closure_${i})
+    foreach(d 1 2 5 17)
+        math(EXPR j "${i} - ${d}")
+        if (j GREATER -1)
+            list(APPEND direct_${i} p${j})
+            list(APPEND closure_${i} p${j} ${closure_${j}})
+        endif()
+    endforeach()
+    if (closure_${i})
+        list(REMOVE_DUPLICATES closure_${i})
+    endif()
+endforeach()
+
+function(generate_tree variant)
+    set(src ${root}/${variant})
+    file(WRITE ${src}/dummy.cpp "int dummy() { return 0; }\n")
+
+    set(lists "cmake_minimum_required(VERSION 3.2.0)\nproject(benchmark C CXX)\n")
+    set(lists "${lists}include(\"${FUNCTIONS}\")\n")
+    set(lists "${lists}set(CMAKE_BUILD_TYPE Release)\n")
+    set(lists "${lists}set(CPPAN_CONFIG_HASH_METHOD SHA1)\n")
+    set(lists "${lists}set(CPPAN_CONFIG_HASH_SHORT_LENGTH 8)\n")
+    foreach(i RANGE ${last})
+        set(lists "${lists}add_subdirectory(p${i})\n")
+
+        set(name p${i})
+        set(deps ${direct_${i}})
+        string(CONFIGURE "${package_begin_${variant}}" text @ONLY)
+
+        set(script)
+        foreach(dep ${closure_${i}})
+            string(CONFIGURE "${build_dep_${variant}}" t @ONLY)
+            set(text "${text}${t}")
+            set(script "${script}\${bd_${dep}}\n")
+        endforeach()
+        string(CONFIGURE "${build_script_${variant}}" t @ONLY)
+        set(text "${text}${t}")
+        foreach(dep ${closure_${i}})
+            string(CONFIGURE "${byproducts_${variant}}" t @ONLY)
+            set(text "${text}${t}")
+        endforeach()
+
+        string(CONFIGURE "${copy_begin_${variant}}" t @ONLY)
+        set(text "${text}${t}")
+        foreach(dep ${direct_${i}})
+            string(CONFIGURE "${copy_dep_${variant}}" t @ONLY)
+            set(text "${text}${t}")
+        endforeach()
+        string(CONFIGURE "${copy_end_${variant}}" t @ONLY)
+        set(text "${text}${t}")
+
+        file(WRITE ${src}/p${i}/CMakeLists.txt "${text}")
+    endforeach()
+    file(WRITE ${src}/CMakeLists.txt "${lists}")
+endfunction()
+
+########################################
+# run
+########################################
+
+foreach(variant inline functions)
+    generate_tree(${variant})
+
+    set(size 0)
+    foreach(i RANGE ${last})
+        file(SIZE ${root}/${variant}/p${i}/CMakeLists.txt s)
+        math(EXPR size "${size} + ${s}")
+    endforeach()
+    math(EXPR size "${size} / 1024")
+
+    # first run detects compilers
+    set(bdir ${root}/${variant}-build)
+    file(REMOVE_RECURSE ${bdir})
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} -S ${root}/${variant} -B ${bdir}
+        OUTPUT_QUIET
+        RESULT_VARIABLE ret
+    )
+    if (NOT ret EQUAL 0)
+        message(FATAL_ERROR "Configure of ${variant} tree failed")
+    endif()
+
+    set(best)
+    foreach(r RANGE 1 ${REPEAT})
+        string(TIMESTAMP t0 "%s%f")
+        execute_process(COMMAND ${CMAKE_COMMAND} ${bdir} OUTPUT_QUIET)
+        string(TIMESTAMP t1 "%s%f")
+        math(EXPR t "(${t1} - ${t0}) / 1000")
+        if (NOT best OR t LESS best)
+            set(best ${t})
+        endif()
+    endforeach()
+
+    message(STATUS "${variant}: ${N} packages, ${size} KB of configs, configure ${best} ms")
+endforeach()
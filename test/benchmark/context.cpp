@@ -0,0 +1,146 @@
+// Generates configs for a synthetic package graph
+// with primitives Context (string concatenation per line)
+// and with CMakeContext, then prints timings.
+//
+// usage: context_benchmark [packages = 1000] [repeat = 5]
+
+#include <context.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+struct Package
+{
+    String name;
+    String dir;
+    std::vector<int> deps; // transitive
+    std::vector<String> files;
+};
+
+std::vector<Package> make_graph(int n)
+{
+    std::vector<Package> g(n);
+    for (int i = 0; i < n; i++)
+    {
+        auto &p = g[i];
+        p.name = "pvt.cppan.demo.package" + std::to_string(i) + "-1.0.0";
+        p.dir = "/home/user/.cppan/storage/src/" + std::to_string(i % 97) + "/" + std::to_string(i);
+        // up to four previous packages and their deps
+        for (int j = std::max(0, i - 4); j < i; j++)
+        {
+            p.deps.push_back(j);
+            p.deps.insert(p.deps.end(), g[j].deps.begin(), g[j].deps.end());
+        }
+        std::sort(p.deps.begin(), p.deps.end());
+        p.deps.erase(std::unique(p.deps.begin(), p.deps.end()), p.deps.end());
+        if (p.deps.size() > 64)
+            p.deps.erase(p.deps.begin(), p.deps.end() - 64);
+        for (int j = 0; j < 100; j++)
+            p.files.push_back(p.dir + "/src/dir" + std::to_string(j % 10) + "/file" + std::to_string(j) + ".cpp");
+    }
+    return g;
+}
+
+template <class C>
+void print_old(C &ctx, const std::vector<Package> &g, const Package &p)
+{
+    ctx.addLine("# " + p.name);
+    ctx.addLine("set(this " + p.name + ")");
+    ctx.addLine();
+    ctx.increaseIndent("cppan_set_dependency_dirs(");
+    for (auto d : p.deps)
+        ctx.addLine(g[d].name + "_DIR \"" + g[d].dir + "\"");
+    ctx.decreaseIndent(")");
+    ctx.emptyLines();
+    ctx.increaseIndent("set(src");
+    for (auto &f : p.files)
+        ctx.addLine("\"" + f + "\"");
+    ctx.decreaseIndent(")");
+    ctx.addLine("if (CPPAN_USE_CACHE)");
+    ctx.increaseIndent();
+    C local;
+    for (auto d : p.deps)
+    {
+        local.addLine("# " + g[d].name);
+        local.addLine("cppan_include(\"" + g[d].dir + "/generate.cmake\")");
+    }
+    ctx += local;
+    ctx.decreaseIndent();
+    ctx.addLine("endif()");
+    ctx.emptyLines();
+}
+
+void print_new(CMakeContext &ctx, const std::vector<Package> &g, const Package &p)
+{
+    ctx.addLine("# ", p.name);
+    ctx.addLine("set(this ", p.name, ")");
+    ctx.addLine();
+    ctx.increaseIndent("cppan_set_dependency_dirs(");
+    for (auto d : p.deps)
+        ctx.addLine(g[d].name, "_DIR \"", g[d].dir, "\"");
+    ctx.decreaseIndent(")");
+    ctx.emptyLines();
+    ctx.increaseIndent("set(src");
+    for (auto &f : p.files)
+        ctx.addLine("\"", f, "\"");
+    ctx.decreaseIndent(")");
+    ctx.if_("CPPAN_USE_CACHE");
+    CMakeContext local;
+    for (auto d : p.deps)
+    {
+        local.addLine("# ", g[d].name);
+        local.addLine("cppan_include(\"", g[d].dir, "/generate.cmake\")");
+    }
+    ctx += local;
+    ctx.endif();
+    ctx.emptyLines();
+}
+
+template <class F>
+double measure(int repeat, F &&f)
+{
+    double best = 1e100;
+    for (int i = 0; i < repeat; i++)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        f();
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? std::atoi(argv[1]) : 1000;
+    int repeat = argc > 2 ? std::atoi(argv[2]) : 5;
+    auto g = make_graph(n);
+
+    size_t size_old = 0, size_new = 0;
+    auto t_old = measure(repeat, [&]
+    {
+        size_old = 0;
+        for (auto &p : g)
+        {
+            Context ctx;
+            print_old(ctx, g, p);
+            size_old += ctx.getText().size();
+        }
+    });
+    auto t_new = measure(repeat, [&]
+    {
+        size_new = 0;
+        for (auto &p : g)
+        {
+            CMakeContext ctx;
+            print_new(ctx, g, p);
+            size_new += ctx.getText().size();
+        }
+    });
+    std::cout << n << " packages, " << size_new / 1024 << " KB of text\n";
+    std::cout << "Context (concatenation): " << t_old << " ms, " << size_old / 1024 << " KB\n";
+    std::cout << "CMakeContext: " << t_new << " ms\n";
+}
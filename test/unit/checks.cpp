@@ -0,0 +1,105 @@
+#include <checks.h>
+
+#define CATCH_CONFIG_RUNNER
+#include <catch.hpp>
+
+TEST_CASE("binary save/load", "[checks]")
+{
+    Checks c;
+    c.load(YAML::Load(R"xxx(
+check_function_exists:
+    - strdup
+check_include_exists:
+    - stdint.h
+check_type_size:
+    - int64_t
+check_struct_member:
+    - st_mtim: struct stat
+check_library_function:
+    - function: clock_gettime
+      library: rt
+check_symbol_exists:
+    EINTR: errno.h
+check_decl_exists:
+    getpid: unistd.h
+c_source_compiles:
+    HAVE_X: int main() { return 0; }
+c_source_runs:
+    HAVE_Y:
+        text: int main() { return 1; }
+        invert: true
+)xxx"));
+
+    auto fn = fs::temp_directory_path() / "cppan_checks_test.bin";
+    write_file(fn, c.save_binary());
+
+    Checks c2;
+    REQUIRE_NOTHROW(c2.load_binary(fn));
+    fs::remove(fn);
+
+    REQUIRE(c.checks.size() == c2.checks.size());
+    for (auto i1 = c.checks.begin(), i2 = c2.checks.begin(); i1 != c.checks.end(); ++i1, ++i2)
+    {
+        CHECK((*i1)->getVariable() == (*i2)->getVariable());
+        CHECK((*i1)->getHash() == (*i2)->getHash());
+        CHECK((*i1)->default_ == (*i2)->default_);
+        CHECK((*i1)->isOk() == (*i2)->isOk());
+    }
+
+    write_file(fn, "CPPANCHK");
+    REQUIRE_THROWS(c2.load_binary(fn));
+    fs::remove(fn);
+}
+
+TEST_CASE("normalize", "[checks]")
+{
+    Checks c;
+    c.load(YAML::Load(R"xxx(
+check_symbol_exists:
+    - symbol: EINTR
+      headers: [ errno.h, " errno.h" ]
+    - symbol: EINTR
+      headers: [ errno.h ]
+check_include_exists:
+    - file: stdint.h
+      variable: HAVE_STDINT_H
+      cpp: false
+    - file: stdint.h
+      variable: HAS_STDINT
+      cpp: false
+)xxx"));
+
+    // default checks are size_t, void * and the two includes
+    REQUIRE(c.checks.size() == 5);
+
+    auto aliases = c.remove_aliases();
+    REQUIRE(aliases.size() == 1);
+    REQUIRE(c.checks.size() == 4);
+
+    // decls see values of aliases before they are added back
+    CheckValues values;
+    values[aliases[0].second->getVariable()] = 1;
+    add_alias_values(aliases, values);
+    REQUIRE(values.size() == 2);
+    REQUIRE(values[aliases[0].first->getVariable()] == 1);
+
+    aliases[0].second->setValue(1);
+    c.add_aliases(aliases);
+    REQUIRE(c.checks.size() == 5);
+    REQUIRE(aliases[0].first->getValue() == 1);
+
+    // the index of merged checks follows removals
+    Checks all;
+    all += c;
+    all += c;
+    REQUIRE(all.checks.size() == 5);
+    all.remove_aliases();
+    all += c;
+    REQUIRE(all.checks.size() == 5);
+}
+
+int main(int argc, char **argv)
+{
+    auto rc = Catch::Session().run(argc, argv);
+    return rc;
+}
@@ -0,0 +1,54 @@
+#include <context.h>
+
+#define CATCH_CONFIG_RUNNER
+#include <catch.hpp>
+
+TEST_CASE("indent", "[context]")
+{
+    CMakeContext ctx;
+    ctx.addLine("set(", String("a"), " b)");
+    ctx.if_("X");
+    ctx.increaseIndent("set(src");
+    ctx.addLine("\"f\"");
+    ctx.decreaseIndent(")");
+    ctx.addLine();
+    ctx.endif();
+    REQUIRE(ctx.getText() == "set(a b)\nif (X)\n    set(src\n        \"f\"\n    )\nendif()\n");
+    REQUIRE(ctx.getSize() == ctx.getText().size());
+}
+
+TEST_CASE("empty lines", "[context]")
+{
+    CMakeContext ctx;
+    ctx.addLine("a");
+    ctx.emptyLines(2);
+    REQUIRE(ctx.getText() == "a\n\n\n");
+    ctx.emptyLines();
+    REQUIRE(ctx.getText() == "a\n\n");
+    ctx.addText("b", "c");
+    REQUIRE(ctx.getText() == "a\nbc\n");
+}
+
+TEST_CASE("merge and split", "[context]")
+{
+    CMakeContext local;
+    local.addLine("a\nb");
+    local.before().addLine("# before");
+    local.after().addLine("# after");
+
+    CMakeContext ctx;
+    ctx.increaseIndent();
+    ctx += local;
+    // before and after have their own indentation
+    REQUIRE(ctx.getText() == "# before\n    a\nb\n# after\n");
+    ctx.splitLines();
+    REQUIRE(ctx.getText() == "# before\n    a\n    b\n# after\n");
+    ctx.addText("c");
+    REQUIRE(ctx.getText() == "# before\n    a\n    bc\n# after\n");
+}
+
+int main(int argc, char **argv)
+{
+    auto rc = Catch::Session().run(argc, argv);
+    return rc;
+}